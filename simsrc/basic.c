@@ -0,0 +1,505 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads and pastes BASIC programs from text files.
+ *
+ * With option -o file the program listed in the text file is
+ * tokenized here and put into the program area, as LOAD would do:
+ * the keywords become their tokens, the numbers get their hidden
+ * 5 byte form, the parameters of DEF FN the 6 bytes the ROM leaves
+ * for them, and the lines are sorted, a later line replaces an
+ * earlier one of the same number. The numbers are rounded to the
+ * nearest, the ROM may differ in the last bit of the mantissa for
+ * fractions.
+ *
+ * With option -O file the lines of the text file are pasted into the
+ * editor, as if typed, with keywords as single key codes and ENTER at
+ * the end of every line. The lines may be commands, like RUN. The
+ * codes are not typed through the keyboard matrix but handed to the
+ * ROM routine KEY-INPUT in LAST_K with the new key bit in FLAGS set,
+ * as the interrupt does after decoding a key.
+ *
+ * Both wait for the ROM to call KEY-INPUT the first time, then the
+ * program is loaded at once. Until it is loaded and the last code is
+ * pasted the CPU runs at unlimited speed.
+ *
+ * Keywords are recognized in upper or lower case, GO TO, GO SUB,
+ * DEF FN, OPEN # and CLOSE # with or without the space. Spaces
+ * around keywords are dropped, the ROM lists them itself. A keyword
+ * isn't recognized within or directly before letters, so variable
+ * names like total or cost stay. The keywords of statements are only
+ * recognized where a statement starts, at the start of the line,
+ * after : or THEN, so variables like cat or list stay too. Within a
+ * statement only functions and operators, the colour items of PRINT,
+ * PLOT ... and DATA of SAVE, LOAD, VERIFY and MERGE are. Strings and
+ * REM lines are taken as they are.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "basic.h"
+
+/* system variables used */
+#define LAST_K		0x5c08
+#define FLAGS		0x5c3b
+#define VARS		0x5c4b
+#define DEST		0x5c4d
+#define PROG		0x5c53
+#define NXTLIN		0x5c55
+#define DATADD		0x5c57
+#define E_LINE		0x5c59
+#define K_CUR		0x5c5b
+#define CH_ADD		0x5c5d
+#define X_PTR		0x5c5f
+#define WORKSP		0x5c61
+#define STKBOT		0x5c63
+#define STKEND		0x5c65
+
+#define T_FIRST		0xa5		/* token of RND */
+#define T_BIN		0xc4
+#define T_THEN		0xcb
+#define T_DEFFN		0xce		/* first token of a statement */
+#define T_MERGE		0xd5
+#define T_VERIFY	0xd6
+#define T_INK		0xd9
+#define T_OVER		0xde
+#define T_DATA		0xe4
+#define T_REM		0xea
+#define T_LOAD		0xef
+#define T_SAVE		0xf8
+
+#define NTOKENS		(0x100 - T_FIRST)
+#define BODY		(BASIC_LINE * 7)	/* a text byte gives up to 7 */
+
+#define rd16(a)		(memory[a] + (memory[(a) + 1] << 8))
+#define wr16(a, v)	(memory[a] = (v) & 0xff, memory[(a) + 1] = (v) >> 8)
+
+struct line {
+	int num;			/* line number */
+	int seq;			/* position in the file */
+	int len;			/* length of the body */
+	BYTE *body;			/* tokens, ENTER not included */
+};
+
+static const char *tokens[NTOKENS] = {
+	"RND", "INKEY$", "PI", "FN", "POINT", "SCREEN$", "ATTR", "AT",
+	"TAB", "VAL$", "CODE", "VAL", "LEN", "SIN", "COS", "TAN", "ASN",
+	"ACS", "ATN", "LN", "EXP", "INT", "SQR", "SGN", "ABS", "PEEK", "IN",
+	"USR", "STR$", "CHR$", "NOT", "BIN", "OR", "AND", "<=", ">=", "<>",
+	"LINE", "THEN", "TO", "STEP", "DEF FN", "CAT", "FORMAT", "MOVE",
+	"ERASE", "OPEN #", "CLOSE #", "MERGE", "VERIFY", "BEEP", "CIRCLE",
+	"INK", "PAPER", "FLASH", "BRIGHT", "INVERSE", "OVER", "OUT",
+	"LPRINT", "LLIST", "STOP", "READ", "DATA", "RESTORE", "NEW",
+	"BORDER", "CONTINUE", "DIM", "REM", "FOR", "GO TO", "GO SUB",
+	"INPUT", "LOAD", "LIST", "LET", "PAUSE", "NEXT", "POKE", "PRINT",
+	"PLOT", "RUN", "SAVE", "RANDOMIZE", "IF", "CLS", "DRAW", "CLEAR",
+	"RETURN", "COPY"
+};
+
+int basic_on;				/* KEY-INPUT is trapped */
+int basic_run;				/* not all in yet, unlimited speed */
+int basic_ki = -1;			/* address of KEY-INPUT */
+
+static BYTE *prog;			/* program to load */
+static int nprog, nlines;
+static int loaded;			/* program is in */
+static BYTE *paste;			/* key codes to paste */
+static int npaste, ppos, plines;
+static const char *err;			/* why a line is no good */
+
+/*
+ *	Length of keyword k at s, 0 if not there, a space in the
+ *	keyword matches any number of spaces, none too
+ */
+static int kw_match(const char *k, const char *s)
+{
+	const char *p = s;
+
+	for (; *k; k++) {
+		if (*k == ' ') {
+			while (*p == ' ')
+				p++;
+			continue;
+		}
+		if (toupper((unsigned char) *p) != *k)
+			return(0);
+		p++;
+	}
+	return(p - s);
+}
+
+/*
+ *	Check if token t may stand within statement cmd, not only at
+ *	the start of one
+ */
+static int kw_inside(int t, int cmd)
+{
+	if (t < T_DEFFN)		/* functions and operators */
+		return(1);
+	if (t >= T_INK && t <= T_OVER)	/* colour items */
+		return(1);
+	return(t == T_DATA && (cmd == T_SAVE || cmd == T_LOAD ||
+			       cmd == T_VERIFY || cmd == T_MERGE));
+}
+
+/*
+ *	Floating point form of v >= 0 in b, the small integer form for
+ *	whole numbers up to 65535, 0 if ok
+ */
+static int zx_float(double v, BYTE *b)
+{
+	unsigned long long m;
+	int e;
+
+	if (v == floor(v) && v <= 65535.0) {
+		b[0] = b[1] = b[4] = 0;
+		b[2] = (int) v & 0xff;
+		b[3] = (int) v >> 8;
+		return(0);
+	}
+	m = llround(ldexp(frexp(v, &e), 32));
+	if (m >> 32) {			/* rounded up to the next power */
+		m >>= 1;
+		e++;
+	}
+	if (e + 128 > 255)
+		return(1);
+	if (e + 128 < 1) {		/* too small, 0 */
+		memset(b, 0, 5);
+		return(0);
+	}
+	b[0] = e + 128;
+	b[1] = (m >> 24) & 0x7f;	/* sign bit instead of the 1 */
+	b[2] = m >> 16;
+	b[3] = m >> 8;
+	b[4] = m;
+	return(0);
+}
+
+/*
+ *	Tokenize the text s into out, which must hold BODY bytes, with
+ *	the hidden numbers if hidden, returns the length, -1 if not ok
+ */
+static int basic_tokenize(const char *s, BYTE *out, int hidden)
+{
+	char num[BASIC_LINE];
+	double v;
+	int n = 0, sp = 0, str = 0, ident = 0, bin = 0, deffn = 0;
+	int stmt = 1, cmd = 0;		/* statement starts, its keyword */
+	int c, i, l, t, len;
+
+	while ((c = (unsigned char) *s) != '\0') {
+		if (c == '\t')
+			c = ' ';
+		if (c < ' ') {
+			s++;
+			continue;
+		}
+		if (str || c == '"') {	/* strings as they are */
+			if (c == '"')
+				str = !str;
+			out[n++] = c;
+			s++;
+			sp = ident = bin = stmt = 0;
+			continue;
+		}
+
+		/* parameters of DEF FN, with room for their values */
+		if (deffn == 2 && isalpha(c)) {
+			out[n++] = *s++;
+			if (*s == '$')
+				out[n++] = *s++;
+			if (hidden) {
+				out[n++] = 0x0e;
+				memset(&out[n], 0, 5);
+				n += 5;
+			}
+			sp = ident = 0;
+			continue;
+		}
+
+		/* the longest keyword, not within or before letters */
+		for (len = 0, t = i = 0; i < NTOKENS; i++) {
+			if (ident && isalpha((unsigned char) tokens[i][0]))
+				continue;
+			if (!stmt && !kw_inside(T_FIRST + i, cmd))
+				continue;
+			l = kw_match(tokens[i], s);
+			if (l > len && !(isalpha((unsigned char) s[l - 1]) &&
+					 isalpha((unsigned char) s[l]))) {
+				len = l;
+				t = T_FIRST + i;
+			}
+		}
+		if (len) {
+			n -= sp;	/* the ROM puts the spaces */
+			out[n++] = t;
+			s += len;
+			sp = ident = 0;
+			if ((stmt && t >= T_DEFFN) || t == T_DATA)
+				cmd = t;	/* DATA of SAVE once */
+			stmt = (t == T_THEN);
+			if (t == T_REM) {
+				if (*s == ' ')
+					s++;
+				while (*s)
+					out[n++] = *s++;
+				break;
+			}
+			while (*s == ' ')
+				s++;
+			bin = (t == T_BIN);
+			deffn = (t == T_DEFFN);
+			continue;
+		}
+
+		/* numbers with their value hidden behind */
+		l = 0;
+		if (bin && (c == '0' || c == '1')) {
+			for (v = 0.0; s[l] == '0' || s[l] == '1'; l++)
+				v = 2 * v + (s[l] - '0');
+		} else if (!ident && (isdigit(c) ||
+			   (c == '.' && isdigit((unsigned char) s[1])))) {
+			while (isdigit((unsigned char) s[l]))
+				l++;
+			if (s[l] == '.')
+				for (l++; isdigit((unsigned char) s[l]); l++)
+					;
+			if ((s[l] == 'e' || s[l] == 'E') &&
+			    (isdigit((unsigned char) s[l + 1]) ||
+			     ((s[l + 1] == '+' || s[l + 1] == '-') &&
+			      isdigit((unsigned char) s[l + 2]))))
+				for (l += 2; isdigit((unsigned char) s[l]); l++)
+					;
+			memcpy(num, s, l);
+			num[l] = '\0';
+			v = strtod(num, NULL);
+		}
+		if (l) {
+			stmt = (n == 0);	/* line number when pasted */
+			memcpy(&out[n], s, l);
+			n += l;
+			s += l;
+			if (hidden) {
+				out[n++] = 0x0e;
+				if (zx_float(v, &out[n])) {
+					err = "number too big";
+					return(-1);
+				}
+				n += 5;
+			}
+			sp = ident = bin = 0;
+			continue;
+		}
+
+		out[n++] = c;
+		s++;
+		if (c == ' ') {
+			sp++;
+			ident = 0;
+			continue;
+		}
+		ident = isalpha(c) || (ident && isdigit(c));
+		sp = bin = 0;
+		stmt = (c == ':');
+		if (c == '(' && deffn == 1)
+			deffn = 2;
+		else if (c == ')')
+			deffn = 0;
+	}
+	if (str) {
+		err = "string not closed";
+		return(-1);
+	}
+	return(n - sp);
+}
+
+static int line_cmp(const void *a, const void *b)
+{
+	const struct line *x = a, *y = b;
+
+	if (x->num != y->num)
+		return(x->num - y->num);
+	return(x->seq - y->seq);
+}
+
+/*
+ *	Read the text file fn, lines with numbers tokenized into prog,
+ *	or all lines into the key codes to paste
+ */
+static void basic_read(char *fn, int topaste)
+{
+	static BYTE out[BODY];
+	static char buf[BASIC_LINE + 2];
+	struct line *lines = NULL;
+	FILE *fp;
+	char *s;
+	int i, n, num, size = 0, line = 0, max = 0;
+	BYTE *p;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("basic: can't open %s\n", fn);
+		exit(1);
+	}
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		line++;
+		if (strlen(buf) > BASIC_LINE) {
+			printf("basic: %s line %d: too long\n", fn, line);
+			exit(1);
+		}
+		buf[strcspn(buf, "\r\n")] = '\0';
+		for (s = buf; *s == ' ' || *s == '\t'; s++)
+			;
+		if (*s == '\0')
+			continue;
+		num = -1;
+		if (!topaste) {
+			if (!isdigit((unsigned char) *s) ||
+			    (num = strtol(s, &s, 10)) > BASIC_MAX) {
+				printf("basic: %s line %d: line number 0-%d "
+				       "expected\n", fn, line, BASIC_MAX);
+				exit(1);
+			}
+			while (*s == ' ' || *s == '\t')
+				s++;
+		}
+		if ((n = basic_tokenize(s, out, !topaste)) < 0) {
+			printf("basic: %s line %d: %s\n", fn, line, err);
+			exit(1);
+		}
+		if (topaste) {
+			if ((p = realloc(paste, npaste + n + 1)) == NULL)
+				goto nomem;
+			paste = p;
+			memcpy(&paste[npaste], out, n);
+			npaste += n;
+			paste[npaste++] = 0x0d;		/* ENTER */
+			plines++;
+			continue;
+		}
+		if (nlines == max) {
+			max = max ? 2 * max : 256;
+			if ((lines = realloc(lines, max * sizeof(*lines)))
+			    == NULL)
+				goto nomem;
+		}
+		if ((lines[nlines].body = malloc(n)) == NULL)
+			goto nomem;
+		memcpy(lines[nlines].body, out, n);
+		lines[nlines].len = n;
+		lines[nlines].num = num;
+		lines[nlines].seq = nlines;
+		nlines++;
+	}
+	fclose(fp);
+	if (topaste)
+		return;
+
+	/* sorted, the last of the same number, empty ones deleted */
+	qsort(lines, nlines, sizeof(*lines), line_cmp);
+	for (i = 0; i < nlines; i++)
+		if ((i + 1 == nlines || lines[i + 1].num != lines[i].num) &&
+		    lines[i].len > 0)
+			size += lines[i].len + 5;
+	if ((prog = malloc(size + 1)) == NULL)
+		goto nomem;
+	for (n = i = 0; i < nlines; i++) {
+		if ((i + 1 == nlines || lines[i + 1].num != lines[i].num) &&
+		    lines[i].len > 0) {
+			p = &prog[nprog];
+			p[0] = lines[i].num >> 8;	/* number high first */
+			p[1] = lines[i].num & 0xff;
+			p[2] = (lines[i].len + 1) & 0xff;
+			p[3] = (lines[i].len + 1) >> 8;
+			memcpy(&p[4], lines[i].body, lines[i].len);
+			p[4 + lines[i].len] = 0x0d;
+			nprog += lines[i].len + 5;
+			n++;
+		}
+		free(lines[i].body);
+	}
+	free(lines);
+	nlines = n;
+	return;
+
+nomem:
+	puts("basic: out of memory");
+	exit(1);
+}
+
+/*
+ *	Replace the program area with the program read, as LOAD does
+ */
+static void basic_load(void)
+{
+	static WORD ptrs[] = { VARS, DEST, NXTLIN, E_LINE, K_CUR, CH_ADD,
+			       X_PTR, WORKSP, STKBOT, STKEND, 0 };
+	int p = rd16(PROG), v = rd16(VARS), end = rd16(STKEND);
+	int d = nprog - (v - p), a;
+	register int i;
+
+	if (p < 0x5cb6 || v < p || end < v || end + d + 80 > SP) {
+		printf("\r\nbasic: no room for %s\r\n", ofn);
+		nlines = 0;
+		return;
+	}
+	memmove(&memory[v + d], &memory[v], end - v);
+	for (i = 0; ptrs[i]; i++) {
+		a = rd16(ptrs[i]);
+		if (a >= v)
+			wr16(ptrs[i], a + d);
+	}
+	wr16(DATADD, p - 1);		/* RESTORE */
+	memcpy(&memory[p], prog, nprog);
+}
+
+/*
+ *	Called by the CPU when the ROM calls KEY-INPUT
+ */
+void basic_key(void)
+{
+	if (!loaded) {
+		if (o_flag)
+			basic_load();
+		loaded = 1;
+	}
+	if (ppos < npaste && !(memory[FLAGS] & 0x20)) {
+		memory[LAST_K] = paste[ppos++];
+		memory[FLAGS] |= 0x20;		/* new key */
+	}
+	basic_on = basic_run = ppos < npaste;
+}
+
+void basic_init(void)
+{
+	if ((basic_ki = sym_lookup(BASIC_KEY)) < 0) {
+		printf("basic: %s not in listing, can't load or paste\n",
+		       BASIC_KEY);
+		return;
+	}
+	if (o_flag)
+		basic_read(ofn, 0);
+	if (O_flag)
+		basic_read(Ofn, 1);
+	basic_on = basic_run = 1;
+}
+
+void basic_exit(void)
+{
+	if (o_flag)
+		printf("basic: %d lines, %d bytes of %s %s\n", nlines, nprog,
+		       ofn, loaded ? "loaded" : "not loaded");
+	if (O_flag)
+		printf("basic: %d of %d key codes of %d lines of %s pasted\n",
+		       ppos, npaste, plines, Ofn);
+}
@@ -0,0 +1,24 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads and pastes BASIC programs from text files.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _BASIC_H_
+#define _BASIC_H_
+
+#define BASIC_KEY	"KEY-INPUT"	/* ROM routine trapped */
+#define BASIC_LINE	1024		/* max length of a text line */
+#define BASIC_MAX	9999		/* highest line number */
+
+extern int basic_on, basic_run;
+extern int basic_ki;
+
+extern void basic_init(void);
+extern void basic_exit(void);
+extern void basic_key(void);
+
+#endif
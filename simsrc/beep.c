@@ -0,0 +1,284 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module generates the sound of the beeper.
+ *
+ * With option -a the sound is played with SDL audio, with option -A
+ * file it is written as WAV file, mono 16 bit with BEEP_RATE samples
+ * per second.
+ *
+ * The CPU counts its T-states in beep_t, at every change of the
+ * speaker bit 4 of port FE the step of the level is placed at its
+ * position in samples, to 1/BEEP_PHASES of a sample, as band-limited
+ * step: a windowed sinc of BEEP_TAPS samples is added to a buffer of
+ * level changes, which is summed up into the samples once no later
+ * step can change them anymore. A high-pass takes out the DC of the
+ * speaker level. The samples are also finished at every interrupt,
+ * so that silence is played as well.
+ *
+ * The finished samples go through a lock-free ring of one writer,
+ * the CPU, and one reader, the SDL audio callback or a thread that
+ * writes the WAV file. The CPU never waits: if the ring is full the
+ * samples are dropped, if it is empty the callback plays silence.
+ * Both are counted and reported on exit.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include "SDL.h"
+#include "sim.h"
+#include "simglb.h"
+#include "beep.h"
+
+int beep_on;				/* beeper sound is generated */
+unsigned long long beep_t;		/* T-states of the CPU */
+
+static float kern[BEEP_PHASES][BEEP_TAPS];
+static float delta[BEEP_BUF];		/* level changes per sample */
+static unsigned long long tclock;	/* T-states per second */
+static unsigned long long out_pos;	/* next sample to finish */
+static float integ, hp_x, hp_y;		/* level, high-pass state */
+static int level;			/* speaker bit */
+static unsigned long long edges, samples, dropped, underruns;
+
+static short ring[BEEP_RING];
+static unsigned int head, tail;		/* written by CPU, by reader */
+
+static SDL_AudioDeviceID dev;
+static FILE *wav;
+static pthread_t writer;
+static int stop;
+
+/*
+ *	Windowed sinc steps for all sub-sample positions, each sums to 1
+ */
+static void beep_kernel(void)
+{
+	int p, k;
+	double x, w, s, sum;
+
+	for (p = 0; p < BEEP_PHASES; p++) {
+		sum = 0.0;
+		for (k = 0; k < BEEP_TAPS; k++) {
+			x = k - BEEP_TAPS / 2 + 1 - (double) p / BEEP_PHASES;
+			s = (x == 0.0) ? 1.0 : sin(M_PI * 0.9 * x) / (M_PI * 0.9 * x);
+			w = 0.42 + 0.5 * cos(M_PI * x / (BEEP_TAPS / 2)) +
+			    0.08 * cos(2 * M_PI * x / (BEEP_TAPS / 2));
+			if (fabs(x) >= BEEP_TAPS / 2)
+				w = 0.0;
+			sum += kern[p][k] = s * w;
+		}
+		for (k = 0; k < BEEP_TAPS; k++)
+			kern[p][k] /= sum;
+	}
+}
+
+/*
+ *	Finish the samples before sample n and put them into the ring
+ */
+static void beep_emit(unsigned long long n)
+{
+	unsigned int h = head, t;
+	float *d;
+	int s;
+
+	t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+	for (; out_pos < n; out_pos++) {
+		d = &delta[out_pos % BEEP_BUF];
+		integ += *d;
+		*d = 0.0;
+		hp_y = integ - hp_x + 0.995 * hp_y;	/* no DC */
+		hp_x = integ;
+		s = (hp_y > 32767.0) ? 32767 : (hp_y < -32768.0) ? -32768
+								 : hp_y;
+		if (h - t == BEEP_RING) {
+			dropped++;
+			continue;
+		}
+		ring[h++ % BEEP_RING] = s;
+		samples++;
+	}
+	__atomic_store_n(&head, h, __ATOMIC_RELEASE);
+}
+
+/*
+ *	Position of T-state t in 1/BEEP_PHASES samples
+ */
+static unsigned long long beep_pos(unsigned long long t)
+{
+	return(t * (BEEP_RATE * BEEP_PHASES) / tclock);
+}
+
+/*
+ *	Called by the I/O for every output to port FE
+ */
+void beep_out(BYTE data)
+{
+	unsigned long long p;
+	int b = (data >> 4) & 1, k;
+	float d;
+
+	if (b == level)
+		return;
+	level = b;
+	edges++;
+	p = beep_pos(beep_t);
+	beep_emit(p / BEEP_PHASES);
+	d = b ? 2 * BEEP_AMP : -2 * BEEP_AMP;
+	for (k = 0; k < BEEP_TAPS; k++)
+		delta[(out_pos + k) % BEEP_BUF] += d * kern[p % BEEP_PHASES][k];
+}
+
+/*
+ *	Called by the CPU for every interrupt taken, finishes the samples
+ *	up to now
+ */
+void beep_flush(void)
+{
+	beep_emit(beep_pos(beep_t) / BEEP_PHASES);
+}
+
+/*
+ *	Take up to n samples from the ring, returns the number
+ */
+static int beep_take(short *buf, int n)
+{
+	unsigned int t = tail, h;
+	int i;
+
+	h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n && t != h; i++)
+		buf[i] = ring[t++ % BEEP_RING];
+	__atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+	return(i);
+}
+
+static void beep_callback(void *userdata, Uint8 *stream, int len)
+{
+	short *buf = (short *) stream;
+	int n = len / 2, i;
+
+	userdata = userdata;	/* to avoid compiler warning */
+
+	if ((i = beep_take(buf, n)) < n) {
+		memset(buf + i, 0, (n - i) * 2);
+		underruns++;
+	}
+}
+
+static void put32(BYTE *p, unsigned long v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/*
+ *	WAV header for n samples
+ */
+static void wav_header(BYTE *h, unsigned long n)
+{
+	memcpy(h, "RIFF\0\0\0\0WAVEfmt \20\0\0\0\1\0\1\0\0\0\0\0\0\0\0\0"
+	       "\2\0\20\0data\0\0\0\0", 44);
+	put32(h + 4, 36 + 2 * n);
+	put32(h + 24, BEEP_RATE);
+	put32(h + 28, BEEP_RATE * 2);
+	put32(h + 40, 2 * n);
+}
+
+/*
+ *	Thread writing the ring into the WAV file
+ */
+static void *wav_writer(void *arg)
+{
+	static short buf[BEEP_FRAG];
+	struct timespec ts = { 0, 5000000L };
+	int n;
+
+	arg = arg;	/* to avoid compiler warning */
+
+	for (;;) {
+		while ((n = beep_take(buf, BEEP_FRAG)) > 0)
+			fwrite(buf, 2, n, wav);
+		if (__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+			break;
+		nanosleep(&ts, NULL);
+	}
+	return(NULL);
+}
+
+void beep_init(void)
+{
+	SDL_AudioSpec want, have;
+	sigset_t all, old;
+	BYTE h[44];
+
+	tclock = (f_flag > 0) ? f_flag * 1000000ULL : BEEP_CLOCK;
+	beep_kernel();
+
+	if (A_flag) {
+		if ((wav = fopen(afn, "wb")) == NULL) {
+			printf("can't create %s\n", afn);
+			exit(1);
+		}
+		wav_header(h, 0);
+		fwrite(h, 1, 44, wav);
+		sigfillset(&all);	/* the timer interrupts the CPU only */
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		if (pthread_create(&writer, NULL, wav_writer, NULL)) {
+			puts("can't start the WAV writer");
+			exit(1);
+		}
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+	} else {
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+			printf("no audio: %s\n", SDL_GetError());
+			return;
+		}
+		memset(&want, 0, sizeof(want));
+		want.freq = BEEP_RATE;
+		want.format = AUDIO_S16SYS;
+		want.channels = 1;
+		want.samples = BEEP_FRAG;
+		want.callback = beep_callback;
+		if ((dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0)) == 0) {
+			printf("no audio: %s\n", SDL_GetError());
+			return;
+		}
+		SDL_PauseAudioDevice(dev, 0);
+	}
+	beep_on = 1;
+}
+
+void beep_exit(void)
+{
+	BYTE h[44];
+	long n;
+
+	if (!beep_on)
+		return;
+	beep_flush();
+	beep_emit(out_pos + BEEP_TAPS);	/* the last steps */
+	beep_on = 0;
+	if (wav != NULL) {
+		__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+		pthread_join(writer, NULL);
+		n = (ftell(wav) - 44) / 2;
+		wav_header(h, n);
+		fseek(wav, 0L, SEEK_SET);
+		fwrite(h, 1, 44, wav);
+		fclose(wav);
+	} else
+		SDL_CloseAudioDevice(dev);
+	printf("beeper: %llu edges, %llu samples, %llu dropped, "
+	       "%llu underruns\n", edges, samples, dropped, underruns);
+}
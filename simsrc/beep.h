@@ -0,0 +1,30 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module generates the sound of the beeper.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _BEEP_H_
+#define _BEEP_H_
+
+#define BEEP_RATE	44100		/* samples per second */
+#define BEEP_CLOCK	3500000		/* T-states per second if unlimited */
+#define BEEP_AMP	8000		/* amplitude of the speaker */
+#define BEEP_TAPS	16		/* samples of the band-limited step */
+#define BEEP_PHASES	32		/* sub-sample positions of a step */
+#define BEEP_BUF	4096		/* samples being synthesised */
+#define BEEP_RING	65536		/* samples between CPU and output */
+#define BEEP_FRAG	1024		/* samples per SDL callback */
+
+extern int beep_on;
+extern unsigned long long beep_t;
+
+extern void beep_init(void);
+extern void beep_exit(void);
+extern void beep_out(BYTE);
+extern void beep_flush(void);
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs an A/B benchmark of two ROM images.
+ *
+ * The ROM loaded with -x (A) and the one given with -B (B) are booted
+ * one after the other, without display window and with an interrupt
+ * every INT_PERIOD T-states, until the editor waits for a key. Then
+ * the same script of screen operations is run on both, by calling the
+ * ROM routines directly with a sentinel return address. The addresses
+ * of the routines are taken from the listing of each ROM, so that the
+ * two may differ in layout.
+ *
+ * Per operation the T-states, the OUT's and the predicted time at the
+ * CPU clock are reported. The exit code is 1 if B is slower than A by
+ * more than the threshold given with -b, or if an operation fails.
+ *
+ * Boot and script are also used by the parameter sweep in sweep.c.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "il9341.h"
+#include "symtab.h"
+#include "stats.h"
+#include "bench.h"
+#ifdef WANT_BUDGET
+#include "budget.h"
+#endif
+
+#define BOOT_TMAX	500000000ULL	/* max. T-states for booting */
+#define CALL_TMAX	100000000ULL	/* max. T-states for one call */
+#define SCRATCH		0x7ff0		/* free RAM for parameters */
+
+/* system variables used */
+#define FLAGS		0x5c3b
+#define VARS		0x5c4b
+#define CH_ADD		0x5c5d
+#define SCR_CT		0x5c8c
+#define STKEND		0x5c65
+
+extern int load_file(char *);
+extern void reset_cpu(void);
+extern void cpu_z80(void);
+
+MSTATE int bench_stop = -1;
+MSTATE unsigned long long bench_t;
+MSTATE unsigned long long bench_tmax;
+
+/* ROM routines called, resolved per ROM */
+enum { R_BOOT, R_PRINT, R_CHAN, R_CLS, R_SCROLL, R_PLOT, R_STACK,
+       R_DRAW, R_CIRCLE, R_LIST, R_NUM };
+
+static char *rnames[R_NUM] = { "WAIT-KEY", "PRINT-A", "CHAN-OPEN", "CLS",
+			       "CL-SC-ALL", "PLOT-SUB", "STACK-A", "DRAW",
+			       "CIRCLE", "LIST" };
+static WORD raddr[R_NUM];
+
+static int op_print(struct bench_result *), op_cls(struct bench_result *),
+	   op_scroll(struct bench_result *), op_plot(struct bench_result *),
+	   op_draw(struct bench_result *), op_circle(struct bench_result *),
+	   op_list(struct bench_result *);
+
+static struct op {
+	char *name;
+	int (*fn)(struct bench_result *);
+} ops[] = {
+	{ "PRINT 704 chars", op_print },
+	{ "CLS", op_cls },
+	{ "scroll 100 lines", op_scroll },
+	{ "PLOT 256 points", op_plot },
+	{ "DRAW 32 lines", op_draw },
+	{ "CIRCLE 8 circles", op_circle },
+	{ "LIST 20 lines", op_list },
+	{ NULL, NULL }
+};
+
+#define NOPS	(sizeof(ops) / sizeof(struct op) - 1)
+
+/* tokenized BASIC line for LIST: 10 PRINT "HELLO, WORLD" */
+static BYTE line[] = { 0x00, 0x0a, 0x10, 0x00, 0xf5, '"', 'H', 'E', 'L',
+		       'L', 'O', ',', ' ', 'W', 'O', 'R', 'L', 'D', '"',
+		       0x0d };
+
+static unsigned long long outs(void)
+{
+	register unsigned long long n = 0;
+	register int i;
+
+	for (i = 0; i < 256; i++)
+		n += stats.out[i];
+	return(n);
+}
+
+/*
+ *	Run the CPU until PC reaches addr, 1 if it didn't
+ */
+int bench_until(int addr, unsigned long long tmax)
+{
+	bench_stop = addr;
+	bench_t = 0;
+	bench_tmax = tmax;
+	cpu_state = CONTIN_RUN;
+	cpu_error = NONE;
+	cpu_z80();
+	return(PC != addr || cpu_error != NONE);
+}
+
+/*
+ *	Call a ROM routine, add the cost to r if it isn't NULL
+ */
+static int call(int rt, WORD bc, BYTE a, struct bench_result *r)
+{
+	unsigned long long o = outs();
+
+	memory[SCR_CT] = 0xff;		/* no scroll? prompt */
+	memory[FLAGS] |= 0x80;		/* run-time, not syntax checking */
+	SP -= 2;
+	memory[SP] = BENCH_SENTINEL & 0xff;
+	memory[SP + 1] = BENCH_SENTINEL >> 8;
+	PC = raddr[rt];
+	A = a;
+	B = bc >> 8;
+	C = bc & 0xff;
+#ifdef WANT_BUDGET
+	if (G_flag)
+		budget_call(PC, SP);
+#endif
+	if (bench_until(BENCH_SENTINEL, CALL_TMAX)) {
+		if (r != NULL)
+			r->failed = 1;
+		return(1);
+	}
+	if (r != NULL) {
+		r->t += bench_t;
+		r->outs += outs() - o;
+	}
+	return(0);
+}
+
+/*
+ *	Point CH_ADD at parameters in RAM, as left by the BASIC parser
+ */
+static void params(BYTE *p, int n)
+{
+	memcpy(&memory[SCRATCH], p, n);
+	memory[CH_ADD] = SCRATCH & 0xff;
+	memory[CH_ADD + 1] = SCRATCH >> 8;
+}
+
+static int op_print(struct bench_result *r)
+{
+	register int i;
+
+	if (call(R_CLS, 0, 0, NULL) || call(R_CHAN, 0, 2, NULL))
+		return(1);
+	for (i = 0; i < 704; i++)
+		if (call(R_PRINT, 0, ' ' + i % 95, r))
+			return(1);
+	return(0);
+}
+
+static int op_cls(struct bench_result *r)
+{
+	return(call(R_CLS, 0, 0, r));
+}
+
+static int op_scroll(struct bench_result *r)
+{
+	register int i;
+
+	for (i = 0; i < 100; i++)
+		if (call(R_SCROLL, 0, 0, r))
+			return(1);
+	return(0);
+}
+
+static int op_plot(struct bench_result *r)
+{
+	register int i;
+
+	if (call(R_CLS, 0, 0, NULL))
+		return(1);
+	for (i = 0; i < 256; i++)
+		if (call(R_PLOT, ((i * 11) % 176) << 8 | i, 0, r))
+			return(1);
+	return(0);
+}
+
+static int op_draw(struct bench_result *r)
+{
+	static BYTE end[] = { 0x0d };
+	register int i;
+
+	if (call(R_CLS, 0, 0, NULL))
+		return(1);
+	for (i = 0; i < 32; i++) {
+		/* DRAW x,y from 0,0 */
+		params(end, sizeof(end));
+		if (call(R_PLOT, 0, 0, NULL) ||
+		    call(R_STACK, 0, 255 - i * 8, NULL) ||
+		    call(R_STACK, 0, 175 - i * 5, NULL) ||
+		    call(R_DRAW, 0, 0, r))
+			return(1);
+	}
+	return(0);
+}
+
+static int op_circle(struct bench_result *r)
+{
+	/* ,50 with the hidden number, radius patched in */
+	static BYTE rad[] = { ',', '5', '0', 0x0e, 0, 0, 50, 0, 0, 0x0d };
+	register int i;
+
+	if (call(R_CLS, 0, 0, NULL))
+		return(1);
+	for (i = 1; i <= 8; i++) {
+		/* CIRCLE 128,88,r */
+		rad[6] = i * 10;
+		params(rad, sizeof(rad));
+		if (call(R_STACK, 0, 128, NULL) ||
+		    call(R_STACK, 0, 88, NULL) ||
+		    call(R_CIRCLE, 0, 0, r))
+			return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Insert the tokenized lines in p in front of the variables,
+ *	as LOAD would do
+ */
+int bench_program(BYTE *prog, int n)
+{
+	static WORD ptrs[] = { 0x5c4b, 0x5c4d, 0x5c55, 0x5c57, 0x5c59,
+			       0x5c5b, 0x5c5d, 0x5c5f, 0x5c61, 0x5c63,
+			       0x5c65, 0 };
+	WORD vars, end, p;
+	register int i;
+
+	vars = memory[VARS] + (memory[VARS + 1] << 8);
+	end = memory[STKEND] + (memory[STKEND + 1] << 8);
+	if (vars < 0x5cb6 || end < vars || end + n >= MEMORY_SIZE)
+		return(1);
+	memmove(&memory[vars + n], &memory[vars], end - vars);
+	for (i = 0; ptrs[i]; i++) {
+		p = memory[ptrs[i]] + (memory[ptrs[i] + 1] << 8);
+		if (p >= vars) {
+			p += n;
+			memory[ptrs[i]] = p & 0xff;
+			memory[ptrs[i] + 1] = p >> 8;
+		}
+	}
+	memcpy(&memory[vars], prog, n);
+	return(0);
+}
+
+static int op_list(struct bench_result *r)
+{
+	static BYTE end[] = { 0x0d };
+	BYTE prog[20 * sizeof(line)];
+	register int i;
+
+	for (i = 0; i < 20; i++) {
+		line[1] = (i + 1) * 10;
+		memcpy(&prog[i * sizeof(line)], line, sizeof(line));
+	}
+	if (bench_program(prog, sizeof(prog)) || call(R_CLS, 0, 0, NULL))
+		return(1);
+	params(end, sizeof(end));
+	return(call(R_LIST, 0, 0, r));
+}
+
+/*
+ *	Set up the machine for running without display and timers
+ */
+void bench_init(void)
+{
+	setenv("SDL_VIDEODRIVER", "dummy", 0);
+	il9341_init();
+	T_flag = 1;			/* for the OUT counters */
+	int_period = INT_PERIOD;
+}
+
+int bench_count(void)
+{
+	return(NOPS);
+}
+
+char *bench_opname(int i)
+{
+	return(ops[i].name);
+}
+
+/*
+ *	Load a ROM with listing and look up the routines of the script
+ */
+int bench_load(char *fn)
+{
+	register unsigned int i;
+	int a;
+
+	memset(memory, 0, MEMORY_SIZE);
+	reset_cpu();
+	if (load_file(fn) || sym_load_near(fn)) {
+		printf("can't load ROM %s with listing\n", fn);
+		return(1);
+	}
+	for (i = 0; i < R_NUM; i++) {
+		if ((a = sym_lookup(rnames[i])) < 0) {
+			printf("%s: routine %s not in listing\n", fn,
+			       rnames[i]);
+			return(1);
+		}
+		raddr[i] = a;
+	}
+#ifdef WANT_BUDGET
+	if (G_flag)		/* budgets for the routines of this ROM */
+		budget_resolve();
+#endif
+	return(0);
+}
+
+/*
+ *	Load a ROM with listing and boot it until it waits for a key
+ */
+int bench_boot(char *fn)
+{
+	if (bench_load(fn))
+		return(1);
+	PC = 0;
+	int_tcnt = 0;
+	if (bench_until(raddr[R_BOOT], BOOT_TMAX)) {
+		printf("%s: doesn't boot to %s\n", fn, rnames[R_BOOT]);
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Run the script on the machine booted, results into res
+ */
+void bench_script(char *fn, struct bench_result *res)
+{
+	register unsigned int i;
+
+	for (i = 0; i < NOPS; i++) {
+		memset(&res[i], 0, sizeof(struct bench_result));
+		if ((*ops[i].fn)(&res[i])) {
+			res[i].failed = 1;
+			printf("%s: %s failed at %04x\n", fn, ops[i].name, PC);
+		}
+	}
+}
+
+/*
+ *	Boot one ROM and run the script
+ */
+static int bench_rom(char *fn, struct bench_result *res)
+{
+	if (bench_boot(fn))
+		return(1);
+	bench_script(fn, res);
+#ifdef WANT_BUDGET
+	if (G_flag)
+		budget_report(fn);
+#endif
+	return(0);
+}
+
+/*
+ *	Benchmark ROM -x against ROM -B, returns exit code
+ */
+int bench_run(void)
+{
+	struct bench_result ra[NOPS], rb[NOPS];
+	double mhz = f_flag ? f_flag : BENCH_MHZ;
+	double d;
+	int rc = 0;
+	register unsigned int i;
+
+	bench_init();
+	if (bench_rom(xfn, ra) || bench_rom(bfn, rb))
+		return(1);
+
+	printf("\nA = %s\nB = %s\nclock %.2f MHz, threshold %.2f%%\n\n",
+	       xfn, bfn, mhz, bench_pct);
+	printf("%-18s %12s %12s %8s %9s %9s %10s %10s\n", "operation",
+	       "T-states A", "T-states B", "diff", "OUT A", "OUT B",
+	       "ms A", "ms B");
+	for (i = 0; i < NOPS; i++) {
+		if (ra[i].failed || rb[i].failed) {
+			printf("%-18s %s\n", ops[i].name, "failed");
+			rc = 1;
+			continue;
+		}
+		d = ra[i].t ? 100.0 * ((double) rb[i].t - ra[i].t) / ra[i].t
+			    : 0.0;
+		printf("%-18s %12llu %12llu %+7.2f%% %9llu %9llu %10.2f "
+		       "%10.2f%s\n", ops[i].name, ra[i].t, rb[i].t, d,
+		       ra[i].outs, rb[i].outs, ra[i].t / mhz / 1000.0,
+		       rb[i].t / mhz / 1000.0,
+		       d > bench_pct ? "  REGRESSION" : "");
+		if (d > bench_pct)
+			rc = 1;
+	}
+	return(rc);
+}
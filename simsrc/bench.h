@@ -0,0 +1,37 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs an A/B benchmark of two ROM images.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#define BENCH_MHZ	3.5		/* clock for predicted time, if no -f */
+#define BENCH_PCT	1.0		/* default regression threshold in % */
+#define BENCH_SENTINEL	0xffff		/* return address ending a call */
+
+struct bench_result {
+	unsigned long long t;		/* T-states */
+	unsigned long long outs;	/* OUT's */
+	int failed;
+};
+
+extern MSTATE int bench_stop;		/* stop CPU when PC reaches it */
+extern MSTATE unsigned long long bench_t;	/* T-states since last start */
+extern MSTATE unsigned long long bench_tmax;	/* stop CPU after that many */
+
+extern void bench_init(void);
+extern int bench_count(void);
+extern char *bench_opname(int);
+extern int bench_load(char *);
+extern int bench_boot(char *);
+extern int bench_until(int, unsigned long long);
+extern int bench_program(BYTE *, int);
+extern void bench_script(char *, struct bench_result *);
+extern int bench_run(void);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module checks T-state budgets of ROM routines.
+ *
+ * The budget file given with option -G has one routine per line,
+ * named by label or ;; name of the listing, with the max. T-states
+ * per call and optionally the unit the budget is for:
+ *
+ *	# routine	max T	unit
+ *	PO-ANY		1200
+ *	CL-LINE		400	B	per line to clear
+ *	LCD_FILL	40	OUT5	per data byte written to the LCD
+ *
+ * A unit is a register at the time of the call (A, B, C, BC, DE, HL)
+ * or the OUT's to a port during the call, a count of 0 is taken as 1.
+ *
+ * CALL, RST and interrupts push a frame on a shadow stack, RET pops
+ * it again. Time spent in interrupt handlers isn't charged to the
+ * routines interrupted. Every call running over budget is counted as
+ * a violation, the report at exit lists them and the simulator then
+ * exits with 1, so that test runs and the benchmark fail.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "budget.h"
+
+#define BUFSIZE		256		/* max line length of budget file */
+
+/* read op-codes without going through the instrumented memrdr() */
+#define op_at(a)	(((a) < MEMORY_SIZE) ? memory[a] : 0xff)
+
+/* units of a budget */
+enum { U_CALL, U_A, U_B, U_C, U_BC, U_DE, U_HL, U_OUT };
+
+static char *units[] = { "call", "A", "B", "C", "BC", "DE", "HL", NULL };
+
+struct budget {
+	char name[SYM_NAMELEN];		/* routine */
+	int addr;			/* entry, -1 if not in listing */
+	unsigned long max;		/* T-states per unit */
+	int unit;			/* U_xxx */
+	int port;			/* port for U_OUT */
+	unsigned long calls;		/* calls returned */
+	unsigned long over;		/* calls over budget */
+	unsigned long long t;		/* T-states of all calls */
+	unsigned long long n;		/* units of all calls */
+	double worst;			/* max. T-states per unit */
+	WORD worst_ret;			/* return address of that call */
+};
+
+struct frame {
+	int idx;			/* budget, -1 for an interrupt */
+	WORD sp;			/* stack slot of return address */
+	WORD ret;			/* return address */
+	unsigned long n;		/* units, if not OUT's */
+	unsigned long long t0;		/* clock at time of call */
+	unsigned long long i0;		/* interrupt time at time of call */
+	unsigned long long o0;		/* OUT's at time of call */
+};
+
+unsigned long long budget_outs[256];	/* OUT's per port */
+int budget_fail;			/* violations over all reports */
+
+static struct budget *budgets;
+static int nbudgets;
+static short bidx[65536];		/* budget per entry address */
+static struct frame stack[BUDGET_DEPTH];
+static int depth;
+static unsigned long long tclock;	/* T-states executed */
+static unsigned long long int_t;	/* T-states in interrupt handlers */
+
+/*
+ *	Read the budget file
+ */
+void budget_init(void)
+{
+	FILE *fp;
+	char buf[BUFSIZE];
+	char name[BUFSIZE], unit[BUFSIZE];
+	struct budget *b;
+	char *s;
+	int i, n, line = 0, size = 0;
+	unsigned long max;
+
+	if ((fp = fopen(gfn, "r")) == NULL) {
+		printf("can't open budget file %s\n", gfn);
+		exit(1);
+	}
+	while (fgets(buf, BUFSIZE, fp) != NULL) {
+		line++;
+		if ((s = strchr(buf, '#')) != NULL)
+			*s = '\0';
+		if ((n = sscanf(buf, "%s %lu %s", name, &max, unit)) <= 0)
+			continue;
+		if (n == 1 || strlen(name) >= SYM_NAMELEN) {
+			printf("%s: line %d: routine and max. T-states expected\n",
+			       gfn, line);
+			exit(1);
+		}
+		if (nbudgets == size) {
+			size = size ? size * 2 : 64;
+			budgets = realloc(budgets,
+					  size * sizeof(struct budget));
+			if (budgets == NULL) {
+				puts("out of memory for budgets");
+				exit(1);
+			}
+		}
+		b = &budgets[nbudgets++];
+		memset(b, 0, sizeof(struct budget));
+		strcpy(b->name, name);
+		b->max = max;
+		if (n == 3 && strncasecmp(unit, "OUT", 3) == 0 &&
+		    isdigit((int)unit[3])) {
+			b->unit = U_OUT;
+			b->port = strtol(&unit[3], NULL, 0) & 0xff;
+		} else if (n == 3) {
+			for (i = 0; units[i] != NULL; i++)
+				if (strcasecmp(unit, units[i]) == 0)
+					break;
+			if (units[i] == NULL) {
+				printf("%s: line %d: unknown unit %s\n", gfn,
+				       line, unit);
+				exit(1);
+			}
+			b->unit = i;
+		}
+	}
+	fclose(fp);
+	budget_resolve();
+}
+
+/*
+ *	Look up the routines in the listing loaded, and start
+ *	counting from scratch
+ */
+void budget_resolve(void)
+{
+	register struct budget *b;
+	register int i;
+
+	for (i = 0; i < 65536; i++)
+		bidx[i] = -1;
+	for (i = 0; i < nbudgets; i++) {
+		b = &budgets[i];
+		b->calls = b->over = 0;
+		b->t = b->n = 0;
+		b->worst = 0.0;
+		if ((b->addr = sym_lookup(b->name)) < 0)
+			printf("budget: routine %s not in listing\n", b->name);
+		else
+			bidx[b->addr] = i;
+	}
+	depth = 0;
+}
+
+/*
+ *	Units of a call to budget b
+ */
+static unsigned long budget_units(struct budget *b)
+{
+	switch (b->unit) {
+	case U_A:
+		return(A);
+	case U_B:
+		return(B);
+	case U_C:
+		return(C);
+	case U_BC:
+		return((B << 8) + C);
+	case U_DE:
+		return((D << 8) + E);
+	case U_HL:
+		return((H << 8) + L);
+	default:
+		return(1);
+	}
+}
+
+static void push(int idx, WORD sp)
+{
+	register struct frame *f;
+
+	if (depth == BUDGET_DEPTH)
+		return;
+	f = &stack[depth++];
+	f->idx = idx;
+	f->sp = sp;
+	f->ret = op_at(sp) + (op_at(sp + 1) << 8);
+	f->t0 = tclock;
+	f->i0 = int_t;
+	if (idx >= 0) {
+		f->n = budget_units(&budgets[idx]);
+		if (budgets[idx].unit == U_OUT)
+			f->o0 = budget_outs[budgets[idx].port];
+	}
+}
+
+/*
+ *	Routine at addr called, return address is on the stack at sp
+ */
+void budget_call(WORD addr, WORD sp)
+{
+	if (bidx[addr] >= 0)
+		push(bidx[addr], sp);
+}
+
+/*
+ *	Interrupt accepted, return address is on the stack at sp
+ */
+void budget_int(WORD sp)
+{
+	push(-1, sp);
+}
+
+/*
+ *	Pop the top frame, check the budget if the routine returned
+ *	normally and didn't drop its return address
+ */
+static void pop(WORD sp)
+{
+	register struct frame *f = &stack[--depth];
+	register struct budget *b;
+	unsigned long long t = tclock - f->t0;
+	unsigned long n;
+	double per;
+
+	if (f->idx < 0) {
+		int_t += t;
+		return;
+	}
+	if (f->sp != sp)
+		return;
+	b = &budgets[f->idx];
+	t -= int_t - f->i0;
+	n = (b->unit == U_OUT) ? budget_outs[b->port] - f->o0 : f->n;
+	if (n == 0)
+		n = 1;
+	per = (double) t / n;
+	b->calls++;
+	b->t += t;
+	b->n += n;
+	if (per > b->worst) {
+		b->worst = per;
+		b->worst_ret = f->ret;
+	}
+	if (per > b->max)
+		b->over++;
+}
+
+/*
+ *	Called after every instruction with PC and SP from before it
+ */
+void budget_step(WORD pc, WORD sp, int states)
+{
+	register BYTE op;
+
+	tclock += states;
+
+	if (SP == (WORD) (sp - 2)) {
+		/* CALL, CALL cc or RST taken ? */
+		op = op_at(pc);
+		if ((op == 0xcd || (op & 0xc7) == 0xc4 ||
+		     (op & 0xc7) == 0xc7) && bidx[PC] >= 0)
+			push(bidx[PC], SP);
+	} else if (SP == (WORD) (sp + 2)) {
+		/* RET, RET cc, RETI or RETN taken ? */
+		op = op_at(pc);
+		if (op == 0xc9 || (op & 0xc7) == 0xc0 ||
+		    (op == 0xed && (op_at(pc + 1) & 0xc7) == 0x45))
+			while (depth > 0 && stack[depth - 1].sp <= sp)
+				pop(sp);
+	}
+}
+
+/*
+ *	Report the budgets, title is the ROM or NULL. Returns the
+ *	number of routines over budget.
+ */
+int budget_report(char *title)
+{
+	register struct budget *b;
+	register int i;
+	int fail = 0;
+	char buf[SYM_NAMELEN + 8];
+
+	printf("\nT-state budgets%s%s\n\n", title ? " of " : "",
+	       title ? title : "");
+	printf("%-20s %10s %5s %9s %12s %12s %9s  %s\n", "routine", "max T",
+	       "unit", "calls", "avg T", "worst T", "over", "worst from");
+	for (i = 0; i < nbudgets; i++) {
+		b = &budgets[i];
+		if (b->addr < 0) {
+			printf("%-20s %10lu %5s %9s\n", b->name, b->max,
+			       b->unit == U_OUT ? "OUT" : units[b->unit],
+			       "no label");
+			continue;
+		}
+		printf("%-20s %10lu %5s %9lu %12.1f %12.1f %9lu  %s%s\n",
+		       b->name, b->max,
+		       b->unit == U_OUT ? "OUT" : units[b->unit], b->calls,
+		       b->n ? (double) b->t / b->n : 0.0, b->worst, b->over,
+		       b->calls ? sym_label(b->worst_ret, buf) : "",
+		       b->over ? "  OVER BUDGET" : "");
+		if (b->over)
+			fail++;
+	}
+	if (fail)
+		printf("\n%d routine(s) over budget\n", fail);
+	budget_fail += fail;
+	return(fail);
+}
+
+/*
+ *	Final report, returns 1 if a routine ran over budget
+ */
+int budget_exit(void)
+{
+	budget_report(NULL);
+	return(budget_fail != 0);
+}
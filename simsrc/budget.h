@@ -0,0 +1,26 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module checks T-state budgets of ROM routines.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _BUDGET_H_
+#define _BUDGET_H_
+
+#define BUDGET_DEPTH	256		/* max. depth of the shadow stack */
+
+extern unsigned long long budget_outs[256];	/* OUT's per port */
+extern int budget_fail;			/* violations over all reports */
+
+extern void budget_init(void);
+extern int budget_exit(void);
+extern void budget_resolve(void);
+extern int budget_report(char *);
+extern void budget_step(WORD, WORD, int);
+extern void budget_call(WORD, WORD);
+extern void budget_int(WORD);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module records code coverage of the ROM.
+ *
+ * One bit per ROM address is set when an instruction starting there
+ * is executed, conditional JR, JP, CALL, RET and DJNZ get two more
+ * bits for branch taken and not taken. The bitmaps are ORed into the
+ * data file given with option -c, so results of several runs merge.
+ *
+ * On exit the ROM listing is written annotated with the coverage into
+ * file.lst, and a summary per label with the never executed routines
+ * and their size into file.txt.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "optab.h"
+#include "cover.h"
+
+#define BUFSIZE		512		/* max line length of listing */
+#define COV_MAGIC	"Z80COV1\n"	/* header of the data file */
+
+#define bit_set(m, a)	((m)[(a) >> 3] |= 1 << ((a) & 7))
+#define bit_tst(m, a)	((m)[(a) >> 3] & (1 << ((a) & 7)))
+
+static BYTE cov_exec[COV_SIZE / 8];	/* instruction executed */
+static BYTE cov_taken[COV_SIZE / 8];	/* branch taken */
+static BYTE cov_ntaken[COV_SIZE / 8];	/* branch not taken */
+
+struct routine {
+	unsigned int insns, insns_x;	/* instructions, executed */
+	unsigned int bytes, bytes_x;	/* code bytes, executed */
+	unsigned int branches;		/* conditional branches */
+	unsigned int both;		/* branches gone both ways */
+};
+
+/*
+ *	Read the data file of earlier runs, if there is one
+ */
+void cover_init(void)
+{
+	FILE *fp;
+	char magic[sizeof(COV_MAGIC)];
+	BYTE buf[COV_SIZE / 8];
+	register int i;
+
+	if ((fp = fopen(cfn, "r")) == NULL)
+		return;
+	if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, COV_MAGIC, 8)) {
+		printf("%s is not a coverage file\n", cfn);
+		exit(1);
+	}
+	if (fread(buf, 1, sizeof(buf), fp) == sizeof(buf))
+		for (i = 0; i < COV_SIZE / 8; i++)
+			cov_exec[i] |= buf[i];
+	if (fread(buf, 1, sizeof(buf), fp) == sizeof(buf))
+		for (i = 0; i < COV_SIZE / 8; i++)
+			cov_taken[i] |= buf[i];
+	if (fread(buf, 1, sizeof(buf), fp) == sizeof(buf))
+		for (i = 0; i < COV_SIZE / 8; i++)
+			cov_ntaken[i] |= buf[i];
+	fclose(fp);
+}
+
+/*
+ *	Check if the instruction in p is a conditional branch
+ */
+static int is_cond(BYTE *p, WORD addr, struct opinfo *oi)
+{
+	return(op_decode(p, addr, oi) && oi->cond && oi->kind != OP_REP);
+}
+
+/*
+ *	Called after every instruction with the PC from before it
+ */
+void cover_step(WORD pc)
+{
+	struct opinfo oi;
+
+	if (pc >= COV_SIZE)
+		return;
+	bit_set(cov_exec, pc);
+	if (is_cond(&memory[pc], pc, &oi)) {
+		if (PC == (WORD) (pc + oi.len))
+			bit_set(cov_ntaken, pc);
+		else
+			bit_set(cov_taken, pc);
+	}
+}
+
+static void cover_save(void)
+{
+	FILE *fp;
+
+	if ((fp = fopen(cfn, "w")) == NULL) {
+		printf("can't open file %s\n", cfn);
+		return;
+	}
+	fwrite(COV_MAGIC, 1, 8, fp);
+	fwrite(cov_exec, 1, sizeof(cov_exec), fp);
+	fwrite(cov_taken, 1, sizeof(cov_taken), fp);
+	fwrite(cov_ntaken, 1, sizeof(cov_ntaken), fp);
+	fclose(fp);
+}
+
+/*
+ *	Write the annotated listing and the summary per label
+ */
+static void cover_report(void)
+{
+	static struct routine r[65536];
+	FILE *in, *out, *sum;
+	char buf[BUFSIZE];
+	char fn[4096 + 8];
+	char lbl[SYM_NAMELEN + 8];
+	BYTE bytes[LST_MAXBYTES];
+	char *src, *mark;
+	struct opinfo oi;
+	WORD addr;
+	unsigned int code = 0, code_x = 0, dead = 0;
+	int i, n, key;
+
+	if (sym_file() == NULL) {
+		puts("no listing for coverage report, use option -y");
+		return;
+	}
+	if ((in = fopen(sym_file(), "r")) == NULL) {
+		printf("can't open listing %s\n", sym_file());
+		return;
+	}
+	strcpy(fn, cfn);
+	strcat(fn, ".lst");
+	if ((out = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		fclose(in);
+		return;
+	}
+
+	while (fgets(buf, BUFSIZE, in) != NULL) {
+		mark = "     ";
+		if (lst_line(buf, &addr, bytes, &n, &src) && n > 0 &&
+		    addr < COV_SIZE && !lst_data(src)) {
+			key = sym_find(addr);
+			key = (key < 0) ? addr : sym_addr(key);
+			r[key].insns++;
+			r[key].bytes += n;
+			code += n;
+			if (bit_tst(cov_exec, addr)) {
+				r[key].insns_x++;
+				r[key].bytes_x += n;
+				code_x += n;
+				mark = "   + ";
+			} else
+				mark = "#### ";
+			if (is_cond(bytes, addr, &oi) &&
+			    bytes[0] == memory[addr]) {
+				r[key].branches++;
+				if (bit_tst(cov_taken, addr) &&
+				    bit_tst(cov_ntaken, addr)) {
+					r[key].both++;
+					mark = "  tn ";
+				} else if (bit_tst(cov_taken, addr))
+					mark = "  t- ";
+				else if (bit_tst(cov_ntaken, addr))
+					mark = "  -n ";
+			}
+		}
+		fputs(mark, out);
+		fputs(buf, out);
+	}
+	fclose(in);
+	fclose(out);
+
+	strcpy(fn, cfn);
+	strcat(fn, ".txt");
+	if ((sum = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return;
+	}
+	fprintf(sum, "ROM coverage, %u of %u code bytes executed (%.1f%%)\n\n",
+		code_x, code, code ? 100.0 * code_x / code : 0.0);
+	fprintf(sum, "addr   insns  exec  bytes  exec  branches both  routine\n");
+	for (i = 0; i < COV_SIZE; i++) {
+		if (r[i].insns == 0)
+			continue;
+		fprintf(sum, "%04X %6u %5u %6u %5u %9u %4u  %s%s\n", i,
+			r[i].insns, r[i].insns_x, r[i].bytes, r[i].bytes_x,
+			r[i].branches, r[i].both, sym_label(i, lbl),
+			r[i].insns_x ? "" : "  (never executed)");
+		if (r[i].insns_x == 0)
+			dead += r[i].bytes;
+	}
+	fprintf(sum, "\n%u code bytes in routines never executed\n", dead);
+	fclose(sum);
+}
+
+/*
+ *	Merge the coverage into the data file and write the reports
+ */
+void cover_exit(void)
+{
+	cover_save();
+	cover_report();
+}
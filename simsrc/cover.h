@@ -0,0 +1,19 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module records code coverage of the ROM.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _COVER_H_
+#define _COVER_H_
+
+#define COV_SIZE	16384		/* size of the ROM covered */
+
+extern void cover_init(void);
+extern void cover_exit(void);
+extern void cover_step(WORD);
+
+#endif
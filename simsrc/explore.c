@@ -0,0 +1,332 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs branches of one booted machine with different
+ * keystrokes.
+ *
+ * The file given with option -E has one branch per line, the keys to
+ * type, the number of frames to run after them and the golden hash of
+ * the LCD at the end, if known:
+ *
+ *	# branch	frames	keys		hash
+ *	list		50	k/		5e1f0c2a9b3d4e77
+ *	print-at	50	^p^i5^o3^o^p/
+ *
+ * Keys are typed as on the Spectrum keyboard: a lower case letter or
+ * digit is the key alone, an upper case letter the key with CAPS
+ * SHIFT, ^ presses SYMBOL SHIFT with the next key, _ is SPACE, / is
+ * ENTER and . waits for the time of one key, - alone is no keys.
+ *
+ * The ROM loaded with -x is booted once with the machine API until the
+ * editor waits for a key (WAIT-KEY in the listing), this machine is
+ * forked copy-on-write into one branch per line. A pool of threads,
+ * one per core, runs the branches: each key is held down EXPLORE_DOWN
+ * frames and released for EXPLORE_UP frames, then the branch runs for
+ * its frames and the LCD GRAM is hashed.
+ *
+ * Branches whose hash differs from the golden one or that stop with a
+ * CPU error are reported and the exit code is 1.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#define _GNU_SOURCE		/* sched_getaffinity() */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include "sim.h"
+#include "simglb.h"
+#include "symtab.h"
+#include "machine.h"
+#include "fleet.h"
+#include "explore.h"
+
+#define BUFSIZE		512		/* max line length of branch file */
+#define BOOT_TMAX	500000000ULL	/* max. T-states for booting */
+#define ERR_NR		0x5c3a		/* system variable, report code */
+
+struct branch {
+	char name[64];
+	char keys[EXPLORE_KEYS];
+	int frames;			/* frames to run after the keys */
+	int golden;			/* hash below is golden */
+	unsigned long long hash;
+	struct machine *m;
+	unsigned long long res;		/* hash of the LCD GRAM */
+	int report;			/* ERR_NR + 1 at the end */
+	int failed;
+};
+
+static struct branch *branches;
+static int nbranches;
+static int next;			/* next branch to run */
+
+/* key matrix: # = CAPS SHIFT, $ = SYMBOL SHIFT, / = ENTER, _ = SPACE */
+static char *matrix[8] = { "#zxcv", "asdfg", "qwert", "12345", "09876",
+			   "poiuy", "/lkjh", "_$mnb" };
+
+/*
+ *	Find row and column of the key for c, 1 if there is none
+ */
+static int explore_find(int c, int *row, int *col)
+{
+	char *p;
+	register int i;
+
+	if (c == '\0' || c == '#' || c == '$')
+		return(1);
+	for (i = 0; i < 8; i++)
+		if ((p = strchr(matrix[i], tolower(c))) != NULL) {
+			*row = i;
+			*col = p - matrix[i];
+			return(0);
+		}
+	return(1);
+}
+
+/*
+ *	Check the keys of a branch, 1 if one is unknown
+ */
+static int explore_check(char *k)
+{
+	int row, col;
+
+	for (; *k; k++) {
+		if (*k == '.')
+			continue;
+		if (*k == '^')
+			k++;
+		if (explore_find(*k, &row, &col))
+			return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Press or release the key for c
+ */
+static void explore_key(struct machine *m, int c, int down)
+{
+	int row, col;
+
+	if (explore_find(c, &row, &col))
+		return;
+	if (isupper(c))
+		machine_key(m, 0, 0, down);	/* CAPS SHIFT */
+	machine_key(m, row, col, down);
+}
+
+/*
+ *	Read the branch file
+ */
+static int explore_file(char *fn)
+{
+	FILE *fp;
+	char buf[BUFSIZE];
+	char *s;
+	struct branch br, *b = &br;	/* copied in below the limit */
+	int n, line = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("can't open branch file %s\n", fn);
+		return(1);
+	}
+	branches = calloc(EXPLORE_MAX, sizeof(struct branch));
+	if (branches == NULL) {
+		puts("out of memory for branches");
+		exit(1);
+	}
+	while (fgets(buf, BUFSIZE, fp) != NULL) {
+		line++;
+		if ((s = strchr(buf, '#')) != NULL)
+			*s = '\0';
+		memset(b, 0, sizeof(*b));
+		n = sscanf(buf, "%63s %d %255s %llx", b->name, &b->frames,
+			   b->keys, &b->hash);
+		if (n <= 0)
+			continue;
+		if (n < 3 || b->frames < 0) {
+			printf("%s: line %d: branch, frames and keys expected\n",
+			       fn, line);
+			return(1);
+		}
+		if (strcmp(b->keys, "-") == 0)	/* no keys */
+			*b->keys = '\0';
+		else if (explore_check(b->keys)) {
+			printf("%s: line %d: unknown key in %s\n", fn, line,
+			       b->keys);
+			return(1);
+		}
+		if (nbranches == EXPLORE_MAX) {
+			printf("%s: more than %d branches\n", fn, EXPLORE_MAX);
+			return(1);
+		}
+		b->golden = (n == 4);
+		branches[nbranches++] = *b;
+	}
+	fclose(fp);
+	return(0);
+}
+
+/*
+ *	Type the keys and run the branch, result into b
+ */
+static void explore_branch(struct branch *b)
+{
+	struct machine *m = b->m;
+	unsigned long long frame = INT_PERIOD;
+	char *k;
+	int sym, size;
+
+	for (k = b->keys; *k; k++) {
+		if (*k == '.') {
+			if (machine_run(m, (EXPLORE_DOWN + EXPLORE_UP) * frame,
+					-1) != M_TIME)
+				return;
+			continue;
+		}
+		if ((sym = (*k == '^')))
+			k++;
+		if (sym)
+			machine_key(m, 7, 1, 1);	/* SYMBOL SHIFT */
+		explore_key(m, *k, 1);
+		if (machine_run(m, EXPLORE_DOWN * frame, -1) != M_TIME)
+			return;
+		explore_key(m, *k, 0);
+		if (sym)
+			machine_key(m, 7, 1, 0);
+		if (machine_run(m, EXPLORE_UP * frame, -1) != M_TIME)
+			return;
+	}
+	if (machine_run(m, b->frames * frame, -1) != M_TIME)
+		return;
+
+	b->res = fleet_hash(machine_gram(m, &size), size);
+	b->report = (machine_mem(m)[ERR_NR] + 1) & 0xff;
+	b->failed = 0;
+}
+
+/*
+ *	Thread of the pool, runs branches until none is left
+ */
+static void *explore_worker(void *arg)
+{
+	int i;
+
+	arg = arg;	/* to avoid compiler warning */
+
+	while ((i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED))
+	       < nbranches) {
+		explore_branch(&branches[i]);
+		machine_destroy(branches[i].m);
+	}
+	return(NULL);
+}
+
+/*
+ *	Boot the -x ROM into machine m, 0 if ok
+ */
+static int explore_boot(struct machine *m)
+{
+	int a;
+
+	if (machine_load(m, xfn) || sym_load_near(xfn)) {
+		printf("can't load ROM %s with listing\n", xfn);
+		return(1);
+	}
+	if ((a = sym_lookup("WAIT-KEY")) < 0) {
+		printf("%s: routine WAIT-KEY not in listing\n", xfn);
+		return(1);
+	}
+	if (machine_run(m, BOOT_TMAX, a) != M_ADDR) {
+		printf("%s: doesn't boot to WAIT-KEY\n", xfn);
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Run the branches, returns exit code
+ */
+int explore_run(void)
+{
+	static struct machine *forks[EXPLORE_MAX];
+	static pthread_t tid[CPU_SETSIZE];
+	struct timespec t1, t2;
+	struct machine *base;
+	struct branch *b;
+	cpu_set_t cpus;
+	double secs;
+	int nthreads, rc = 0, bad = 0, new = 0;
+	register int i;
+
+	if (explore_file(efn))
+		return(1);
+	if ((base = machine_create()) == NULL) {
+		puts("out of memory for machine");
+		return(1);
+	}
+	if (explore_boot(base))
+		return(1);
+	if (nbranches == 0)
+		return(0);
+	if (machine_fork(base, forks, nbranches)) {
+		puts("can't fork machine into branches");
+		return(1);
+	}
+	for (i = 0; i < nbranches; i++) {
+		branches[i].m = forks[i];
+		branches[i].failed = 1;	/* until the run reports */
+	}
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) ||
+	    (nthreads = CPU_COUNT(&cpus)) < 1)
+		nthreads = 1;
+	if (nthreads > nbranches)
+		nthreads = nbranches;
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&tid[i], NULL, explore_worker, NULL))
+			break;
+	if (i == 0)			/* no threads, run them here */
+		explore_worker(NULL);
+	while (i > 0)
+		pthread_join(tid[--i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+	printf("\n%-20s %-24s %7s %6s %16s  %s\n", "branch", "keys",
+	       "frames", "report", "hash", "result");
+	for (i = 0; i < nbranches; i++) {
+		b = &branches[i];
+		if (b->failed) {
+			printf("%-20s %-24s %7d %6s %16s  failed\n", b->name,
+			       b->keys, b->frames, "", "");
+			rc = 1;
+			continue;
+		}
+		printf("%-20s %-24s %7d %6X %016llx  ", b->name, b->keys,
+		       b->frames, b->report, b->res);
+		if (!b->golden) {
+			puts("new");
+			new++;
+		} else if (b->res != b->hash) {
+			printf("MISMATCH, golden %016llx\n", b->hash);
+			bad++;
+			rc = 1;
+		} else
+			puts("ok");
+	}
+	printf("\n%d branches, %d mismatches, %d without golden hash\n",
+	       nbranches, bad, new);
+	printf("%d threads, %.3f s, %.1f branches/s\n", nthreads, secs,
+	       secs > 0.0 ? nbranches / secs : 0.0);
+	machine_destroy(base);
+	return(rc);
+}
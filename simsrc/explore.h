@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs branches of one booted machine with different
+ * keystrokes.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _EXPLORE_H_
+#define _EXPLORE_H_
+
+#define EXPLORE_MAX	4096		/* max. branches */
+#define EXPLORE_KEYS	256		/* max. keystrokes per branch */
+#define EXPLORE_DOWN	4		/* frames a key is held down */
+#define EXPLORE_UP	4		/* frames between two keys */
+
+extern int explore_run(void);
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs a corpus of BASIC programs on parallel workers.
+ *
+ * The corpus file given with option -F has one program per line,
+ * the number of frames to run it and the golden hash of the LCD
+ * after that, if known:
+ *
+ *	# program		frames	hash
+ *	corpus/print.bin	100	5e1f0c2a9b3d4e77
+ *
+ * A program file holds the tokenized lines, as in the PROG area or
+ * the data block of a tape file.
+ *
+ * The ROM loaded with -x is booted once until the editor waits for a
+ * key, this machine is the snapshot shared copy-on-write by all
+ * workers. One worker is forked per core and pinned to it, the
+ * workers take the next program from a counter in shared memory and
+ * run each one in a fork of their own, so that it starts from the
+ * untouched snapshot. The program is inserted in front of the
+ * variables, RUN is put into the edit line and the ROM continues at
+ * MAIN-3 as if ENTER had been pressed. After the frames the LCD GRAM
+ * is hashed and the result is left in shared memory.
+ *
+ * Programs whose hash differs from the golden one are reported and
+ * the exit code is 1, programs without golden hash just get theirs
+ * printed.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#define _GNU_SOURCE		/* sched_setaffinity() */
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "il9341.h"
+#include "symtab.h"
+#include "bench.h"
+#include "fleet.h"
+
+#define BUFSIZE		4352		/* max line length of corpus file */
+
+/* system variables used */
+#define ERR_NR		0x5c3a
+#define ERR_SP		0x5c3d
+#define E_LINE		0x5c59
+#define K_CUR		0x5c5b
+#define WORKSP		0x5c61
+#define STKBOT		0x5c63
+#define STKEND		0x5c65
+
+#define T_RUN		0xf7		/* token of RUN */
+
+struct prog {
+	char fn[4096];			/* program file */
+	int frames;			/* frames to run */
+	int golden;			/* hash below is golden */
+	unsigned long long hash;
+};
+
+struct result {
+	unsigned long long hash;	/* hash of the LCD GRAM */
+	unsigned long long t;		/* T-states run */
+	int report;			/* ERR_NR + 1 at the end */
+	int failed;
+};
+
+struct fleet_shm {
+	int next;			/* next program to run */
+	struct result res[FLEET_MAX];
+};
+
+static struct prog *progs;
+static int nprogs;
+static struct fleet_shm *shm;
+static WORD main3;			/* MAIN-3 in the ROM */
+static cpu_set_t cpus;			/* cores we may run on */
+
+#define rd16(a)		(memory[a] + (memory[(a) + 1] << 8))
+#define wr16(a, v)	(memory[a] = (v) & 0xff, memory[(a) + 1] = (v) >> 8)
+
+#define ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+#define P1		0x9e3779b185ebca87ULL
+#define P2		0xc2b2ae3d27d4eb4fULL
+
+/*
+ *	64 bit hash over 4 independent lanes of 8 bytes, so that the
+ *	compiler can keep them in vector registers
+ */
+unsigned long long fleet_hash(const BYTE *p, int n)
+{
+	unsigned long long v[4] = { P1 + P2, P2, 0, -P1 };
+	unsigned long long h, k;
+	register int i, j;
+
+	for (i = 0; i + 32 <= n; i += 32)
+		for (j = 0; j < 4; j++) {
+			memcpy(&k, p + i + j * 8, 8);
+			v[j] = ROTL(v[j] + k * P2, 31) * P1;
+		}
+	h = ROTL(v[0], 1) + ROTL(v[1], 7) + ROTL(v[2], 12) + ROTL(v[3], 18);
+	for (; i < n; i++)
+		h = ROTL(h ^ (p[i] * P1), 11) * P2;
+	h ^= n;
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	return(h);
+}
+
+/*
+ *	Read the corpus file
+ */
+static int fleet_corpus(char *fn)
+{
+	FILE *fp;
+	char buf[BUFSIZE];
+	char *s;
+	int n, line = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("can't open corpus %s\n", fn);
+		return(1);
+	}
+	progs = calloc(FLEET_MAX, sizeof(struct prog));
+	if (progs == NULL) {
+		puts("out of memory for corpus");
+		exit(1);
+	}
+	while (fgets(buf, BUFSIZE, fp) != NULL) {
+		line++;
+		if ((s = strchr(buf, '#')) != NULL)
+			*s = '\0';
+		n = sscanf(buf, "%4095s %d %llx", progs[nprogs].fn,
+			   &progs[nprogs].frames, &progs[nprogs].hash);
+		if (n <= 0)
+			continue;
+		if (n == 1 || progs[nprogs].frames <= 0) {
+			printf("%s: line %d: program and frames expected\n",
+			       fn, line);
+			return(1);
+		}
+		if (nprogs == FLEET_MAX) {
+			printf("%s: more than %d programs\n", fn, FLEET_MAX);
+			return(1);
+		}
+		progs[nprogs++].golden = (n == 3);
+	}
+	fclose(fp);
+	return(0);
+}
+
+/*
+ *	Put RUN into the empty edit line
+ */
+static int fleet_edit_run(void)
+{
+	static WORD ptrs[] = { K_CUR, WORKSP, STKBOT, STKEND, 0 };
+	WORD e = rd16(E_LINE), end = rd16(STKEND), p;
+	register int i;
+
+	if (end < e || end + 1 >= MEMORY_SIZE)
+		return(1);
+	memmove(&memory[e + 1], &memory[e], end - e);
+	memory[e] = T_RUN;
+	for (i = 0; ptrs[i]; i++) {
+		p = rd16(ptrs[i]);
+		if (p >= e)
+			wr16(ptrs[i], p + 1);
+	}
+	return(0);
+}
+
+/*
+ *	Run program i in this process, result into shared memory
+ */
+static void fleet_prog(int i)
+{
+	static BYTE buf[FLEET_PROG];
+	struct result *r = &shm->res[i];
+	FILE *fp;
+	BYTE *gram;
+	int n, size;
+
+	if ((fp = fopen(progs[i].fn, "r")) == NULL) {
+		printf("can't open program %s\n", progs[i].fn);
+		fflush(stdout);
+		_exit(1);
+	}
+	n = fread(buf, 1, FLEET_PROG, fp);
+	fclose(fp);
+	if (n <= 0 || bench_program(buf, n) || fleet_edit_run()) {
+		printf("%s: no room for program\n", progs[i].fn);
+		fflush(stdout);
+		_exit(1);
+	}
+
+	/* as if ENTER was pressed and the syntax was checked */
+	memory[ERR_NR] = 0xff;
+	SP = rd16(ERR_SP);
+	PC = main3;
+	bench_until(-1, (unsigned long long) progs[i].frames * int_period);
+
+	gram = il9341_gram(&size);
+	r->hash = fleet_hash(gram, size);
+	r->t = bench_t;
+	r->report = (memory[ERR_NR] + 1) & 0xff;
+	r->failed = 0;
+	fflush(stdout);
+	_exit(0);
+}
+
+/*
+ *	Worker pinned to the n'th core, runs programs until none is left
+ */
+static void fleet_worker(int n)
+{
+	cpu_set_t set;
+	pid_t pid;
+	int i, status;
+
+	for (i = 0; i < CPU_SETSIZE; i++)
+		if (CPU_ISSET(i, &cpus) && n-- == 0) {
+			CPU_ZERO(&set);
+			CPU_SET(i, &set);
+			sched_setaffinity(0, sizeof(set), &set);
+			break;
+		}
+
+	while ((i = __atomic_fetch_add(&shm->next, 1, __ATOMIC_RELAXED))
+	       < nprogs) {
+		if ((pid = fork()) == 0)
+			fleet_prog(i);
+		if (pid < 0 || waitpid(pid, &status, 0) < 0)
+			break;
+	}
+	_exit(0);
+}
+
+/*
+ *	Run the corpus, returns exit code
+ */
+int fleet_run(void)
+{
+	struct timespec t1, t2;
+	struct result *r;
+	unsigned long long frames = 0;
+	double secs;
+	int ncpu, rc = 0, bad = 0, new = 0;
+	register int i;
+	int a;
+
+	if (fleet_corpus(ffn))
+		return(1);
+	bench_init();
+	if (bench_boot(xfn))
+		return(1);
+	if ((a = sym_lookup("MAIN-3")) < 0) {
+		printf("%s: routine MAIN-3 not in listing\n", xfn);
+		return(1);
+	}
+	main3 = a;
+
+	shm = mmap(NULL, sizeof(struct fleet_shm), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		return(1);
+	}
+	for (i = 0; i < nprogs; i++)
+		shm->res[i].failed = 1;	/* until the run reports */
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) ||
+	    (ncpu = CPU_COUNT(&cpus)) < 1)
+		ncpu = 1;
+	if (ncpu > nprogs)
+		ncpu = nprogs;
+
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (i = 0; i < ncpu; i++)
+		if (fork() == 0)
+			fleet_worker(i);
+	while (wait(NULL) > 0)
+		;
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+	printf("\n%-32s %7s %6s %16s  %s\n", "program", "frames", "report",
+	       "hash", "result");
+	for (i = 0; i < nprogs; i++) {
+		r = &shm->res[i];
+		if (r->failed) {
+			printf("%-32s %7d %6s %16s  failed\n", progs[i].fn,
+			       progs[i].frames, "", "");
+			rc = 1;
+			continue;
+		}
+		frames += progs[i].frames;
+		printf("%-32s %7d %6X %016llx  ", progs[i].fn,
+		       progs[i].frames, r->report, r->hash);
+		if (!progs[i].golden) {
+			puts("new");
+			new++;
+		} else if (r->hash != progs[i].hash) {
+			printf("MISMATCH, golden %016llx\n", progs[i].hash);
+			bad++;
+			rc = 1;
+		} else
+			puts("ok");
+	}
+	printf("\n%d programs, %d mismatches, %d without golden hash\n",
+	       nprogs, bad, new);
+	printf("%d workers, %.2f s, %.1f programs/s, %.0f frames/s\n", ncpu,
+	       secs, secs > 0.0 ? nprogs / secs : 0.0,
+	       secs > 0.0 ? frames / secs : 0.0);
+	munmap(shm, sizeof(struct fleet_shm));
+	return(rc);
+}
@@ -0,0 +1,19 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module runs a corpus of BASIC programs on parallel workers.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#define FLEET_MAX	4096		/* max. programs in the corpus */
+#define FLEET_PROG	32768		/* max. size of a program */
+
+extern unsigned long long fleet_hash(const BYTE *, int);
+extern int fleet_run(void);
+
+#endif
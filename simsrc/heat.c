@@ -0,0 +1,315 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module counts data accesses per memory address.
+ *
+ * memrdr() and memwrt() report every access, together with the PC
+ * of the instruction doing it. Reads of the instruction bytes itself
+ * are not counted. Per address, per instruction and per pair of both
+ * reads and writes are counted, and the lowest SP per instruction is
+ * recorded for the stack high-water mark.
+ *
+ * On exit the following files are written:
+ *	file.ppm	heatmap of the memory, 256 addresses per line,
+ *			green is reads and red is writes, log scaled
+ *	file.csv	reads and writes per address with system
+ *			variable names and the instruction accessing
+ *			the address most
+ *	file.pc.csv	reads, writes and lowest SP per routine
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "heat.h"
+
+#define HEAT_W		256	/* addresses per line of the image */
+#define HEAT_PAIRS	262144	/* (PC, address) pairs counted, power of 2 */
+
+struct pair {
+	unsigned int key;		/* PC << 16 | address, 0 is unused */
+	unsigned long rd, wr;
+};
+
+struct sysvar {
+	WORD addr;
+	int len;
+	char *name;
+};
+
+WORD heat_pc;				/* PC of the instruction running */
+
+static unsigned long rd[MEMORY_SIZE];	/* reads per address */
+static unsigned long wr[MEMORY_SIZE];	/* writes per address */
+static unsigned long pc_rd[65536];	/* reads done per instruction */
+static unsigned long pc_wr[65536];	/* writes done per instruction */
+static WORD sp_min[65536];		/* lowest SP per instruction */
+static WORD sp_low = 0xffff;		/* lowest SP of all */
+static WORD sp_low_pc;			/* instruction it was seen at */
+static struct pair *pairs;
+static unsigned long lost;		/* accesses not fitting into pairs */
+
+static struct sysvar sysvars[] = {
+	{ 0x5c00, 8, "KSTATE" },	{ 0x5c08, 1, "LAST_K" },
+	{ 0x5c09, 1, "REPDEL" },	{ 0x5c0a, 1, "REPPER" },
+	{ 0x5c0b, 2, "DEFADD" },	{ 0x5c0d, 1, "K_DATA" },
+	{ 0x5c0e, 2, "TVDATA" },	{ 0x5c10, 38, "STRMS" },
+	{ 0x5c36, 2, "CHARS" },		{ 0x5c38, 1, "RASP" },
+	{ 0x5c39, 1, "PIP" },		{ 0x5c3a, 1, "ERR_NR" },
+	{ 0x5c3b, 1, "FLAGS" },		{ 0x5c3c, 1, "TV_FLAG" },
+	{ 0x5c3d, 2, "ERR_SP" },	{ 0x5c3f, 2, "LIST_SP" },
+	{ 0x5c41, 1, "MODE" },		{ 0x5c42, 2, "NEWPPC" },
+	{ 0x5c44, 1, "NSPPC" },		{ 0x5c45, 2, "PPC" },
+	{ 0x5c47, 1, "SUBPPC" },	{ 0x5c48, 1, "BORDCR" },
+	{ 0x5c49, 2, "E_PPC" },		{ 0x5c4b, 2, "VARS" },
+	{ 0x5c4d, 2, "DEST" },		{ 0x5c4f, 2, "CHANS" },
+	{ 0x5c51, 2, "CURCHL" },	{ 0x5c53, 2, "PROG" },
+	{ 0x5c55, 2, "NXTLIN" },	{ 0x5c57, 2, "DATADD" },
+	{ 0x5c59, 2, "E_LINE" },	{ 0x5c5b, 2, "K_CUR" },
+	{ 0x5c5d, 2, "CH_ADD" },	{ 0x5c5f, 2, "X_PTR" },
+	{ 0x5c61, 2, "WORKSP" },	{ 0x5c63, 2, "STKBOT" },
+	{ 0x5c65, 2, "STKEND" },	{ 0x5c67, 1, "BREG" },
+	{ 0x5c68, 2, "MEM" },		{ 0x5c6a, 1, "FLAGS2" },
+	{ 0x5c6b, 1, "DF_SZ" },		{ 0x5c6c, 2, "S_TOP" },
+	{ 0x5c6e, 2, "OLDPPC" },	{ 0x5c70, 1, "OSPPC" },
+	{ 0x5c71, 1, "FLAGX" },		{ 0x5c72, 2, "STRLEN" },
+	{ 0x5c74, 2, "T_ADDR" },	{ 0x5c76, 2, "SEED" },
+	{ 0x5c78, 3, "FRAMES" },	{ 0x5c7b, 2, "UDG" },
+	{ 0x5c7d, 2, "COORDS" },	{ 0x5c7f, 1, "P_POSN" },
+	{ 0x5c80, 2, "PR_CC" },		{ 0x5c82, 2, "ECHO_E" },
+	{ 0x5c84, 2, "DF_CC" },		{ 0x5c86, 2, "DF_CCL" },
+	{ 0x5c88, 2, "S_POSN" },	{ 0x5c8a, 2, "SPOSNL" },
+	{ 0x5c8c, 1, "SCR_CT" },	{ 0x5c8d, 1, "ATTR_P" },
+	{ 0x5c8e, 1, "MASK_P" },	{ 0x5c8f, 1, "ATTR_T" },
+	{ 0x5c90, 1, "MASK_T" },	{ 0x5c91, 1, "P_FLAG" },
+	{ 0x5c92, 30, "MEMBOT" },	{ 0x5cb0, 2, "NMIADD" },
+	{ 0x5cb2, 2, "RAMTOP" },	{ 0x5cb4, 2, "P_RAMT" },
+	{ 0, 0, NULL }
+};
+
+void heat_init(void)
+{
+	pairs = calloc(HEAT_PAIRS, sizeof(struct pair));
+	if (pairs == NULL) {
+		puts("out of memory for heatmap");
+		exit(1);
+	}
+	memset(sp_min, 0xff, sizeof(sp_min));
+}
+
+static struct pair *heat_pair(WORD addr)
+{
+	register struct pair *p;
+	register unsigned int key = (heat_pc << 16) | addr;
+	register unsigned int h, n;
+
+	if (key == 0)
+		return(NULL);
+	h = (key * 2654435761U) >> 14;
+	for (n = 0; n < 16; n++) {
+		p = &pairs[(h + n) & (HEAT_PAIRS - 1)];
+		if (p->key == key)
+			return(p);
+		if (p->key == 0) {
+			p->key = key;
+			return(p);
+		}
+	}
+	lost++;
+	return(NULL);
+}
+
+/*
+ *	Called from memrdr() for every read
+ */
+void heat_rd(WORD addr)
+{
+	register struct pair *p;
+
+	/* op-code and operands of the instruction itself */
+	if ((WORD) (addr - heat_pc) < 4)
+		return;
+	rd[addr]++;
+	pc_rd[heat_pc]++;
+	if ((p = heat_pair(addr)) != NULL)
+		p->rd++;
+}
+
+/*
+ *	Called from memwrt() for every write
+ */
+void heat_wr(WORD addr)
+{
+	register struct pair *p;
+
+	wr[addr]++;
+	pc_wr[heat_pc]++;
+	if ((p = heat_pair(addr)) != NULL)
+		p->wr++;
+}
+
+/*
+ *	Called after every instruction with the new SP
+ */
+void heat_sp(WORD sp)
+{
+	if (sp < sp_min[heat_pc])
+		sp_min[heat_pc] = sp;
+	if (sp < sp_low) {
+		sp_low = sp;
+		sp_low_pc = heat_pc;
+	}
+}
+
+/*
+ *	Name of the system variable at addr into buf, empty if none
+ */
+static char *heat_var(WORD addr, char *buf)
+{
+	register struct sysvar *v;
+
+	buf[0] = '\0';
+	for (v = sysvars; v->name != NULL; v++)
+		if (addr >= v->addr && addr < v->addr + v->len) {
+			if (addr == v->addr)
+				strcpy(buf, v->name);
+			else
+				sprintf(buf, "%s+%d", v->name, addr - v->addr);
+			break;
+		}
+	return(buf);
+}
+
+static BYTE heat_scale(unsigned long n, double max)
+{
+	if (n == 0)
+		return(0);
+	return((BYTE) (55 + 200 * log((double) n) / max));
+}
+
+static void heat_image(char *fn)
+{
+	FILE *fp;
+	unsigned long max = 1;
+	double lmax;
+	register int i;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return;
+	}
+	for (i = 0; i < MEMORY_SIZE; i++) {
+		if (rd[i] > max)
+			max = rd[i];
+		if (wr[i] > max)
+			max = wr[i];
+	}
+	lmax = (max > 1) ? log((double) max) : 1.0;
+	fprintf(fp, "P6\n%d %d\n255\n", HEAT_W, MEMORY_SIZE / HEAT_W);
+	for (i = 0; i < MEMORY_SIZE; i++) {
+		putc(heat_scale(wr[i], lmax), fp);
+		putc(heat_scale(rd[i], lmax), fp);
+		putc(0, fp);
+	}
+	fclose(fp);
+}
+
+static void heat_addr(char *fn)
+{
+	static unsigned int top[MEMORY_SIZE];
+	static unsigned long top_n[MEMORY_SIZE];
+	FILE *fp;
+	char var[SYM_NAMELEN + 8];
+	char lbl[SYM_NAMELEN + 8];
+	register struct pair *p;
+	register int i;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return;
+	}
+	for (i = 0; i < HEAT_PAIRS; i++) {
+		p = &pairs[i];
+		if (p->key && (p->key & 0xffff) < MEMORY_SIZE &&
+		    p->rd + p->wr > top_n[p->key & 0xffff]) {
+			top_n[p->key & 0xffff] = p->rd + p->wr;
+			top[p->key & 0xffff] = p->key >> 16;
+		}
+	}
+	fprintf(fp, "addr,sysvar,reads,writes,top_pc,top_label,top_count\n");
+	for (i = 0; i < MEMORY_SIZE; i++) {
+		if (rd[i] == 0 && wr[i] == 0)
+			continue;
+		fprintf(fp, "%04X,%s,%lu,%lu,", i, heat_var(i, var),
+			rd[i], wr[i]);
+		if (top_n[i])
+			fprintf(fp, "%04X,%s,%lu\n", top[i],
+				sym_label(top[i], lbl), top_n[i]);
+		else
+			fprintf(fp, ",,\n");
+	}
+	fclose(fp);
+}
+
+static void heat_routines(char *fn)
+{
+	static unsigned long r_rd[65536], r_wr[65536];
+	static WORD r_sp[65536];
+	FILE *fp;
+	char lbl[SYM_NAMELEN + 8];
+	register int i, k;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return;
+	}
+	memset(r_sp, 0xff, sizeof(r_sp));
+	for (i = 0; i < 65536; i++) {
+		if (pc_rd[i] == 0 && pc_wr[i] == 0 && sp_min[i] == 0xffff)
+			continue;
+		k = sym_find(i);
+		k = (k < 0) ? i : sym_addr(k);
+		r_rd[k] += pc_rd[i];
+		r_wr[k] += pc_wr[i];
+		if (sp_min[i] < r_sp[k])
+			r_sp[k] = sp_min[i];
+	}
+	fprintf(fp, "addr,routine,reads,writes,min_sp\n");
+	for (i = 0; i < 65536; i++)
+		if (r_rd[i] || r_wr[i] || r_sp[i] != 0xffff)
+			fprintf(fp, "%04X,%s,%lu,%lu,%04X\n", i,
+				sym_label(i, lbl), r_rd[i], r_wr[i], r_sp[i]);
+	fclose(fp);
+}
+
+/*
+ *	Write the heatmap and the tables
+ */
+void heat_exit(void)
+{
+	char fn[4096 + 8];
+	char lbl[SYM_NAMELEN + 8];
+
+	strcpy(fn, hfn);
+	strcat(fn, ".ppm");
+	heat_image(fn);
+	strcpy(fn, hfn);
+	strcat(fn, ".csv");
+	heat_addr(fn);
+	strcpy(fn, hfn);
+	strcat(fn, ".pc.csv");
+	heat_routines(fn);
+
+	printf("Stack high-water mark %04X at %s\n", sp_low,
+	       sym_label(sp_low_pc, lbl));
+	if (lost)
+		printf("Heatmap: %lu accesses not counted per PC\n", lost);
+}
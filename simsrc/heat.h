@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module counts data accesses per memory address.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _HEAT_H_
+#define _HEAT_H_
+
+extern WORD heat_pc;
+
+extern void heat_init(void);
+extern void heat_exit(void);
+extern void heat_rd(WORD);
+extern void heat_wr(WORD);
+extern void heat_sp(WORD);
+
+#endif
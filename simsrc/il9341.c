@@ -2,19 +2,28 @@
 #include "SDL.h"
 #include "sim.h"
 
-int data_count;
-BYTE current_cmd;
+#include "lcd.h"
+
 SDL_Surface *framebuffer;
 SDL_Surface *display_surface;
 SDL_Window *display_window;
 SDL_Renderer *display_renderer;
-unsigned long fb_x, fb_y;
-unsigned long fb_window_start_x;
-unsigned long fb_window_end_x;
-unsigned long fb_window_start_y;
-unsigned long fb_window_end_y;
 int initialised = 0;
 
+// Controller state, per thread with the machine API
+MSTATE int data_count;
+MSTATE BYTE current_cmd;
+MSTATE unsigned long fb_x, fb_y;
+MSTATE unsigned long fb_window_start_x;
+MSTATE unsigned long fb_window_end_x;
+MSTATE unsigned long fb_window_start_y;
+MSTATE unsigned long fb_window_end_y;
+MSTATE int wr_count;
+MSTATE BYTE *gram;
+MSTATE BYTE colmod;           // pixel format, 0 before COLMOD is 16 bit
+MSTATE int px_count;          // bytes of a pixel in other formats
+MSTATE BYTE px[2];
+
 void il9341_init()
 {
   if (initialised)
@@ -30,14 +39,15 @@ void il9341_init()
     exit(1);
 	}
 
-  framebuffer = SDL_CreateRGBSurfaceWithFormat(0, 320, 240, 16, SDL_PIXELFORMAT_RGB565);
+  framebuffer = SDL_CreateRGBSurfaceWithFormat(0, lcd->w, lcd->h, 16, SDL_PIXELFORMAT_RGB565);
   if (framebuffer == NULL)
   {
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRGBSurfaceWithFormat fail : %s\n", SDL_GetError());
     exit(1);
   }
+  gram = (BYTE*)framebuffer->pixels;
 
-	if(SDL_CreateWindowAndRenderer(320, 240, SDL_WINDOW_SHOWN, &display_window, &display_renderer))
+	if(SDL_CreateWindowAndRenderer(lcd->w, lcd->h, SDL_WINDOW_SHOWN, &display_window, &display_renderer))
 	{
 		SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Window creation fail : %s\n",SDL_GetError());
 		exit(1);
@@ -84,16 +94,47 @@ void il9341_wr_cmd(BYTE cmd)
     case 0x2c: // memory write
       fb_x = fb_window_start_x;
       fb_y = fb_window_start_y;
+      wr_count = px_count = 0;
       data_count = -1; break;
 
-    default: break;
+    default:
+      if (cmd == lcd->id_cmd)
+      {
+        data_count = 0; // bytes read
+      }
+      break;
   }
 }
 
-void il9341_wr_data(BYTE data)
+// Write a pixel at the write pointer, for the pixel formats other
+// than 16 bit
+void il9341_pixel(WORD colour)
 {
-  static int wr_count = 0;
+  if (fb_x > fb_window_end_x)
+  {
+    fb_x = fb_window_start_x;
+    fb_y++;
+  }
+  if (fb_y > fb_window_end_y)
+  {
+    return;
+  }
+  int index = 2*(fb_y * lcd->w + fb_x);
+  if (SDL_BYTEORDER == SDL_LIL_ENDIAN)
+  {
+    gram[index] = colour & 0xff;
+    gram[index + 1] = colour >> 8;
+  }
+  else
+  {
+    gram[index] = colour >> 8;
+    gram[index + 1] = colour & 0xff;
+  }
+  fb_x++;
+}
 
+void il9341_wr_data(BYTE data)
+{
   switch(current_cmd)
   {
     case 0x2a: // column address set
@@ -128,7 +169,25 @@ void il9341_wr_data(BYTE data)
       data_count--;
       break;
 
+    case 0x3a: // COLMOD pixel format set
+      colmod = data;
+      break;
+
     case 0x2c: // memory write
+      if ((colmod & 7) == 6)
+      {
+        // 18 bit, 6 bits of red, green and blue in the upper bits
+        // of 3 bytes
+        if (px_count < 2)
+        {
+          px[px_count++] = data;
+          break;
+        }
+        px_count = 0;
+        il9341_pixel(((px[0] & 0xf8) << 8) | ((px[1] & 0xfc) << 3) |
+                     (data >> 3));
+        break;
+      }
       {
         if (fb_x > fb_window_end_x)
         {
@@ -139,13 +198,13 @@ void il9341_wr_data(BYTE data)
         {
           return;
         }
-        int index = 2*(fb_y * 320 + fb_x) + wr_count;
+        int index = 2*(fb_y * lcd->w + fb_x) + wr_count;
         // Convert little to big endian if required.
         if (SDL_BYTEORDER == SDL_LIL_ENDIAN)
         {
           index ^= 1;
         }
-        ((unsigned char*)framebuffer->pixels)[index] = data;
+        gram[index] = data;
         wr_count++;
         if (wr_count == 2)
         {
@@ -159,9 +218,15 @@ void il9341_wr_data(BYTE data)
   }
 }
 
+// The ID of the controller after a dummy byte, else nothing to read
 BYTE il9341_rd_data()
 {
-  return 0;
+  if (current_cmd != lcd->id_cmd || data_count > 3)
+  {
+    return 0;
+  }
+  data_count++;
+  return data_count == 1 ? 0 : lcd->id[data_count - 2];
 }
 
 void il9341_update()
@@ -189,3 +254,65 @@ void il9341_set_window(int startx, int endx, int starty, int endy)
   il9341_wr_data(endy >> 8);
   il9341_wr_data(endy & 0xff);
 }
+
+// Fill a rectangle of the frame buffer in one go, bypassing the
+// controller's write window
+void il9341_fill(int startx, int endx, int starty, int endy, WORD colour)
+{
+  SDL_Rect r;
+
+  r.x = startx;
+  r.y = starty;
+  r.w = endx - startx + 1;
+  r.h = endy - starty + 1;
+  SDL_FillRect(framebuffer, &r, colour);
+}
+
+BYTE *il9341_gram(int *size)
+{
+  *size = LCD_GRAM;
+  return gram;
+}
+
+// Save the controller state of this thread, for the machine API
+void il9341_save(struct il9341_state *s)
+{
+  s->data_count = data_count;
+  s->current_cmd = current_cmd;
+  s->x = fb_x;
+  s->y = fb_y;
+  s->start_x = fb_window_start_x;
+  s->end_x = fb_window_end_x;
+  s->start_y = fb_window_start_y;
+  s->end_y = fb_window_end_y;
+  s->wr_count = wr_count;
+  s->gram = gram;
+  s->colmod = colmod;
+  s->px_count = px_count;
+  s->px[0] = px[0];
+  s->px[1] = px[1];
+}
+
+void il9341_restore(struct il9341_state *s)
+{
+  data_count = s->data_count;
+  current_cmd = s->current_cmd;
+  fb_x = s->x;
+  fb_y = s->y;
+  fb_window_start_x = s->start_x;
+  fb_window_end_x = s->end_x;
+  fb_window_start_y = s->start_y;
+  fb_window_end_y = s->end_y;
+  wr_count = s->wr_count;
+  gram = s->gram;
+  colmod = s->colmod;
+  px_count = s->px_count;
+  px[0] = s->px[0];
+  px[1] = s->px[1];
+}
+
+struct lcd_driver lcd_il9341 = {
+  "ili9341", 320, 240, 0xd3, { 0x00, 0x93, 0x41 },
+  il9341_wr_cmd, il9341_wr_data, il9341_rd_data, il9341_update,
+  il9341_save, il9341_restore
+};
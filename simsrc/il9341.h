@@ -1,11 +1,30 @@
 #ifndef __IL9341_H__
 #define __IL9341_H__
 
+struct il9341_state
+{
+  int data_count;
+  BYTE current_cmd;
+  unsigned long x, y;
+  unsigned long start_x, end_x;
+  unsigned long start_y, end_y;
+  int wr_count;
+  BYTE *gram;
+  BYTE colmod;
+  int px_count;
+  BYTE px[2];
+};
+
 void il9341_init();
 void il9341_wr_cmd(BYTE cmd);
 void il9341_wr_data(BYTE data);
+void il9341_pixel(WORD colour);
 BYTE il9341_rd_data();
 void il9341_update();
 void il9341_set_window(int startx, int endx, int starty, int endy);
+void il9341_fill(int startx, int endx, int starty, int endy, WORD colour);
+BYTE *il9341_gram(int *size);
+void il9341_save(struct il9341_state *s);
+void il9341_restore(struct il9341_state *s);
 
 #endif
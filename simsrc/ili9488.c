@@ -0,0 +1,36 @@
+
+#include "sim.h"
+
+#include "lcd.h"
+
+// ILI9488 driver. Its command set is the one of the ILI9341 for the
+// window, memory write and pixel formats, with 3 bit colour added, on
+// a panel of 480x320. The ROM draws into the upper left 320x240.
+
+extern MSTATE BYTE current_cmd, colmod;
+
+// One bit of red, green and blue to RGB565
+static WORD rgb111(BYTE bits)
+{
+  return ((bits & 4) ? 0xf800 : 0) | ((bits & 2) ? 0x07e0 : 0) |
+         ((bits & 1) ? 0x001f : 0);
+}
+
+static void ili9488_wr_data(BYTE data)
+{
+  if (current_cmd != 0x2c || (colmod & 7) != 1)
+  {
+    il9341_wr_data(data);
+    return;
+  }
+
+  // 3 bit, two pixels in bits 5:3 and 2:0 of a byte
+  il9341_pixel(rgb111(data >> 3));
+  il9341_pixel(rgb111(data));
+}
+
+struct lcd_driver lcd_ili9488 = {
+  "ili9488", 480, 320, 0xd3, { 0x00, 0x94, 0x88 },
+  il9341_wr_cmd, ili9488_wr_data, il9341_rd_data, il9341_update,
+  il9341_save, il9341_restore
+};
@@ -0,0 +1,281 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module measures interrupt latency and interrupts disabled
+ * regions.
+ *
+ * The latency of a maskable interrupt is the number of T-states from
+ * int_int being raised up to the CPU accepting it, which waits for
+ * IFF and the protection of the instruction after EI. The jitter is
+ * the deviation of the time between two accepted interrupts.
+ *
+ * A DI region starts when IFF is cleared by DI or by accepting an
+ * interrupt, and ends with the EI enabling them again. Regions are
+ * charged to the routine they start in, interrupts to the routine
+ * running when they were raised.
+ *
+ * On exit histograms, the longest DI regions with their address
+ * range and the worst routines are written into the file given
+ * with option -L.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "intlat.h"
+
+#define LAT_ROUTINES	40		/* no. of routines to report */
+
+/* read memory without going through the instrumented memrdr() */
+#define mem_at(a)	(((a) < MEMORY_SIZE) ? memory[a] : 0xff)
+
+struct hist {
+	unsigned long n;		/* samples */
+	unsigned long long sum;		/* T-states of all samples */
+	double sq;			/* sum of the squares */
+	unsigned long long min, max;
+	unsigned long bucket[LAT_BUCKETS];	/* samples < 2^(i+1) T */
+};
+
+struct region {
+	WORD start, end;		/* DI and EI */
+	unsigned long long t;		/* T-states disabled */
+};
+
+static unsigned long long tclock;	/* T-states executed */
+static struct hist lat;			/* interrupt latency */
+static struct hist period;		/* time between interrupts */
+static struct hist di;			/* length of DI regions */
+
+static int pending;			/* int_int seen raised */
+static unsigned long long t_raised;	/* clock when int_int was raised */
+static WORD pc_raised;			/* PC when int_int was raised */
+static unsigned long long t_accept;	/* clock of last interrupt */
+
+static int disabled;			/* in a DI region */
+static unsigned long long t_di;		/* clock at start of DI region */
+static WORD pc_di;			/* start of DI region */
+
+static struct region worst[LAT_WORST];	/* longest DI regions */
+static int nworst;
+
+static unsigned long di_cnt[65536];	/* DI regions per routine */
+static unsigned long long di_sum[65536];	/* T-states disabled */
+static unsigned long long di_max[65536];	/* longest region */
+static unsigned long lat_cnt[65536];	/* interrupts raised in routine */
+static unsigned long long lat_max[65536];	/* worst latency */
+
+/*
+ *	Map an address to the routine it belongs to
+ */
+static WORD intlat_key(WORD addr)
+{
+	int i = sym_routine(addr);
+
+	return((i < 0) ? addr : sym_addr(i));
+}
+
+static void hist_add(struct hist *h, unsigned long long t)
+{
+	register int i;
+
+	if (h->n == 0 || t < h->min)
+		h->min = t;
+	if (t > h->max)
+		h->max = t;
+	h->n++;
+	h->sum += t;
+	h->sq += (double) t * t;
+	for (i = 0; i < LAT_BUCKETS - 1 && t >= (2ULL << i); i++)
+		;
+	h->bucket[i]++;
+}
+
+void intlat_init(void)
+{
+	disabled = (IFF != 3);
+	pc_di = PC;
+}
+
+/*
+ *	Maskable interrupt accepted, PC is the handler and the
+ *	return address is on the stack
+ */
+void intlat_int(void)
+{
+	unsigned long long t = 0;
+	WORD key;
+
+	if (pending)
+		t = tclock - t_raised;
+	else			/* raised and accepted at once */
+		pc_raised = mem_at(SP) + (mem_at((WORD) (SP + 1)) << 8);
+	key = intlat_key(pc_raised);
+
+	hist_add(&lat, t);
+	lat_cnt[key]++;
+	if (t > lat_max[key])
+		lat_max[key] = t;
+	if (t_accept)
+		hist_add(&period, tclock - t_accept);
+	t_accept = tclock;
+	pending = 0;
+
+	/* handler runs with interrupts disabled */
+	if (!disabled) {
+		disabled = 1;
+		t_di = tclock;
+		pc_di = PC;
+	}
+}
+
+/*
+ *	Keep the region if it is one of the longest
+ */
+static void region_add(WORD start, WORD end, unsigned long long t)
+{
+	register int i;
+
+	if (nworst == LAT_WORST && t <= worst[LAT_WORST - 1].t)
+		return;
+	if (nworst < LAT_WORST)
+		nworst++;
+	for (i = nworst - 1; i > 0 && worst[i - 1].t < t; i--)
+		worst[i] = worst[i - 1];
+	worst[i].start = start;
+	worst[i].end = end;
+	worst[i].t = t;
+}
+
+/*
+ *	Called after every instruction with PC from before it
+ */
+void intlat_step(WORD pc, int states)
+{
+	unsigned long long t;
+	WORD key;
+
+	tclock += states;
+
+	if (int_int && !pending) {	/* raised by timer or T-states */
+		pending = 1;
+		t_raised = tclock;
+		pc_raised = PC;
+	} else if (!int_int)
+		pending = 0;
+
+	if (IFF != 3 && !disabled) {	/* DI, RETN, LD A,I ... */
+		disabled = 1;
+		t_di = tclock - states;
+		pc_di = pc;
+	} else if (IFF == 3 && disabled) {	/* EI */
+		disabled = 0;
+		t = tclock - t_di;
+		key = intlat_key(pc_di);
+		hist_add(&di, t);
+		di_cnt[key]++;
+		di_sum[key] += t;
+		if (t > di_max[key])
+			di_max[key] = t;
+		region_add(pc_di, pc, t);
+	}
+}
+
+static void hist_print(FILE *fp, char *title, struct hist *h)
+{
+	register int i;
+	double avg, sd;
+
+	fprintf(fp, "%s, %lu samples\n", title, h->n);
+	if (h->n == 0) {
+		fputc('\n', fp);
+		return;
+	}
+	avg = (double) h->sum / h->n;
+	sd = sqrt(fmax(h->sq / h->n - avg * avg, 0.0));
+	fprintf(fp, "min %llu, avg %.1f, max %llu, std. deviation %.1f T\n\n",
+		h->min, avg, h->max, sd);
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		if (h->bucket[i] == 0)
+			continue;
+		fprintf(fp, "  < %8llu T %10lu %6.2f%%\n", 2ULL << i,
+			h->bucket[i], 100.0 * h->bucket[i] / h->n);
+	}
+	fputc('\n', fp);
+}
+
+static int di_cmp(const void *a, const void *b)
+{
+	WORD x = *(const WORD *) a, y = *(const WORD *) b;
+
+	if (di_max[x] != di_max[y])
+		return((di_max[x] < di_max[y]) ? 1 : -1);
+	return(x - y);
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+	WORD x = *(const WORD *) a, y = *(const WORD *) b;
+
+	if (lat_max[x] != lat_max[y])
+		return((lat_max[x] < lat_max[y]) ? 1 : -1);
+	return(x - y);
+}
+
+/*
+ *	Write the report into lfn
+ */
+void intlat_exit(void)
+{
+	static WORD keys[65536];
+	FILE *fp;
+	char buf[SYM_NAMELEN + 8], buf2[SYM_NAMELEN + 8];
+	register int i;
+	int n;
+
+	if ((fp = fopen(lfn, "w")) == NULL) {
+		printf("can't open file %s\n", lfn);
+		return;
+	}
+	fprintf(fp, "Interrupts, %llu T-states\n\n", tclock);
+	hist_print(fp, "Interrupt latency", &lat);
+	hist_print(fp, "Time between interrupts (jitter)", &period);
+	hist_print(fp, "DI regions", &di);
+
+	fprintf(fp, "Longest DI regions\n\n");
+	fprintf(fp, "        T  from                      to\n");
+	for (i = 0; i < nworst; i++)
+		fprintf(fp, "%9llu  %04X %-20s %04X %s\n", worst[i].t,
+			worst[i].start, sym_label(worst[i].start, buf),
+			worst[i].end, sym_label(worst[i].end, buf2));
+
+	for (i = n = 0; i < 65536; i++)
+		if (di_cnt[i])
+			keys[n++] = i;
+	qsort(keys, n, sizeof(WORD), di_cmp);
+	fprintf(fp, "\nDI regions per routine\n\n");
+	fprintf(fp, "  regions      total T        max T  routine\n");
+	for (i = 0; i < n && i < LAT_ROUTINES; i++)
+		fprintf(fp, "%9lu %12llu %12llu  %s\n", di_cnt[keys[i]],
+			di_sum[keys[i]], di_max[keys[i]],
+			sym_label(keys[i], buf));
+
+	for (i = n = 0; i < 65536; i++)
+		if (lat_cnt[i])
+			keys[n++] = i;
+	qsort(keys, n, sizeof(WORD), lat_cmp);
+	fprintf(fp, "\nInterrupt latency per routine interrupted\n\n");
+	fprintf(fp, "    ints   max latency T  routine\n");
+	for (i = 0; i < n && i < LAT_ROUTINES; i++)
+		fprintf(fp, "%9lu %14llu  %s\n", lat_cnt[keys[i]],
+			lat_max[keys[i]], sym_label(keys[i], buf));
+	fclose(fp);
+}
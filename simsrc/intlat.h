@@ -0,0 +1,22 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module measures interrupt latency and interrupts disabled
+ * regions.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _INTLAT_H_
+#define _INTLAT_H_
+
+#define LAT_BUCKETS	24		/* log2 buckets of the histograms */
+#define LAT_WORST	20		/* no. of longest DI regions kept */
+
+extern void intlat_init(void);
+extern void intlat_exit(void);
+extern void intlat_step(WORD, int);
+extern void intlat_int(void);
+
+#endif
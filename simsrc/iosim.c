@@ -85,13 +85,36 @@
 #include "sim.h"
 #include "simglb.h"
 #include "memory.h"
-#include "il9341.h"
+#include "lcd.h"
 #include "lcd_emu.h"
+#include "kbd.h"
+#ifdef WANT_PROF
+#include "prof.h"
+#endif
+#ifdef WANT_STATS
+#include "stats.h"
+#endif
+#ifdef WANT_BUDGET
+#include "budget.h"
+#endif
+#ifdef WANT_TAPE
+#include "tape.h"
+#endif
+#ifdef WANT_BEEP
+#include "beep.h"
+#endif
+#ifdef WANT_RELOAD
+#include "reload.h"
+#endif
 
 #define BUFSIZE 256		/* max line length of command buffer */
 #define MAX_BUSY_COUNT 10	/* max counter to detect I/O busy waiting
 				   on the console status port */
 
+#ifdef WANT_MACHINE
+MSTATE BYTE *key_rows;		/* key matrix of a machine, else kbd_rows */
+#endif
+
 extern int boot(void);
 extern void reset_cpu(void);
 
@@ -100,8 +123,9 @@ extern void reset_cpu(void);
  */
 static BYTE io_trap_in(void);
 static void io_trap_out(BYTE);
-static BYTE port_fe_in(void), il9341_data_in(void);
-static void port_fe_out(BYTE), il9341_cmd_out(BYTE), il9341_data_out(BYTE);
+static BYTE port_fe_in(void), lcd_data_in(void);
+static BYTE keyboard_in(void);
+static void port_fe_out(BYTE), lcd_cmd_out(BYTE), lcd_data_out(BYTE);
 
 /*
  *	Forward declaration of support functions
@@ -118,7 +142,7 @@ static BYTE (*port_in[256]) (void) = {
 	io_trap_in,		/* port 2 */
 	io_trap_in,		/* port 3 */
 	io_trap_in,		/* port 4 */
-	il9341_data_in,	/* port 5 */
+	lcd_data_in,	/* port 5 */
 	io_trap_in,		/* port 6 */
 	io_trap_in,		/* port 7 */
 	io_trap_in,		/* port 8 */
@@ -377,11 +401,11 @@ static BYTE (*port_in[256]) (void) = {
  */
 static void (*port_out[256]) (BYTE) = {
 	io_trap_out,		/* port 0 */
-	il9341_cmd_out, 	/* port 1 */
+	lcd_cmd_out, 	/* port 1 */
 	io_trap_out,		/* port 2 */
 	io_trap_out,		/* port 3 */
 	io_trap_out,		/* port 4 */
-	il9341_data_out,	/* port 5 */
+	lcd_data_out,	/* port 5 */
 	io_trap_out,		/* port 6 */
 	io_trap_out,		/* port 7 */
 	io_trap_out,		/* port 8 */
@@ -643,6 +667,11 @@ void init_io(void)
 	static struct sigaction newact;
 
     il9341_init();
+#ifdef WANT_REPLAY
+	kbd_init(!K_flag);	/* the keys come from the replay */
+#else
+	kbd_init(1);
+#endif
 
     // Set up the 50ms timer
 	newact.sa_handler = int_timer;
@@ -669,7 +698,7 @@ void exit_io(void)
  */
 void reset_system(void)
 {
-	extern BYTE *wrk_ram;
+	extern MSTATE BYTE *wrk_ram;
 
 	/* reset CPU */
 	reset_cpu();
@@ -689,6 +718,20 @@ BYTE io_in(BYTE addrl, BYTE addrh)
 	io_port_h = addrh;
 
 	io_port = addrl;
+	if (lcd_wait && port_in[addrl] == lcd_data_in)
+		io_wait += lcd_wait;	/* wait states of the LCD bus */
+#ifdef WANT_STATS
+	if (T_flag) {
+		STAT_ADD(stats.in[addrl], 1);
+		if (STAT_SAMPLE()) {
+			unsigned long long t0 = stats_ns();
+
+			io_data = (*port_in[addrl]) ();
+			stats_io(port_in[addrl] == lcd_data_in, t0);
+			return(io_data);
+		}
+	}
+#endif
 	io_data = (*port_in[addrl]) ();
 	//printf("input %02x from port %02x\r\n", io_data, io_port);
 	return(io_data);
@@ -708,6 +751,42 @@ void io_out(BYTE addrl, BYTE addrh, BYTE data)
 
 	busy_loop_cnt[0] = 0;
 
+	if (lcd_wait && (port_out[addrl] == lcd_cmd_out ||
+			 port_out[addrl] == lcd_data_out))
+		io_wait += lcd_wait;	/* wait states of the LCD bus */
+#ifdef WANT_BUDGET
+	if (G_flag)		/* OUT's as unit of budgets */
+		budget_outs[addrl]++;
+#endif
+#ifdef WANT_STATS
+	if (T_flag) {
+		STAT_ADD(stats.out[addrl], 1);
+		if (STAT_SAMPLE()) {
+			unsigned long long t0 = stats_ns();
+
+			(*port_out[addrl]) (data);
+			stats_io(port_out[addrl] == lcd_cmd_out ||
+				 port_out[addrl] == lcd_data_out, t0);
+#ifdef WANT_PROF
+			if (p_flag)
+				prof_io_acc += stats_ns() - t0;
+#endif
+			return;
+		}
+	}
+#endif
+#ifdef WANT_PROF
+	if (p_flag) {		/* charge host time to the profiler */
+		struct timespec ts1, ts2;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+		(*port_out[addrl]) (data);
+		clock_gettime(CLOCK_MONOTONIC, &ts2);
+		prof_io_acc += (ts2.tv_sec - ts1.tv_sec) * 1000000000LL
+			       + ts2.tv_nsec - ts1.tv_nsec;
+		return;
+	}
+#endif
 	(*port_out[addrl]) (data);
 	//printf("output %02x to port %02x\r\n", io_data, io_port)";
 }
@@ -738,197 +817,35 @@ static void io_trap_out(BYTE data)
 }
 
 /*
- *	I/O handler for keyboard
+ *	I/O handler for port FE, keyboard and EAR
  */
 static BYTE port_fe_in(void)
 {
-	static BYTE keys[2];
-	static int keycount;
-	static BYTE ports[2];
-	static int symbol_shift = 0;
-
-	// Key tables
-	static BYTE keytable[] = {
-		0xfe, // 0
-		0xfe, // 1
-		0xfd, // 2
-		0xfb, // 3
-		0xf7, // 4
-		0xef, // 5
-		0xef, // 6
-		0xf7, // 7
-		0xfb, // 8
-		0xfd, // 9
-		0xfe, // a
-		0xef, // b
-		0xf7, // c
-		0xfb, // d
-		0xfb, // e
-		0xf7, // f
-		0xef, // g
-		0xef, // h
-		0xfb, // i
-		0xf7, // j
-		0xfb, // k 
-		0xfd, // l
-		0xfb, // m
-		0xf7, // n
-		0xfd, // o
-		0xfe, // p
-		0xfe, // q
-		0xf7, // r
-		0xfd, // s
-		0xef, // t
-		0xf7, // u
-		0xef, // v
-		0xfd, // w
-		0xfb, // x
-		0xef, // y
-		0xfd, // z 
-	};
-
-	if ((keycount == 0) || symbol_shift)
-	{
-		struct timeval tv;
-		fd_set fds;
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(STDIN_FILENO, &fds);
-		select(STDIN_FILENO+1, &fds, NULL, NULL, &tv);
-		if (FD_ISSET(STDIN_FILENO, &fds))
-		{
-			char c = fgetc(stdin);
-
-			// numbers
-			if (c >= '0' && c <= '9')
-			{
-				if (c >= '1' && c <= '5')
-				{
-					ports[keycount] = 0xf7;
-				}
-				else
-				{
-					ports[keycount] = 0xef;
-				}
-				keys[keycount] = keytable[c-'0'];
-				keycount++;
-			}
-			// letters
-			else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
-			{
-				char cc = c;
-
-				if (c < 'a')
-				{
-					cc = 'a' + (c-'A');
-				}
-				switch(cc)
-				{
-					case 'q': case 'w': case 'e': case 'r': case 't': ports[keycount] = 0xfb; break;
-					case 'y': case 'u': case 'i': case 'o': case 'p': ports[keycount] = 0xdf; break;
-					case 'a': case 's': case 'd': case 'f': case 'g': ports[keycount] = 0xfd; break;
-					case 'h': case 'j': case 'k': case 'l':           ports[keycount] = 0xbf; break;
-					case 'z': case 'x': case 'c': case 'v':           ports[keycount] = 0xfe; break;
-					case 'b': case 'n': case 'm':                     ports[keycount] = 0x7f; break;
-					default: break;
-				}
-				keys[keycount] = keytable[10 + cc - 'a'];
-				keycount++;
-				if (c < 'a')
-				{
-					if (!symbol_shift)
-					{
-						// caps shift
-						keys[keycount] = 0xfe;
-						ports[keycount] = 0xfe;
-						keycount++;
-					}
-				}
-			}
-			// tab (used as BREAK)
-			else if (c == '\t')
-			{
-				keys[1] = 0xfe;
-				ports[1] = 0x7f;
-				keys[0] = 0xfe;
-				ports[0] = 0xfe;
-				keycount = 2;
-			}
-			// enter
-			else if (c == '\r')
-			{
-				keys[0] = 0xfe;
-				ports[0] = 0xbf;
-				keycount++;
-			}
-			// space
-			else if (c == ' ')
-			{
-				keys[0] = 0xfe;
-				ports[0] = 0x7f;
-				keycount++;
-			}
-			// sym shift
-			else if (c == '`')
-			{
-				keys[0] = 0xfd;
-				ports[0] = 0x7f;
-				keycount = 1;
-				symbol_shift = 1;
-			}
-			// caps+sym shift
-			else if (c == '~')
-			{
-				keys[0] = 0xfd;
-				ports[0] = 0x7f;
-				keys[1] = 0xfe;
-				ports[1] = 0xfe;
-				keycount = 2;
-			}
-			// shifted numbers
-			else
-			{
-				keys[1] = 0xfe;
-				ports[1] = 0xfe;
-				keycount = 2;
-				switch(c)
-				{
-					case '!' : keys[0] = 0xfe; ports[0] = 0xf7; break;
-					case '@' : keys[0] = 0xfd; ports[0] = 0xf7; break;
-					case '#' : keys[0] = 0xfb; ports[0] = 0xf7; break;
-					case '$' : keys[0] = 0xf7; ports[0] = 0xf7; break;
-					case '%' : keys[0] = 0xef; ports[0] = 0xf7; break;
-					case '^' : keys[0] = 0xef; ports[0] = 0xef; break;
-					case '&' : keys[0] = 0xf7; ports[0] = 0xef; break;
-					case '*' : keys[0] = 0xfb; ports[0] = 0xef; break;
-					case '(' : keys[0] = 0xfd; ports[0] = 0xef; break;
-					case ')' : keys[0] = 0xfe; ports[0] = 0xef; break;
-					default: keycount = 0; break;
-				}
-			}
-		}
-	}
+	BYTE data = keyboard_in();
 
-	if (symbol_shift && (keycount < 2))
-	{
-		return 0xff;
-	}
-	else if (keycount && (io_port_h == ports[keycount-1]))
-	{
-		if (symbol_shift && keycount == 2 && ports[1] == 0x7f)
-		{
-			symbol_shift = 0;
-			keycount = 0;
-			return keys[1] & keys[0];
-		}
-		symbol_shift = 0;
-		return keys[--keycount];
-	}
-	else
-	{
-		return 0xff;
-	}
+#ifdef WANT_TAPE
+	if (tape_run && !tape_ear)	/* EAR bit from the tape */
+		data &= ~0x40;
+#endif
+	return(data);
+}
+
+/*
+ *	Keyboard rows selected by the high byte of the port address
+ */
+static BYTE keyboard_in(void)
+{
+	BYTE *rows = kbd_rows, data = 0xff;
+	register int i;
+
+#ifdef WANT_MACHINE
+	if (key_rows != NULL)	/* keys set with the machine API */
+		rows = key_rows;
+#endif
+	for (i = 0; i < 8; i++)
+		if (!(io_port_h & (1 << i)))
+			data &= rows[i];
+	return(data);
 }
 
 /*
@@ -936,32 +853,34 @@ static BYTE port_fe_in(void)
  */
 static void port_fe_out(BYTE data)
 {
-	// silence the warning
-	data = data;
-	//fb_set_border(data & 0x7);
+	fb_set_border(data & 0x7);
+#ifdef WANT_BEEP
+	if (beep_on)		/* speaker bit */
+		beep_out(data);
+#endif
 }
 /*
  *	I/O handler for read display RAM
  */
-static BYTE il9341_data_in(void)
+static BYTE lcd_data_in(void)
 {
-	return((BYTE) 0);
+	return(lcd_read());
 }
 
 /*
  *	I/O handler for write display command
  */
-static void il9341_cmd_out(BYTE data)
+static void lcd_cmd_out(BYTE data)
 {
-	il9341_wr_cmd(data);
+	lcd_cmd(data);
 }
 
 /*
  *	I/O handler for write display RAM
  */
-static void il9341_data_out(BYTE data)
+static void lcd_data_out(BYTE data)
 {
-	il9341_wr_data(data);
+	lcd_data(data);
 }
 
 /*
@@ -971,8 +890,27 @@ static void int_timer(int sig)
 {
 	sig = sig;	/* to avoid compiler warning */
 
-	int_int = 1;
-	int_data = 0xff;	/* RST 38H for IM 0, 0FFH for IM 2 */
- 	il9341_update();
+	if (int_period == 0) {	/* else counted in T-states by the CPU */
+		int_int = 1;
+		int_data = 0xff; /* RST 38H for IM 0, 0FFH for IM 2 */
+	}
+#ifdef WANT_RELOAD
+	if (reload_on)		/* ROM file changed? */
+		reload_poll();
+#endif
+#ifdef WANT_STATS
+	if (T_flag) {
+		unsigned long long t0 = stats_ns();
+
+		/* counters of its own, this interrupts the CPU thread */
+		fb_border();
+		lcd_present();
+		STAT_ADD(stats.ns_frame, stats_ns() - t0);
+		STAT_ADD(stats.frames, 1);
+		return;
+	}
+#endif
+	fb_border();
+ 	lcd_present();
 }
 
@@ -0,0 +1,288 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements the keyboard matrix.
+ *
+ * The 40 keys are kept as the 8 half-rows port FE reads, a half-row
+ * is selected by a 0 bit in the high byte of the port address, a key
+ * held down is a 0 bit. Reading the port is an AND over the selected
+ * half-rows, see iosim.c.
+ *
+ * Keys come from the SDL window and from the terminal. The SDL events
+ * are taken once per frame by the CPU thread, which owns the matrix,
+ * so that keys held together and released are seen as on the real
+ * keyboard. The timer signal, which presents the screen with SDL in
+ * the same thread, is blocked while they are taken. The terminal is
+ * read by a thread of its own, which puts the typed characters as the
+ * keys to press for them into a lock-free queue of one writer and one
+ * reader. At every frame the next one is taken and held down for
+ * KBD_HOLD frames, then released for KBD_GAP frames, or KBD_REPEAT if
+ * the next one is the same key, so that the keyboard scan of the ROM
+ * sees every key once.
+ *
+ * While a recording is replayed the events are still taken, so that
+ * the window stays responsive and can be closed, but the keys are
+ * thrown away and the terminal isn't read.
+ *
+ * The characters typed are the ones of the former keyboard emulation:
+ * upper case letters with CAPS SHIFT, !@#$%^&*() as CAPS SHIFT with
+ * the digit, ` holds SYMBOL SHIFT with the next key, ~ is CAPS and
+ * SYMBOL SHIFT, TAB is BREAK and DEL is DELETE.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include "SDL.h"
+#include "sim.h"
+#include "simglb.h"
+#include "kbd.h"
+
+#define K_CAPS	0			/* key numbers, half-row * 5 + bit */
+#define K_SPACE	35
+#define K_SYM	36
+#define K_NONE	0xff
+
+struct kev {				/* keys of a typed character */
+	BYTE key[3];
+};
+
+BYTE kbd_rows[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+int kbd_on;				/* matrix is updated every frame */
+static int keys;			/* keys are taken, not replayed */
+
+static const char *layout[8] = {	/* 1 is CAPS, 2 SYMBOL SHIFT */
+	"\001zxcv", "asdfg", "qwert", "12345",
+	"09876", "poiuy", "\rlkjh", " \002mnb"
+};
+static BYTE keymap[128];		/* character to key number */
+static BYTE down[40];			/* times a key is held down */
+
+static struct kev queue[KBD_QUEUE];
+static unsigned int head, tail;		/* written by reader, by CPU */
+static pthread_t reader;
+
+static struct kev typed;		/* key typed held down */
+static int hold;			/* frames left of it */
+
+static void key_press(int k, int d)
+{
+	if (k == K_NONE || (d < 0 && down[k] == 0))
+		return;
+	down[k] += d;
+	if (down[k])
+		kbd_rows[k / 5] &= ~(1 << (k % 5));
+	else
+		kbd_rows[k / 5] |= 1 << (k % 5);
+}
+
+static void kev_press(struct kev *e, int d)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		key_press(e->key[i], d);
+}
+
+/*
+ *	Keys of a character typed on the terminal, 0 if none
+ */
+static int tty_keys(int c, struct kev *e)
+{
+	static const char shifted[] = ")!@#$%^&*(";
+	const char *p;
+
+	memset(e->key, K_NONE, 3);
+	if (c == '\001' || c == '\002')	/* CAPS, SYMBOL SHIFT in keymap */
+		return(0);
+	if (c == '\n')
+		c = '\r';
+	if (c >= 'A' && c <= 'Z') {
+		e->key[1] = K_CAPS;
+		c += 'a' - 'A';
+	} else if (c != '\0' && (p = strchr(shifted, c)) != NULL) {
+		e->key[1] = K_CAPS;
+		c = '0' + (p - shifted);
+	} else if (c == '\t') {		/* BREAK */
+		e->key[1] = K_CAPS;
+		c = ' ';
+	} else if (c == 0x7f || c == '\b') {	/* DELETE */
+		e->key[1] = K_CAPS;
+		c = '0';
+	} else if (c == '~') {		/* extended mode */
+		e->key[1] = K_CAPS;
+		c = '\002';
+	}
+	if (c < 0 || c > 127 || keymap[c] == K_NONE)
+		return(0);
+	e->key[0] = keymap[c];
+	return(1);
+}
+
+/*
+ *	Thread reading the terminal into the queue
+ */
+static void *tty_reader(void *arg)
+{
+	struct timespec ts = { 0, 10000000L };
+	struct kev e;
+	unsigned int h;
+	int sym = 0;
+	char c;
+
+	arg = arg;	/* to avoid compiler warning */
+
+	while (read(STDIN_FILENO, &c, 1) == 1) {
+		if (c == '`') {		/* SYMBOL SHIFT with the next key */
+			sym = 1;
+			continue;
+		}
+		if (!tty_keys(c, &e))
+			continue;
+		if (sym)
+			e.key[2] = K_SYM;
+		sym = 0;
+		h = head;
+		while (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == KBD_QUEUE)
+			nanosleep(&ts, NULL);	/* the CPU is behind */
+		queue[h % KBD_QUEUE] = e;
+		__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+	}
+	return(NULL);
+}
+
+/*
+ *	Keys of an SDL key, 0 if none
+ */
+static int sdl_keys(int sym, BYTE *k)
+{
+	static const char arrows[] = "5678";	/* left down up right */
+
+	k[1] = K_NONE;
+	if (sym >= 0 && sym < 128 && sym != '\001' && sym != '\002' &&
+	    keymap[sym] != K_NONE) {
+		k[0] = keymap[sym];
+		return(1);
+	}
+	switch (sym) {
+	case SDLK_LSHIFT:
+	case SDLK_RSHIFT:
+		k[0] = K_CAPS;
+		return(1);
+	case SDLK_LCTRL:
+	case SDLK_RCTRL:
+		k[0] = K_SYM;
+		return(1);
+	case SDLK_BACKSPACE:
+		k[0] = keymap['0'];
+		break;
+	case SDLK_ESCAPE:
+		k[0] = K_SPACE;
+		break;
+	case SDLK_LEFT:
+		k[0] = keymap[(int) arrows[0]];
+		break;
+	case SDLK_DOWN:
+		k[0] = keymap[(int) arrows[1]];
+		break;
+	case SDLK_UP:
+		k[0] = keymap[(int) arrows[2]];
+		break;
+	case SDLK_RIGHT:
+		k[0] = keymap[(int) arrows[3]];
+		break;
+	default:
+		return(0);
+	}
+	k[1] = K_CAPS;			/* the keys with CAPS SHIFT */
+	return(2);
+}
+
+/*
+ *	Called by the CPU for every interrupt taken
+ */
+void kbd_frame(void)
+{
+	static int last = K_NONE, since = KBD_REPEAT;
+	SDL_Event ev;
+	struct kev *e;
+	BYTE k[2];
+	unsigned int t;
+	int n;
+	sigset_t alrm, old;
+
+	/* int_timer() must not enter SDL while it is polled */
+	sigemptyset(&alrm);
+	sigaddset(&alrm, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &alrm, &old);
+	while (SDL_PollEvent(&ev)) {
+		switch (ev.type) {
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			if (!keys || ev.key.repeat ||
+			    (n = sdl_keys(ev.key.keysym.sym, k)) == 0)
+				break;
+			key_press(k[0], ev.type == SDL_KEYDOWN ? 1 : -1);
+			if (n == 2)
+				key_press(k[1], ev.type == SDL_KEYDOWN ? 1 : -1);
+			break;
+		case SDL_QUIT:
+			cpu_error = POWEROFF;
+			cpu_state = STOPPED;
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (!keys)
+		return;
+
+	if (hold) {			/* key typed on the terminal */
+		if (--hold == 0) {
+			kev_press(&typed, -1);
+			last = typed.key[0];
+			since = 0;
+		}
+		return;
+	}
+	if (since < KBD_REPEAT)
+		since++;
+	t = tail;
+	if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+		return;
+	e = &queue[t % KBD_QUEUE];
+	if (since < KBD_GAP || (e->key[0] == last && since < KBD_REPEAT))
+		return;
+	typed = *e;
+	__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+	kev_press(&typed, 1);
+	hold = KBD_HOLD;
+}
+
+/*
+ *	Start the keyboard, with k 0 only the SDL events are taken
+ */
+void kbd_init(int k)
+{
+	sigset_t all, old;
+	int r, b;
+
+	kbd_on = 1;
+	if ((keys = k) == 0)
+		return;
+	memset(keymap, K_NONE, sizeof(keymap));
+	for (r = 0; r < 8; r++)
+		for (b = 0; b < 5; b++)
+			keymap[(int) layout[r][b]] = r * 5 + b;
+
+	sigfillset(&all);		/* the timer interrupts the CPU only */
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&reader, NULL, tty_reader, NULL) == 0)
+		pthread_detach(reader);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
@@ -0,0 +1,24 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements the keyboard matrix.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _KBD_H_
+#define _KBD_H_
+
+#define KBD_QUEUE	256		/* typed keys not taken yet */
+#define KBD_HOLD	2		/* frames a typed key is held down */
+#define KBD_GAP		1		/* frames between typed keys */
+#define KBD_REPEAT	6		/* frames between the same key typed */
+
+extern BYTE kbd_rows[8];
+extern int kbd_on;
+
+extern void kbd_init(int);
+extern void kbd_frame(void);
+
+#endif
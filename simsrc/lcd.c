@@ -0,0 +1,139 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module is the interface to the LCD controller drivers.
+ *
+ * The I/O ports of the LCD write commands and data and read data
+ * through the driver selected with option -D, the timer presents its
+ * frame buffer. The drivers are the ILI9341 of the board, the ST7789
+ * and the ILI9488, all of them with the window, memory write and pixel
+ * formats of MIPI DCS, so that the same ROM runs on them. They share
+ * the controller state of il9341.c.
+ *
+ * The commands, parameter bytes, bytes written into the GRAM and bytes
+ * read are counted for every frame of the CPU. The counts are kept in
+ * a struct lcd_counts per machine, like memory the thread works on the
+ * one lcd_counts points to, which the machine API switches with the
+ * machine. With option -D the averages and maximums per frame of the
+ * machine of the session are printed at the end, so that the panels
+ * can be compared with the same workload.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "sim.h"
+#include "simglb.h"
+#include "lcd.h"
+
+extern struct lcd_driver lcd_il9341, lcd_st7789, lcd_ili9488;
+
+static struct lcd_driver *drivers[] = {
+	&lcd_il9341, &lcd_st7789, &lcd_ili9488, NULL
+};
+
+struct lcd_driver *lcd = &lcd_il9341;	/* driver used */
+
+static struct lcd_counts session;	/* counts of the session */
+MSTATE struct lcd_counts *lcd_counts = &session; /* machines switch it */
+
+/*
+ *	Select driver name, 0 if there is one
+ */
+int lcd_select(const char *name)
+{
+	register int i;
+
+	for (i = 0; drivers[i] != NULL; i++)
+		if (strcasecmp(name, drivers[i]->name) == 0) {
+			lcd = drivers[i];
+			return(0);
+		}
+	return(1);
+}
+
+void lcd_list(void)
+{
+	register int i;
+
+	for (i = 0; drivers[i] != NULL; i++)
+		printf("\t     %s %dx%d\n", drivers[i]->name, drivers[i]->w,
+		       drivers[i]->h);
+}
+
+void lcd_cmd(BYTE c)
+{
+	lcd_counts->now.cmds++;
+	lcd_counts->cmd = c;
+	(*lcd->wr_cmd)(c);
+}
+
+void lcd_data(BYTE d)
+{
+	if (lcd_counts->cmd == LCD_RAMWR)
+		lcd_counts->now.pixels++;
+	else
+		lcd_counts->now.params++;
+	(*lcd->wr_data)(d);
+}
+
+BYTE lcd_read(void)
+{
+	lcd_counts->now.reads++;
+	return((*lcd->rd_data)());
+}
+
+void lcd_present(void)
+{
+	(*lcd->present)();
+}
+
+static void count(unsigned long long *t, unsigned long long *p,
+		  unsigned long long n)
+{
+	*t += n;
+	if (n > *p)
+		*p = n;
+}
+
+/*
+ *	Called by the CPU for every interrupt taken
+ */
+void lcd_frame(void)
+{
+	register struct lcd_counts *c = lcd_counts;
+
+	c->now.bus = c->now.cmds + c->now.params + c->now.pixels +
+		     c->now.reads;
+	count(&c->total.cmds, &c->peak.cmds, c->now.cmds);
+	count(&c->total.params, &c->peak.params, c->now.params);
+	count(&c->total.pixels, &c->peak.pixels, c->now.pixels);
+	count(&c->total.reads, &c->peak.reads, c->now.reads);
+	count(&c->total.bus, &c->peak.bus, c->now.bus);
+	memset(&c->now, 0, sizeof(c->now));
+	c->frames++;
+}
+
+static void lcd_print(const char *what, unsigned long long t,
+		      unsigned long long p)
+{
+	printf("lcd:   %-12s %10.1f, max %llu\n", what,
+	       lcd_counts->frames ?
+	       (double) t / lcd_counts->frames : 0.0, p);
+}
+
+void lcd_exit(void)
+{
+	register struct lcd_counts *c = lcd_counts;
+
+	printf("lcd: %s %dx%d, %llu frames, per frame:\n", lcd->name, lcd->w,
+	       lcd->h, c->frames);
+	lcd_print("commands", c->total.cmds, c->peak.cmds);
+	lcd_print("parameters", c->total.params, c->peak.params);
+	lcd_print("GRAM bytes", c->total.pixels, c->peak.pixels);
+	lcd_print("reads", c->total.reads, c->peak.reads);
+	lcd_print("bus bytes", c->total.bus, c->peak.bus);
+}
@@ -0,0 +1,58 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module is the interface to the LCD controller drivers.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _LCD_H_
+#define _LCD_H_
+
+#include "il9341.h"
+
+#define LCD_GRAM	(lcd->w * lcd->h * 2)	/* RGB565 frame buffer */
+#define LCD_RAMWR	0x2c			/* memory write of all of them */
+
+struct lcd_driver {
+	const char *name;
+	int w, h;			/* pixels, as the ROM uses the panel */
+	BYTE id_cmd;			/* command reading the ID */
+	BYTE id[3];			/* its bytes after a dummy one */
+	void (*wr_cmd)(BYTE);
+	void (*wr_data)(BYTE);
+	BYTE (*rd_data)(void);
+	void (*present)(void);
+	void (*save)(struct il9341_state *);
+	void (*restore)(struct il9341_state *);
+};
+
+struct lcd_count {
+	unsigned long long cmds;	/* commands written */
+	unsigned long long params;	/* parameter bytes written */
+	unsigned long long pixels;	/* bytes written into the GRAM */
+	unsigned long long reads;	/* bytes read */
+	unsigned long long bus;		/* all of them */
+};
+
+struct lcd_counts {			/* counts of a machine */
+	struct lcd_count now;		/* counts of this frame */
+	struct lcd_count total, peak;
+	unsigned long long frames;
+	BYTE cmd;			/* last command written */
+};
+
+extern struct lcd_driver *lcd;
+extern MSTATE struct lcd_counts *lcd_counts;
+
+extern int lcd_select(const char *);
+extern void lcd_list(void);
+extern void lcd_cmd(BYTE);
+extern void lcd_data(BYTE);
+extern BYTE lcd_read(void);
+extern void lcd_present(void);
+extern void lcd_frame(void);
+extern void lcd_exit(void);
+
+#endif
@@ -5,7 +5,7 @@
 #include "memory.h"
 
 #ifdef LCD_EMU
-#include "il9341.h"
+#include "lcd.h"
 #ifdef LOG_LCD_MEM
 FILE* mem_log_file;
 #endif
@@ -57,40 +57,50 @@ void fbinit()
 #endif
 }
 
-static void fill(int startx, int endx, int starty, int endy, int colour)
-{
-	il9341_set_window(startx, endx, starty, endy);
-	il9341_wr_cmd(0x2c);
-	for(int y=starty; y<=endy; y++)
-	{
-		for(int x=startx; x<=endx; x++)
-		{
-			il9341_wr_data(colour >> 8);
-			il9341_wr_data(colour & 0xff);
-		}
-	}
-}
+// Border colour written to port 0xFE, -1 before the first write,
+// and the one drawn into the frame buffer
+static MSTATE int border = -1;
+static int border_drawn = -1;
+
 void fb_set_border(BYTE colour)
 {
 #ifdef LOG_LCD_MEM
-	fprintf(mem_log_file, "BORDER WR, PC = 0x%04x\r\n", PC);
+	if (mem_log_file != NULL)
+		fprintf(mem_log_file, "BORDER WR, PC = 0x%04x\r\n", PC);
 #endif
-	return;
-	colour &= 0x7;
-	
+	border = colour & 0x7;
+}
+
+// Called for every frame before it is presented, draws the border
+// with four rectangle fills if its colour has changed
+void fb_border()
+{
+	int colour = border;
+
+	if (colour < 0 || colour == border_drawn)
+	{
+		return;
+	}
+	border_drawn = colour;
+
 	// Top
-	fill(0, 319, 0, 23, colour_table[colour]);
+	il9341_fill(0, lcd->w - 1, 0, LCD_WIN_Y_START - 1, colour_table[colour]);
 	// Left
-	fill(0, 31, 24, 215, colour_table[colour]);
+	il9341_fill(0, LCD_WIN_X_START - 1, LCD_WIN_Y_START, LCD_WIN_Y_END,
+		    colour_table[colour]);
 	// Right
-	fill(288, 319, 24, 215, colour_table[colour]);
+	il9341_fill(LCD_WIN_X_END + 1, lcd->w - 1, LCD_WIN_Y_START, LCD_WIN_Y_END,
+		    colour_table[colour]);
 	// Bottom
-	fill(0, 319, 216, 239, colour_table[colour]);
+	il9341_fill(0, lcd->w - 1, LCD_WIN_Y_END + 1, lcd->h - 1,
+		    colour_table[colour]);
 }
 
 void fbwr(WORD addr, BYTE data)
 {
 #ifdef LOG_LCD_MEM
+	if (mem_log_file == NULL)	/* embedded without fbinit() */
+		return;
 	if (addr >= 16384 && addr <= (16384 + 6144 - 1))
 	{
 		fprintf(mem_log_file, "FB WR, PC = 0x%04x, ADDR = 0x%04x\n", PC, addr);
@@ -4,5 +4,6 @@
 void fbinit();
 void fbwr(WORD addr, BYTE data);
 void fb_set_border(BYTE colour);
+void fb_border();
 
 #endif
@@ -0,0 +1,372 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module is the API to run machines embedded in other programs.
+ *
+ * All state of a machine, CPU, interrupts, memory, LCD controller with
+ * its counts and key matrix, is kept in a struct machine. The CPU emulation works on
+ * the global registers, which are per thread (MSTATE), and memory is a
+ * per thread pointer. machine_run() switches the state of the machine
+ * into the calling thread, runs it and switches it out again, so any
+ * number of machines can run in one process, on as many threads as
+ * wanted, as long as one machine isn't run by two threads at once.
+ * The state of the thread, e.g. the machine loaded with -x, is put
+ * back after the run.
+ *
+ * Memory and GRAM of a machine are one mapping. machine_fork() clones
+ * a machine into branches: the pages are written once into a memfd,
+ * a temporary file removed at once on systems other than Linux, which
+ * the machine and all branches then map private, so that they share
+ * the pages until one of them writes, and a branch only pays for the
+ * pages it dirties.
+ *
+ * The machines run without display window and timer, with an
+ * interrupt every INT_PERIOD T-states. Keys are set in the key
+ * matrix, the LCD is read from the GRAM of the machine. Options
+ * that instrument the CPU (-P, -S, -c, -H, -T, -G, -L) collect into
+ * process wide tables and must not be used with the API.
+ *
+ * Programs embedding machines link with ../libnewspec.a.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#define _GNU_SOURCE		/* memfd_create() */
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "lcd.h"
+#include "bench.h"
+#include "machine.h"
+
+#define CACHE_LINE	64
+#define MAP_SIZE	(MEMORY_SIZE + LCD_GRAM)	/* memory and GRAM */
+
+extern int load_file(char *);
+extern void reset_cpu(void);
+extern MSTATE BYTE *key_rows;
+
+/*
+ *	CPU state, accessed on every switch, packed at the start
+ */
+struct cpu {
+	WORD pc, sp, ix, iy;
+	BYTE a, b, c, d, e, h, l, i;
+	BYTE a_, b_, c_, d_, e_, h_, l_, iff;
+	int f, f_;
+	long r;
+	int int_int, int_nmi, int_mode, int_data, int_protection;
+	int int_period, int_tcnt, lcd_wait;
+	int error;
+};
+
+struct machine {
+	struct cpu cpu;
+	BYTE keys[8];			/* key matrix, bit 0 = key down */
+	unsigned long long t;		/* T-states run */
+	struct il9341_state lcd;
+	struct lcd_counts lcdc;		/* LCD bytes per frame */
+	BYTE *mem;			/* memory, followed by the GRAM */
+	BYTE *gram;
+};
+
+/*
+ *	State of the thread, while a machine runs in it
+ */
+struct save {
+	struct cpu cpu;
+	struct il9341_state lcd;
+	struct lcd_counts *lcdc;
+	BYTE *memory;
+	BYTE *keys;
+	int stop;			/* bench_until() of the thread */
+	unsigned long long t, tmax;
+};
+
+static void cpu_get(struct cpu *c)
+{
+	c->pc = PC;
+	c->sp = SP;
+	c->ix = IX;
+	c->iy = IY;
+	c->a = A;
+	c->b = B;
+	c->c = C;
+	c->d = D;
+	c->e = E;
+	c->h = H;
+	c->l = L;
+	c->i = I;
+	c->a_ = A_;
+	c->b_ = B_;
+	c->c_ = C_;
+	c->d_ = D_;
+	c->e_ = E_;
+	c->h_ = H_;
+	c->l_ = L_;
+	c->iff = IFF;
+	c->f = F;
+	c->f_ = F_;
+	c->r = R;
+	c->int_int = int_int;
+	c->int_nmi = int_nmi;
+	c->int_mode = int_mode;
+	c->int_data = int_data;
+	c->int_protection = int_protection;
+	c->int_period = int_period;
+	c->int_tcnt = int_tcnt;
+	c->lcd_wait = lcd_wait;
+	c->error = cpu_error;
+}
+
+static void cpu_set(struct cpu *c)
+{
+	PC = c->pc;
+	SP = c->sp;
+	IX = c->ix;
+	IY = c->iy;
+	A = c->a;
+	B = c->b;
+	C = c->c;
+	D = c->d;
+	E = c->e;
+	H = c->h;
+	L = c->l;
+	I = c->i;
+	A_ = c->a_;
+	B_ = c->b_;
+	C_ = c->c_;
+	D_ = c->d_;
+	E_ = c->e_;
+	H_ = c->h_;
+	L_ = c->l_;
+	IFF = c->iff;
+	F = c->f;
+	F_ = c->f_;
+	R = c->r;
+	int_int = c->int_int;
+	int_nmi = c->int_nmi;
+	int_mode = c->int_mode;
+	int_data = c->int_data;
+	int_protection = c->int_protection;
+	int_period = c->int_period;
+	int_tcnt = c->int_tcnt;
+	lcd_wait = c->lcd_wait;
+	cpu_error = c->error;
+	io_wait = 0;
+}
+
+/*
+ *	Switch machine m into this thread, state of the thread into s
+ */
+static void machine_enter(struct machine *m, struct save *s)
+{
+	cpu_get(&s->cpu);
+	(*lcd->save)(&s->lcd);
+	s->lcdc = lcd_counts;
+	s->memory = memory;
+	s->keys = key_rows;
+	s->stop = bench_stop;
+	s->t = bench_t;
+	s->tmax = bench_tmax;
+
+	cpu_set(&m->cpu);
+	(*lcd->restore)(&m->lcd);
+	lcd_counts = &m->lcdc;
+	memory = m->mem;
+	key_rows = m->keys;
+}
+
+static void machine_leave(struct machine *m, struct save *s)
+{
+	cpu_get(&m->cpu);
+	(*lcd->save)(&m->lcd);
+
+	cpu_set(&s->cpu);
+	(*lcd->restore)(&s->lcd);
+	lcd_counts = s->lcdc;
+	memory = s->memory;
+	key_rows = s->keys;
+	bench_stop = s->stop;
+	bench_t = s->t;
+	bench_tmax = s->tmax;
+}
+
+/*
+ *	New machine with memory cleared and CPU reset, NULL if
+ *	out of memory
+ */
+struct machine *machine_create(void)
+{
+	struct machine *m;
+
+	if (posix_memalign((void **) &m, CACHE_LINE, sizeof(struct machine)))
+		return(NULL);
+	memset(m, 0, sizeof(struct machine));
+	m->mem = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m->mem == MAP_FAILED) {
+		free(m);
+		return(NULL);
+	}
+	m->gram = m->mem + MEMORY_SIZE;
+	m->cpu.int_data = -1;
+	m->cpu.int_period = INT_PERIOD;
+	memset(m->keys, 0xff, sizeof(m->keys));
+	m->lcd.gram = m->gram;
+	return(m);
+}
+
+void machine_destroy(struct machine *m)
+{
+	munmap(m->mem, MAP_SIZE);
+	free(m);
+}
+
+/*
+ *	File without name for the pages of a fork, -1 if none
+ */
+static int fork_fd(void)
+{
+#ifdef __linux__
+	return(memfd_create("machine", MFD_CLOEXEC));
+#else
+	char fn[] = "/tmp/machineXXXXXX";
+	int fd;
+
+	if ((fd = mkstemp(fn)) >= 0)
+		unlink(fn);
+	return(fd);
+#endif
+}
+
+/*
+ *	Clone machine m into n branches, copy-on-write, 0 if ok
+ */
+int machine_fork(struct machine *m, struct machine **branch, int n)
+{
+	struct machine *b;
+	int fd, i;
+
+	if ((fd = fork_fd()) < 0)
+		return(1);
+	if (pwrite(fd, m->mem, MAP_SIZE, 0) != MAP_SIZE ||
+	    mmap(m->mem, MAP_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		close(fd);
+		return(1);
+	}
+	for (i = 0; i < n; i++) {
+		if (posix_memalign((void **) &b, CACHE_LINE,
+				   sizeof(struct machine)))
+			break;
+		*b = *m;
+		b->mem = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE, fd, 0);
+		if (b->mem == MAP_FAILED) {
+			free(b);
+			break;
+		}
+		b->gram = b->mem + MEMORY_SIZE;
+		b->lcd.gram = b->gram;
+		branch[i] = b;
+	}
+	close(fd);			/* the mappings keep it */
+	if (i < n) {
+		while (i > 0)
+			machine_destroy(branch[--i]);
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Load a ROM in Intel hex or Mostek format and reset the CPU,
+ *	0 if ok
+ */
+int machine_load(struct machine *m, char *fn)
+{
+	struct save s;
+	int rc;
+
+	machine_enter(m, &s);
+	memset(memory, 0, MEMORY_SIZE);
+	reset_cpu();
+	rc = load_file(fn);
+	PC = 0;
+	machine_leave(m, &s);
+	return(rc);
+}
+
+/*
+ *	Run machine m for t T-states, or until PC reaches addr if
+ *	it isn't -1, returns M_TIME, M_ADDR or M_ERROR
+ */
+int machine_run(struct machine *m, unsigned long long t, int addr)
+{
+	struct save s;
+	int rc;
+
+	if (t == 0)
+		return(M_TIME);
+	machine_enter(m, &s);
+	bench_until(addr, t);
+	if (cpu_error != NONE)
+		rc = M_ERROR;
+	else if (PC == addr)
+		rc = M_ADDR;
+	else
+		rc = M_TIME;
+	m->t += bench_t;
+	machine_leave(m, &s);
+	return(rc);
+}
+
+/*
+ *	Press (down = 1) or release a key, row is the bit of the
+ *	upper address byte selecting the half row, col the bit of
+ *	the key in the data read
+ */
+void machine_key(struct machine *m, int row, int col, int down)
+{
+	if (row < 0 || row > 7 || col < 0 || col > 4)
+		return;
+	if (down)
+		m->keys[row] &= ~(1 << col);
+	else
+		m->keys[row] |= 1 << col;
+}
+
+/*
+ *	LCD GRAM, lcd->w x lcd->h RGB565 in host byte order
+ */
+BYTE *machine_gram(struct machine *m, int *size)
+{
+	*size = LCD_GRAM;
+	return(m->gram);
+}
+
+BYTE *machine_mem(struct machine *m)
+{
+	return(m->mem);
+}
+
+WORD machine_pc(struct machine *m)
+{
+	return(m->cpu.pc);
+}
+
+int machine_error(struct machine *m)
+{
+	return(m->cpu.error);
+}
+
+unsigned long long machine_time(struct machine *m)
+{
+	return(m->t);
+}
@@ -0,0 +1,32 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module is the API to run machines embedded in other programs.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+					/* why machine_run() returned */
+#define M_TIME		0		/* T-states run */
+#define M_ADDR		1		/* PC reached the address */
+#define M_ERROR		2		/* CPU error, see machine_error() */
+
+struct machine;
+
+extern struct machine *machine_create(void);
+extern void machine_destroy(struct machine *);
+extern int machine_fork(struct machine *, struct machine **, int);
+extern int machine_load(struct machine *, char *);
+extern int machine_run(struct machine *, unsigned long long, int);
+extern void machine_key(struct machine *, int, int, int);
+extern BYTE *machine_gram(struct machine *, int *);
+extern BYTE *machine_mem(struct machine *);
+extern WORD machine_pc(struct machine *);
+extern int machine_error(struct machine *);
+extern unsigned long long machine_time(struct machine *);
+
+#endif
@@ -13,9 +13,18 @@
 #include "sim.h"
 #include "lcd_emu.h"
 #include "memory.h"
+#ifdef WANT_HEAT
+#include "simglb.h"
+#include "heat.h"
+#endif
 
 /* non banked memory */
+#ifdef WANT_MACHINE
+static BYTE ram[MEMORY_SIZE];
+MSTATE BYTE *memory = ram;	/* other machines switch it per thread */
+#else
 BYTE memory[MEMORY_SIZE];
+#endif
 
 void init_memory(void)
 {
@@ -33,6 +42,10 @@ void memwrt(WORD addr, BYTE data)
 	}
 	memory[addr] = data; 
 	fbwr(addr, data);
+#ifdef WANT_HEAT
+	if (H_flag)
+		heat_wr(addr);
+#endif
 }
 
 BYTE memrdr(WORD addr)
@@ -41,5 +54,9 @@ BYTE memrdr(WORD addr)
 	{
 		return 0;
 	}
+#ifdef WANT_HEAT
+	if (H_flag)
+		heat_rd(addr);
+#endif
 	return memory[addr];
 }
@@ -13,7 +13,11 @@
 #define MEMORY_SIZE 32768
 
 extern void init_memory(void), init_rom(void);
+#ifdef WANT_MACHINE
+extern MSTATE BYTE *memory;	/* memory of the machine in this thread */
+#else
 extern BYTE memory[];
+#endif
 
 /*
  * memory access for the CPU cores
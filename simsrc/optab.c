@@ -0,0 +1,216 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module holds the sizes and T-states of the Z80 instructions,
+ * for the tools working on listings and for the analysis in the
+ * simulator, which only knows the T-states of an instruction after
+ * it has been executed.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include "sim.h"
+#include "optab.h"
+
+/*
+ *	T-states of the unprefixed op-codes, conditional ones not taken
+ */
+static BYTE t_main[256] = {
+	 4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4, /* 00 */
+	 8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4, /* 10 */
+	 7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4, /* 20 */
+	 7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4, /* 30 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 40 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 50 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 60 */
+	 7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4, /* 70 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 80 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* 90 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* A0 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, /* B0 */
+	 5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11, /* C0 */
+	 5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11, /* D0 */
+	 5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11, /* E0 */
+	 5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11  /* F0 */
+};
+
+/*
+ *	Size of the unprefixed op-codes
+ */
+static BYTE l_main[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,	/* 00 */
+	2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,	/* 10 */
+	2, 3, 3, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* 20 */
+	2, 3, 3, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,	/* 30 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 40 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 50 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 60 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 70 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 80 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* 90 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* A0 */
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	/* B0 */
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,	/* C0 */
+	1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1,	/* D0 */
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,	/* E0 */
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1	/* F0 */
+};
+
+/*
+ *	T-states of the ED prefixed op-codes 40-7F, the others are
+ *	block instructions or act as two NOP's
+ */
+static BYTE t_ed[64] = {
+	12, 12, 15, 20,  8, 14,  8,  9, 12, 12, 15, 20,  8, 14,  8,  9, /* 40 */
+	12, 12, 15, 20,  8, 14,  8,  9, 12, 12, 15, 20,  8, 14,  8,  9, /* 50 */
+	12, 12, 15, 20,  8, 14,  8, 18, 12, 12, 15, 20,  8, 14,  8, 18, /* 60 */
+	12, 12, 15, 20,  8, 14,  8,  8, 12, 12, 15, 20,  8, 14,  8,  8  /* 70 */
+};
+
+/*
+ *	Check if the unprefixed op-code accesses memory with (HL),
+ *	which becomes (IX+d) with a DD or FD prefix
+ */
+static int is_hlmem(BYTE op)
+{
+	if (op == 0x34 || op == 0x35 || op == 0x36)
+		return(1);
+	if (op >= 0x40 && op <= 0x7f && op != 0x76)
+		return((op & 7) == 6 || (op & 0xf8) == 0x70);
+	if (op >= 0x80 && op <= 0xbf)
+		return((op & 7) == 6);
+	return(0);
+}
+
+/*
+ *	Decode the instruction in p, located at addr. Returns the
+ *	length, 0 for a prefix not followed by an instruction.
+ */
+int op_decode(BYTE *p, WORD addr, struct opinfo *oi)
+{
+	register BYTE op = p[0];
+	int xy = 0;
+
+	oi->kind = OP_PLAIN;
+	oi->cond = 0;
+	oi->target = 0;
+
+	if (op == 0xdd || op == 0xfd) {		/* IX, IY */
+		op = p[1];
+		if (op == 0xdd || op == 0xfd || op == 0xed)
+			return(oi->len = 0);
+		xy = 1;
+		p++;
+	}
+
+	if (op == 0xcb) {
+		if (xy) {			/* DD CB d op */
+			oi->len = 4;
+			oi->t = ((p[2] & 0xc0) == 0x40) ? 20 : 23;
+		} else {
+			oi->len = 2;
+			if ((p[1] & 7) == 6)
+				oi->t = ((p[1] & 0xc0) == 0x40) ? 12 : 15;
+			else
+				oi->t = 8;
+		}
+		oi->t_taken = oi->t;
+		return(oi->len);
+	}
+
+	if (op == 0xed) {
+		op = p[1];
+		oi->len = 2;
+		if (op >= 0x40 && op <= 0x7f) {
+			oi->t = t_ed[op - 0x40];
+			if ((op & 7) == 3)	/* LD (nn),rr / LD rr,(nn) */
+				oi->len = 4;
+			if ((op & 7) == 5)	/* RETN, RETI */
+				oi->kind = OP_RET;
+		} else if ((op & 0xe4) == 0xa0) {	/* block instructions */
+			oi->t = 16;
+			if (op & 0x10) {
+				oi->kind = OP_REP;
+				oi->cond = 1;
+				oi->t_taken = 21;
+				oi->target = addr;
+				return(oi->len);
+			}
+		} else
+			oi->t = 8;
+		oi->t_taken = oi->t;
+		return(oi->len);
+	}
+
+	oi->len = l_main[op];
+	oi->t = t_main[op];
+
+	switch (op) {
+	case 0x10:				/* DJNZ */
+		oi->kind = OP_DJNZ;
+		oi->cond = 1;
+		oi->t_taken = 13;
+		oi->target = addr + 2 + (signed char) p[1];
+		return(oi->len);
+	case 0x18:				/* JR */
+		oi->kind = OP_JR;
+		oi->target = addr + 2 + (signed char) p[1];
+		break;
+	case 0x20: case 0x28: case 0x30: case 0x38:	/* JR cc */
+		oi->kind = OP_JR;
+		oi->cond = 1;
+		oi->t_taken = 12;
+		oi->target = addr + 2 + (signed char) p[1];
+		return(oi->len);
+	case 0xc3:				/* JP */
+		oi->kind = OP_JP;
+		oi->target = p[1] + (p[2] << 8);
+		break;
+	case 0xcd:				/* CALL */
+		oi->kind = OP_CALL;
+		oi->target = p[1] + (p[2] << 8);
+		break;
+	case 0xc9:				/* RET */
+		oi->kind = OP_RET;
+		break;
+	case 0xe9:				/* JP (HL) */
+		oi->kind = OP_JPIND;
+		break;
+	case 0x76:				/* HALT */
+		oi->kind = OP_HALT;
+		break;
+	default:
+		if ((op & 0xc7) == 0xc2) {	/* JP cc */
+			oi->kind = OP_JP;
+			oi->cond = 1;
+			oi->target = p[1] + (p[2] << 8);
+		} else if ((op & 0xc7) == 0xc4) {	/* CALL cc */
+			oi->kind = OP_CALL;
+			oi->cond = 1;
+			oi->t_taken = 17;
+			oi->target = p[1] + (p[2] << 8);
+			return(oi->len);
+		} else if ((op & 0xc7) == 0xc0) {	/* RET cc */
+			oi->kind = OP_RET;
+			oi->cond = 1;
+			oi->t_taken = 11;
+			return(oi->len);
+		} else if ((op & 0xc7) == 0xc7) {	/* RST */
+			oi->kind = OP_RST;
+			oi->target = op & 0x38;
+		}
+		break;
+	}
+
+	if (xy) {				/* IX/IY instead of HL */
+		oi->len++;
+		if (is_hlmem(op)) {
+			oi->len++;		/* displacement */
+			oi->t += (op == 0x36) ? 9 : 12;
+		} else
+			oi->t += 4;
+	}
+	oi->t_taken = oi->t;
+	return(oi->len);
+}
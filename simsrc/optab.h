@@ -0,0 +1,36 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module holds the sizes and T-states of the Z80 instructions.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _OPTAB_H_
+#define _OPTAB_H_
+
+					/* kind of instruction */
+#define OP_PLAIN	0		/* no transfer of control */
+#define OP_JR		1		/* JR, JR cc, target is relative */
+#define OP_DJNZ		2		/* DJNZ */
+#define OP_JP		3		/* JP, JP cc */
+#define OP_JPIND	4		/* JP (HL), JP (IX), JP (IY) */
+#define OP_CALL		5		/* CALL, CALL cc */
+#define OP_RST		6		/* RST */
+#define OP_RET		7		/* RET, RET cc, RETI, RETN */
+#define OP_REP		8		/* repeated block instruction */
+#define OP_HALT		9		/* HALT */
+
+struct opinfo {
+	int len;			/* bytes */
+	int t;				/* T-states, not taken/not repeated */
+	int t_taken;			/* T-states, taken/repeated */
+	int kind;			/* OP_xxx */
+	int cond;			/* conditional transfer or repeat */
+	WORD target;			/* destination of JR, DJNZ, JP, CALL, RST */
+};
+
+extern int op_decode(BYTE *, WORD, struct opinfo *);
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements an exact per-PC execution profiler.
+ *
+ * Every executed instruction is counted with its T-states, host time
+ * spent in io_out() is charged to the instruction doing the OUT.
+ * CALL, RST and interrupts push a frame on a shadow stack, RET pops
+ * it again, this gives inclusive times per routine and a calling
+ * context tree for the collapsed stack output.
+ *
+ * Results are grouped by the labels of the ROM listing (option -y),
+ * without a listing every call target is a routine of its own.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "prof.h"
+
+#define PROF_DEPTH	256	/* max. depth of the shadow stack */
+#define PROF_HOT	40	/* no. of hot instructions to report */
+
+/* read op-codes without going through the instrumented memrdr() */
+#define op_at(a)	(((a) < MEMORY_SIZE) ? memory[a] : 0xff)
+
+struct frame {
+	WORD key;			/* routine called */
+	WORD sp;			/* stack slot of return address */
+	int node;			/* context tree node of the caller */
+	unsigned long long t0;		/* clock at time of call */
+};
+
+struct node {
+	WORD key;			/* routine */
+	int parent;			/* calling context */
+	int child;			/* first callee */
+	int sibling;			/* next callee of parent */
+	unsigned long long self;	/* T-states in this context */
+};
+
+unsigned long long prof_io_acc;		/* ns in io_out() not yet charged */
+
+static unsigned long prof_exec[65536];		/* executions per PC */
+static unsigned long long prof_t[65536];	/* T-states per PC */
+static unsigned long long prof_io[65536];	/* ns in io_out() per PC */
+static unsigned long prof_calls[65536];		/* calls per routine */
+static unsigned long long prof_incl[65536];	/* inclusive T per routine */
+static int prof_active[65536];			/* activations per routine */
+static unsigned long long prof_clock;		/* T-states profiled */
+
+static struct frame stack[PROF_DEPTH];
+static int depth;
+static struct node *cct;
+static int ncct, cct_size;
+static int cur_node;
+
+/*
+ *	Map an address to the routine it belongs to
+ */
+static WORD prof_key(WORD addr)
+{
+	int i = sym_find(addr);
+
+	return((i < 0) ? addr : sym_addr(i));
+}
+
+static int cct_new(int parent, WORD key)
+{
+	if (ncct == cct_size) {
+		cct_size = cct_size ? cct_size * 2 : 4096;
+		cct = realloc(cct, cct_size * sizeof(struct node));
+		if (cct == NULL) {
+			puts("out of memory for profiler");
+			exit(1);
+		}
+	}
+	cct[ncct].key = key;
+	cct[ncct].parent = parent;
+	cct[ncct].child = -1;
+	cct[ncct].self = 0;
+	if (parent >= 0) {
+		cct[ncct].sibling = cct[parent].child;
+		cct[parent].child = ncct;
+	} else
+		cct[ncct].sibling = -1;
+	return(ncct++);
+}
+
+/*
+ *	Find or create the context for key called from node n
+ */
+static int cct_child(int n, WORD key)
+{
+	register int c;
+
+	for (c = cct[n].child; c >= 0; c = cct[c].sibling)
+		if (cct[c].key == key)
+			return(c);
+	return(cct_new(n, key));
+}
+
+void prof_init(void)
+{
+	cur_node = cct_new(-1, 0);
+}
+
+/*
+ *	Called after every instruction with PC and SP from before it
+ */
+void prof_step(WORD pc, WORD sp, int states)
+{
+	register BYTE op;
+
+	prof_exec[pc]++;
+	prof_t[pc] += states;
+	prof_clock += states;
+	cct[cur_node].self += states;
+
+	if (prof_io_acc) {
+		prof_io[pc] += prof_io_acc;
+		prof_io_acc = 0;
+	}
+
+	if (SP == (WORD) (sp - 2)) {
+		/* CALL, CALL cc or RST taken ? */
+		op = op_at(pc);
+		if (op == 0xcd || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7)
+			prof_call(PC, SP);
+	} else if (SP == (WORD) (sp + 2)) {
+		/* RET, RET cc, RETI or RETN taken ? */
+		op = op_at(pc);
+		if (op == 0xc9 || (op & 0xc7) == 0xc0 ||
+		    (op == 0xed && (op_at(pc + 1) & 0xc7) == 0x45))
+			prof_ret(sp);
+	}
+}
+
+/*
+ *	Routine at addr called, return address is on the stack at sp
+ */
+void prof_call(WORD addr, WORD sp)
+{
+	register struct frame *f;
+	WORD key = prof_key(addr);
+
+	if (depth == PROF_DEPTH)
+		return;
+	f = &stack[depth++];
+	f->key = key;
+	f->sp = sp;
+	f->node = cur_node;
+	f->t0 = prof_clock;
+	prof_calls[key]++;
+	prof_active[key]++;
+	cur_node = cct_child(cur_node, key);
+}
+
+static void prof_pop(void)
+{
+	register struct frame *f = &stack[--depth];
+
+	/* only the outermost activation of a recursion counts */
+	if (--prof_active[f->key] == 0)
+		prof_incl[f->key] += prof_clock - f->t0;
+	cur_node = f->node;
+}
+
+/*
+ *	Return address popped from the stack at sp. Frames whose
+ *	return address was dropped by the code (POP, LD SP) are
+ *	unwound here as well.
+ */
+void prof_ret(WORD sp)
+{
+	while (depth > 0 && stack[depth - 1].sp <= sp)
+		prof_pop();
+}
+
+struct entry {
+	WORD key;
+	unsigned long long self, incl, io;
+	unsigned long execs, calls;
+};
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct entry *x = a, *y = b;
+
+	if (x->self != y->self)
+		return((x->self < y->self) ? 1 : -1);
+	return(x->key - y->key);
+}
+
+static int hot_cmp(const void *a, const void *b)
+{
+	WORD x = *(const WORD *) a, y = *(const WORD *) b;
+
+	if (prof_t[x] != prof_t[y])
+		return((prof_t[x] < prof_t[y]) ? 1 : -1);
+	return(x - y);
+}
+
+static void prof_flat(FILE *fp)
+{
+	static struct entry e[65536];
+	static WORD hot[65536];
+	static int idx[65536];
+	register int i;
+	int n = 0, nhot = 0;
+	char buf[SYM_NAMELEN + 8];
+	WORD key;
+
+	for (i = 0; i < 65536; i++)
+		idx[i] = -1;
+
+	for (i = 0; i < 65536; i++) {
+		if (prof_exec[i] == 0 && prof_calls[i] == 0)
+			continue;
+		key = prof_key(i);
+		if (idx[key] < 0) {
+			idx[key] = n;
+			memset(&e[n], 0, sizeof(struct entry));
+			e[n].key = key;
+			e[n].calls = prof_calls[key];
+			e[n].incl = prof_incl[key];
+			n++;
+		}
+		e[idx[key]].self += prof_t[i];
+		e[idx[key]].execs += prof_exec[i];
+		e[idx[key]].io += prof_io[i];
+		if (prof_exec[i])
+			hot[nhot++] = i;
+	}
+	qsort(e, n, sizeof(struct entry), entry_cmp);
+
+	fprintf(fp, "Flat profile, %llu T-states\n\n", prof_clock);
+	fprintf(fp, " %%time       self T       incl T     calls      insns     io ms  routine\n");
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%6.2f %12llu %12llu %9lu %10lu %9.3f  %s\n",
+			prof_clock ? 100.0 * e[i].self / prof_clock : 0.0,
+			e[i].self, e[i].incl, e[i].calls, e[i].execs,
+			e[i].io / 1000000.0, sym_label(e[i].key, buf));
+
+	qsort(hot, nhot, sizeof(WORD), hot_cmp);
+	fprintf(fp, "\nHot instructions\n\n");
+	fprintf(fp, " addr       execs            T     io ms  location\n");
+	for (i = 0; i < nhot && i < PROF_HOT; i++)
+		fprintf(fp, " %04X  %10lu %12llu %9.3f  %s\n", hot[i],
+			prof_exec[hot[i]], prof_t[hot[i]],
+			prof_io[hot[i]] / 1000000.0, sym_label(hot[i], buf));
+}
+
+static void prof_path(FILE *fp, int n)
+{
+	char buf[SYM_NAMELEN + 8];
+
+	if (cct[n].parent < 0) {
+		fputs("(top)", fp);
+		return;
+	}
+	prof_path(fp, cct[n].parent);
+	fprintf(fp, ";%s", sym_label(cct[n].key, buf));
+}
+
+/*
+ *	Write the calling contexts in the collapsed stack format
+ *	used by flamegraph tools
+ */
+static void prof_folded(FILE *fp)
+{
+	register int i;
+
+	for (i = 0; i < ncct; i++) {
+		if (cct[i].self == 0)
+			continue;
+		prof_path(fp, i);
+		fprintf(fp, " %llu\n", cct[i].self);
+	}
+}
+
+/*
+ *	Write the profile into pfn and pfn.folded
+ */
+void prof_exit(void)
+{
+	FILE *fp;
+	char fn[4096 + 8];
+
+	while (depth > 0)
+		prof_pop();
+
+	if ((fp = fopen(pfn, "w")) == NULL) {
+		printf("can't open file %s\n", pfn);
+		return;
+	}
+	prof_flat(fp);
+	fclose(fp);
+
+	strcpy(fn, pfn);
+	strcat(fn, ".folded");
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		return;
+	}
+	prof_folded(fp);
+	fclose(fp);
+}
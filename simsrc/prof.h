@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements an exact per-PC execution profiler.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+extern unsigned long long prof_io_acc;
+
+extern void prof_init(void);
+extern void prof_exit(void);
+extern void prof_step(WORD, WORD, int);
+extern void prof_call(WORD, WORD);
+extern void prof_ret(WORD);
+
+#endif
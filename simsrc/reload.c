@@ -0,0 +1,261 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module reloads the ROM when its file changes.
+ *
+ * With option -M rom or -M warm the directory of the file loaded with
+ * option -x is watched with inotify. The 50 ms timer reads the events,
+ * on systems other than Linux it looks at the time the file was
+ * modified instead. When the file was written or moved there and
+ * nothing happened for RELOAD_SETTLE ticks after, so that the assembler is done with it,
+ * the CPU is stopped and the ROM is reloaded before it goes on. That
+ * takes some milliseconds instead of starting the simulator again. If
+ * the file can't be loaded the old ROM stays.
+ *
+ * With -M rom only the ROM pages are swapped, RAM stays as it is. The
+ * labels are read from the listing again and the routines trapped are
+ * looked up in it again. When the CPU was in the ROM, its return
+ * addresses on the stack are no good anymore, the machine goes on at
+ * MAIN-4 as after the report 0 OK, with the stack set up like the ROM
+ * does after a report. The BASIC program and variables are kept. When
+ * the CPU was in RAM it goes on there.
+ *
+ * With -M warm the machine is reset and booted again with the new ROM,
+ * from the snapshot of option -l, the boot cache of option -C or cold.
+ *
+ * Addresses looked up once at the start by other modules, the budgets
+ * and profiles of routines, keep those of the old ROM.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "reload.h"
+#ifdef WANT_TAPE
+#include "tape.h"
+#endif
+#ifdef WANT_BASIC
+#include "basic.h"
+#endif
+#ifdef WANT_TEXT
+#include "text.h"
+#endif
+
+#define ERR_NR		0x5c3a		/* system variables */
+#define ERR_SP		0x5c3d
+#define STKBOT		0x5c63
+#define STKEND		0x5c65
+#define MEM		0x5c68
+#define MEMBOT		0x5c92
+#define RAMTOP		0x5cb2
+
+#define rd16(a)		(memory[a] + (memory[(a) + 1] << 8))
+#define wr16(a, v)	(memory[a] = (v) & 0xff, memory[(a) + 1] = (v) >> 8)
+
+int reload_on;				/* ROM file is watched */
+volatile int reload_pending;		/* it changed, CPU to be stopped */
+
+#ifdef __linux__
+static int fd = -1;			/* inotify */
+static char name[4096];			/* file name in the directory */
+#else
+static struct stat last;		/* file as seen last */
+#endif
+static int changed, quiet;		/* timer ticks since it changed */
+static unsigned long reloads, fails;
+static BYTE save[MEMORY_SIZE];
+static BYTE rom[RELOAD_PAGES];
+
+extern int load_file(char *);
+extern void load_symbols(void), reset_system(void);
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ *	Called by the 50 ms timer
+ */
+void reload_poll(void)
+{
+#ifdef __linux__
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	char *p;
+	ssize_t n;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		for (p = buf; p < buf + n; p += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *) p;
+			if (ev->len && strcmp(ev->name, name) == 0) {
+				changed = 1;
+				quiet = 0;
+			}
+		}
+#else
+	struct stat sbuf;
+
+	if (stat(xfn, &sbuf) == 0 && (sbuf.st_mtime != last.st_mtime ||
+				      sbuf.st_size != last.st_size ||
+				      sbuf.st_ino != last.st_ino)) {
+		last = sbuf;
+		changed = 1;
+		quiet = 0;
+	}
+#endif
+	if (changed && ++quiet > RELOAD_SETTLE) {
+		changed = 0;
+		reload_pending = 1;
+	}
+	/* again at every tick, mon() could just have started the CPU */
+	if (reload_pending)
+		cpu_state = STOPPED;
+}
+
+/*
+ *	Look up the ROM routines trapped in the new listing
+ */
+static void reload_syms(void)
+{
+	load_symbols();
+#ifdef WANT_TAPE
+	if (tp_flag) {
+		tape_ld = sym_lookup(TAPE_LOAD);
+		tape_sa = sym_lookup(TAPE_SAVE);
+	}
+#endif
+#ifdef WANT_BASIC
+	if (o_flag || O_flag)
+		basic_ki = sym_lookup(BASIC_KEY);
+#endif
+#ifdef WANT_TEXT
+	if (X_flag)
+		text_on = text_syms() == 0;
+#endif
+}
+
+/*
+ *	Go on at MAIN-4 of the new ROM, as ERROR-2 and SET-STK of the ROM
+ *	do after a report
+ */
+static void reload_restart(void)
+{
+	int main4, err;
+
+	if ((main4 = sym_lookup(RELOAD_MAIN)) < 0) {
+		printf("reload: %s not in listing, going on at %04x\r\n",
+		       RELOAD_MAIN, PC);
+		return;
+	}
+	err = rd16(RAMTOP) - 3;
+	wr16(err, main4);
+	wr16(ERR_SP, err);
+	wr16(STKEND, rd16(STKBOT));
+	wr16(MEM, MEMBOT);
+	memory[ERR_NR] = 0xff;		/* 0 OK */
+	SP = err + 2;
+	PC = main4;
+	IY = ERR_NR;
+	int_mode = 1;
+	IFF = 3;
+}
+
+/*
+ *	Called by mon() when the CPU stopped for a reload, 0 if the new
+ *	ROM was loaded
+ */
+int reload_rom(void)
+{
+	unsigned long long t0 = now_ns();
+	WORD pc = PC;
+
+	reload_pending = 0;
+	memcpy(save, memory, MEMORY_SIZE);
+	memset(memory, 0, RELOAD_PAGES);
+	if (load_file(xfn)) {
+		memcpy(memory, save, MEMORY_SIZE);
+		PC = pc;
+		fails++;
+		printf("\rreload: %s not loaded, going on with the old ROM\r\n",
+		       xfn);
+		return(1);
+	}
+	memcpy(rom, memory, RELOAD_PAGES);
+	reload_syms();
+
+	if (M_flag == RELOAD_WARM) {
+		reset_system();
+		if (l_flag)		/* the snapshot has the old ROM */
+			memcpy(memory, rom, RELOAD_PAGES);
+	} else {
+		memcpy(memory + RELOAD_PAGES, save + RELOAD_PAGES,
+		       MEMORY_SIZE - RELOAD_PAGES);
+		PC = pc;
+		if (pc < RELOAD_PAGES)
+			reload_restart();
+	}
+	reloads++;
+	printf("\rreload: %s %s in %.1f ms\r\n", xfn,
+	       M_flag == RELOAD_WARM ? "booted" : "swapped",
+	       (now_ns() - t0) / 1e6);
+	return(0);
+}
+
+void reload_init(void)
+{
+#ifdef __linux__
+	char dir[4096];
+#endif
+
+	if (!x_flag) {
+		puts("option -M needs a ROM loaded with -x");
+		exit(1);
+	}
+#ifdef __linux__
+	strcpy(dir, xfn);
+	strcpy(name, basename(dir));
+	strcpy(dir, xfn);
+	if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+	    inotify_add_watch(fd, dirname(dir),
+			      IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		printf("reload: can't watch %s\n", xfn);
+		exit(1);
+	}
+#else
+	if (stat(xfn, &last) != 0) {
+		printf("reload: can't watch %s\n", xfn);
+		exit(1);
+	}
+#endif
+	reload_on = 1;
+}
+
+void reload_exit(void)
+{
+#ifdef __linux__
+	close(fd);
+#endif
+	printf("reload: %s reloaded %lu times", xfn, reloads);
+	if (fails)
+		printf(", %lu times not loaded", fails);
+	putchar('\n');
+}
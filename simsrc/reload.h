@@ -0,0 +1,28 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module reloads the ROM when its file changes.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _RELOAD_H_
+#define _RELOAD_H_
+
+#define RELOAD_ROM	1		/* -M rom, swap the ROM pages only */
+#define RELOAD_WARM	2		/* -M warm, boot the new ROM */
+
+#define RELOAD_PAGES	0x4000		/* size of the ROM, RAM above */
+#define RELOAD_SETTLE	2		/* quiet timer ticks before reloading */
+#define RELOAD_MAIN	"MAIN-4"	/* ROM routine going on after reports */
+
+extern int reload_on;
+extern volatile int reload_pending;
+
+extern void reload_init(void);
+extern void reload_exit(void);
+extern void reload_poll(void);
+extern int reload_rom(void);
+
+#endif
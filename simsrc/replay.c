@@ -0,0 +1,213 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module records and replays the keyboard at exact T-states.
+ *
+ * With option -k file the changes of the keyboard matrix are written
+ * into file with the T-state they happened at, option -K file applies
+ * them again at the same T-states. So that the machine is the same at
+ * these T-states, both count the interrupts in T-states instead of
+ * taking them from the 50 ms timer, fill memory and registers with
+ * the same random values and start counting when the CPU starts, after
+ * booting or loading a snapshot. Recording at unlimited speed would be
+ * too fast to type, it runs at REPLAY_MHZ then. A replay runs at the
+ * speed of option -f, with -f 0 as fast as possible, and stops the CPU
+ * at the T-state the recording ended at; the time it took is printed,
+ * to be used as benchmark. While replaying keys from the terminal and
+ * the SDL window are ignored.
+ *
+ * The file has a header of REPLAY_MAGIC and REPLAY_VERSION, followed
+ * by a record per changed half-row: the T-states since the record
+ * before, times 2, as LEB128 number and a byte with the half-row in
+ * the upper 3 bits and its 5 keys in the lower ones. The session ends
+ * with a record of an odd number and no byte.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "simglb.h"
+#include "kbd.h"
+#include "replay.h"
+
+#define HEADER	(sizeof(REPLAY_MAGIC) - 1 + 1)
+
+int replay_on;				/* T-states are counted */
+int replay_rec;				/* keys are recorded */
+unsigned long long replay_t;		/* T-states since the CPU started */
+unsigned long long replay_next = ~0ULL;	/* T-state of the next change */
+
+static FILE *fp;			/* recording */
+static BYTE rows[8];			/* matrix recorded last */
+static BYTE *buf, *p, *end;		/* replay */
+static int rec;			/* next change replayed, -1 end */
+static int done;			/* end of the replay reached */
+static unsigned long long last_t;	/* T-state of the last record */
+static unsigned long changes;
+static unsigned long long ns_start;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ *	Write a record, b -1 is the end
+ */
+static void put_record(unsigned long long d, int b)
+{
+	d = 2 * d + (b < 0);
+	do {
+		putc((d & 0x7f) | ((d > 0x7f) ? 0x80 : 0), fp);
+		d >>= 7;
+	} while (d);
+	if (b >= 0)
+		putc(b, fp);
+}
+
+/*
+ *	Read the next record to replay
+ */
+static void get_record(void)
+{
+	unsigned long long d = 0;
+	int shift = 0;
+
+	do {
+		if (p >= end || shift > 63)
+			goto bad;
+		d |= (unsigned long long) (*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	if (!(d & 1) && p >= end)
+		goto bad;
+	rec = (d & 1) ? -1 : *p++;
+	replay_next = last_t += d >> 1;
+	return;
+
+bad:
+	printf("\r\nreplay: %s truncated\r\n", Kfn);
+	rec = -1;
+	replay_next = last_t;
+}
+
+/*
+ *	Called by the CPU for every interrupt taken while recording
+ */
+void replay_frame(void)
+{
+	register int i;
+
+	for (i = 0; i < 8; i++)
+		if (kbd_rows[i] != rows[i]) {
+			put_record(replay_t - last_t,
+				   (i << 5) | (kbd_rows[i] & 0x1f));
+			rows[i] = kbd_rows[i];
+			last_t = replay_t;
+			changes++;
+		}
+}
+
+/*
+ *	Called by the CPU when replay_t reaches replay_next
+ */
+void replay_apply(void)
+{
+	while (replay_t >= replay_next) {
+		if (rec < 0) {
+			replay_next = ~0ULL;
+			done = 1;
+			cpu_error = NONE;
+			cpu_state = STOPPED;
+			return;
+		}
+		kbd_rows[rec >> 5] = 0xe0 | (rec & 0x1f);
+		changes++;
+		get_record();
+	}
+}
+
+/*
+ *	Called when the CPU starts, after booting
+ */
+void replay_start(void)
+{
+	int_period = INT_PERIOD;	/* snapshots bring their own */
+	int_tcnt = 0;
+	replay_t = last_t = 0;
+	if (K_flag)
+		get_record();
+	ns_start = now_ns();
+}
+
+void replay_init(void)
+{
+	long n;
+
+	if (K_flag) {
+		if ((fp = fopen(Kfn, "rb")) == NULL) {
+			printf("can't open %s\n", Kfn);
+			exit(1);
+		}
+		fseek(fp, 0L, SEEK_END);
+		n = ftell(fp);
+		rewind(fp);
+		if (n < (long) HEADER || (buf = malloc(n)) == NULL ||
+		    fread(buf, 1, n, fp) != (size_t) n ||
+		    memcmp(buf, REPLAY_MAGIC, HEADER - 1) ||
+		    buf[HEADER - 1] != REPLAY_VERSION) {
+			printf("%s is no key recording of version %d\n", Kfn,
+			       REPLAY_VERSION);
+			exit(1);
+		}
+		fclose(fp);
+		fp = NULL;
+		p = buf + HEADER;
+		end = buf + n;
+	}
+
+	if (k_flag) {
+		if ((fp = fopen(kfn, "wb")) == NULL) {
+			printf("can't create %s\n", kfn);
+			exit(1);
+		}
+		fwrite(REPLAY_MAGIC, 1, HEADER - 1, fp);
+		putc(REPLAY_VERSION, fp);
+		memset(rows, 0xff, sizeof(rows));
+		replay_rec = 1;
+		if (f_flag == 0) {	/* to be able to type */
+			f_flag = REPLAY_MHZ;
+			tmax = f_flag * 10000;
+			printf("Recording keys at %d MHz\n", f_flag);
+		}
+	}
+	replay_on = 1;
+}
+
+void replay_exit(void)
+{
+	unsigned long long ns = now_ns() - ns_start;
+
+	if (fp != NULL) {
+		put_record(replay_t - last_t, -1);
+		fclose(fp);
+		printf("replay: %lu key changes in %llu T-states recorded "
+		       "into %s\n", changes, replay_t, kfn);
+	}
+	if (K_flag) {
+		printf("replay: %lu key changes in %llu T-states, %.3f s, "
+		       "%.1f MHz\n", changes, replay_t, ns / 1e9,
+		       ns ? replay_t * 1000.0 / ns : 0.0);
+		if (!done)
+			printf("replay: stopped before the end of %s\n", Kfn);
+		free(buf);
+	}
+}
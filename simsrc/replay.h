@@ -0,0 +1,27 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module records and replays the keyboard at exact T-states.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#define REPLAY_MAGIC	"NSPCKEYS"
+#define REPLAY_VERSION	1
+#define REPLAY_SEED	1		/* random memory and registers */
+#define REPLAY_MHZ	4		/* recording speed if unlimited */
+
+extern int replay_on, replay_rec;
+extern unsigned long long replay_t, replay_next;
+
+extern void replay_init(void);
+extern void replay_start(void);
+extern void replay_exit(void);
+extern void replay_frame(void);
+extern void replay_apply(void);
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module keeps a ring of checkpoints to rewind the machine.
+ *
+ * With option -R frames[:MB] a checkpoint of the CPU, LCD and I/O
+ * state (see snap.c), the memory and the LCD GRAM is taken every
+ * frames interrupts. Only the newest checkpoint is kept as a whole,
+ * each older one as delta to the next newer one: the XOR of both in
+ * 64 bit words, packed as records of two 16 bit counts, equal words
+ * to skip and words that differ, followed by the XOR of the latter.
+ * Going back is XOR'ing the deltas into a copy of the newest one in
+ * turn, the oldest deltas are freed when the deltas would take more
+ * than MB megabytes.
+ *
+ * SIGUSR2 rewinds the machine at the next interrupt to the newest
+ * checkpoint, sent again before the next checkpoint is taken it goes
+ * one checkpoint further back. The checkpoints newer than that are
+ * dropped and the run goes on from there, so the same frames are run
+ * again.
+ *
+ * On exit the number of checkpoints, memory used and the time spent
+ * for taking them, against the time of the run, are printed.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "lcd.h"
+#include "snap.h"
+#include "rewind.h"
+
+struct ckpt {
+	BYTE *delta;			/* to the next newer checkpoint */
+	size_t size;
+	unsigned long frame;
+};
+
+static struct ckpt ring[REWIND_MAX];
+static int first, nring;		/* oldest delta, no. of deltas */
+static size_t used, budget;		/* bytes of the deltas */
+static BYTE *cur, *work, *pack;		/* newest checkpoint, scratch */
+static size_t isize;			/* size of a checkpoint */
+static unsigned long every;		/* frames between checkpoints */
+static unsigned long frames, since;	/* frames run, since checkpoint */
+static unsigned long cur_frame;		/* frame of the newest one */
+static int back;			/* SIGUSR2 since last frame */
+static int again;			/* rewound, no checkpoint since */
+static unsigned long long taken, ns_taken, ns_start;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void usr2_int(int sig)
+{
+	sig = sig;	/* to avoid compiler warning */
+
+	__atomic_add_fetch(&back, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ *	Pack the delta of n bytes at new to old into out and update
+ *	old, n is a multiple of 8 and below 512K, returns the size
+ */
+static size_t delta_pack(const BYTE *new, BYTE *old, size_t n, BYTE *out)
+{
+	unsigned long long a, b;
+	size_t words = n / 8, i = 0, start;
+	BYTE *o = out, *rec;
+
+	while (i < words) {
+		rec = o;
+		o += 4;
+		for (start = i; i < words; i++)
+			if (memcmp(new + 8 * i, old + 8 * i, 8))
+				break;
+		rec[0] = (i - start) & 0xff;
+		rec[1] = (i - start) >> 8;
+		for (start = i; i < words; i++) {
+			memcpy(&a, new + 8 * i, 8);
+			memcpy(&b, old + 8 * i, 8);
+			if (a == b)
+				break;
+			b ^= a;
+			memcpy(o, &b, 8);
+			memcpy(old + 8 * i, &a, 8);
+			o += 8;
+		}
+		rec[2] = (i - start) & 0xff;
+		rec[3] = (i - start) >> 8;
+	}
+	return(o - out);
+}
+
+/*
+ *	XOR the delta d into n bytes at buf, returns the size of
+ *	the delta
+ */
+static size_t delta_apply(const BYTE *d, BYTE *buf, size_t n)
+{
+	const BYTE *p = d;
+	unsigned long long a, b;
+	size_t words = n / 8, i = 0, run;
+
+	while (i < words) {
+		i += p[0] | (p[1] << 8);
+		run = p[2] | (p[3] << 8);
+		p += 4;
+		for (; run > 0; run--, i++, p += 8) {
+			memcpy(&a, buf + 8 * i, 8);
+			memcpy(&b, p, 8);
+			a ^= b;
+			memcpy(buf + 8 * i, &a, 8);
+		}
+	}
+	return(p - d);
+}
+
+/*
+ *	Take a checkpoint, the newest goes into cur, the delta from it
+ *	to the one before into the ring
+ */
+static void rewind_take(void)
+{
+	BYTE state[SNAP_STATE];
+	BYTE *gram;
+	size_t n;
+	int i, dummy;
+	unsigned long long t0 = now_ns();
+
+	again = 0;
+	if ((gram = il9341_gram(&dummy)) == NULL)
+		return;			/* no LCD yet */
+	snap_state_get(state);
+	if (taken++ == 0) {
+		memcpy(cur, state, SNAP_STATE);
+		memcpy(cur + SNAP_STATE, mem_base(), MEMORY_SIZE);
+		memcpy(cur + SNAP_STATE + MEMORY_SIZE, gram, LCD_GRAM);
+		cur_frame = frames;
+		ns_taken += now_ns() - t0;
+		return;
+	}
+
+	n = delta_pack(state, cur, SNAP_STATE, pack);
+	n += delta_pack(mem_base(), cur + SNAP_STATE, MEMORY_SIZE, pack + n);
+	n += delta_pack(gram, cur + SNAP_STATE + MEMORY_SIZE, LCD_GRAM,
+			pack + n);
+
+	while (nring > 0 && (used + n > budget || nring == REWIND_MAX)) {
+		free(ring[first].delta);	/* drop the oldest */
+		used -= ring[first].size;
+		first = (first + 1) % REWIND_MAX;
+		nring--;
+	}
+	if (n <= budget && (ring[i = (first + nring) % REWIND_MAX].delta =
+			    malloc(n)) != NULL) {
+		memcpy(ring[i].delta, pack, n);
+		ring[i].size = n;
+		ring[i].frame = cur_frame;
+		used += n;
+		nring++;
+	}
+	cur_frame = frames;
+	ns_taken += now_ns() - t0;
+}
+
+/*
+ *	Rewind to the n'th newest checkpoint
+ */
+static void rewind_restore(int n)
+{
+	struct ckpt *c;
+	BYTE *p;
+	int dummy;
+
+	memcpy(work, cur, isize);
+	while (--n > 0 && nring > 0) {
+		c = &ring[(first + nring - 1) % REWIND_MAX];
+		p = c->delta;
+		p += delta_apply(p, work, SNAP_STATE);
+		p += delta_apply(p, work + SNAP_STATE, MEMORY_SIZE);
+		delta_apply(p, work + SNAP_STATE + MEMORY_SIZE, LCD_GRAM);
+		cur_frame = c->frame;
+		free(c->delta);
+		used -= c->size;
+		nring--;
+	}
+	p = cur;			/* the restored one is the newest */
+	cur = work;
+	work = p;
+
+	snap_state_set(cur, SNAP_STATE);
+	memcpy(mem_base(), cur + SNAP_STATE, MEMORY_SIZE);
+	memcpy(il9341_gram(&dummy), cur + SNAP_STATE + MEMORY_SIZE,
+	       LCD_GRAM);
+	printf("\r\nrewind: back %lu frames to frame %lu\r\n",
+	       frames - cur_frame, cur_frame);
+	frames = cur_frame;
+	since = 0;
+	again = 1;
+}
+
+/*
+ *	Called by the CPU for every interrupt taken
+ */
+void rewind_frame(void)
+{
+	int n;
+
+	frames++;
+	if (back && (n = __atomic_exchange_n(&back, 0, __ATOMIC_RELAXED))) {
+		if (taken)
+			rewind_restore(n + again);
+		return;
+	}
+	if (++since >= every) {
+		since = 0;
+		rewind_take();
+	}
+}
+
+void rewind_init(void)
+{
+	static struct sigaction newact;
+	char *s;
+	double mb = REWIND_MB;
+
+	every = strtoul(rsp, &s, 10);
+	if (*s == ':')
+		mb = atof(s + 1);
+	else if (*s != '\0')
+		every = 0;
+	if (every == 0 || mb <= 0.0) {
+		printf("bad rewind %s, expected frames[:MB]\n", rsp);
+		exit(1);
+	}
+	budget = mb * 1024 * 1024;
+
+	isize = SNAP_STATE + MEMORY_SIZE + LCD_GRAM;
+	cur = malloc(isize);
+	work = malloc(isize);
+	pack = malloc(2 * isize);
+	if (cur == NULL || work == NULL || pack == NULL) {
+		puts("out of memory for rewind");
+		exit(1);
+	}
+
+	newact.sa_handler = usr2_int;
+	memset((void *) &newact.sa_mask, 0, sizeof(newact.sa_mask));
+	newact.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &newact, NULL);
+	ns_start = now_ns();
+}
+
+void rewind_exit(void)
+{
+	unsigned long long ns = now_ns() - ns_start;
+
+	signal(SIGUSR2, SIG_IGN);
+	printf("rewind: %llu checkpoints every %lu frames, %d kept, "
+	       "%zu KB of %zu KB\n", taken, every, taken ? nring + 1 : 0,
+	       used / 1024, budget / 1024);
+	printf("rewind: %.1f us per checkpoint, %.2f%% of %.1f s run time\n",
+	       taken ? ns_taken / 1000.0 / taken : 0.0,
+	       ns ? 100.0 * ns_taken / ns : 0.0, ns / 1e9);
+}
@@ -0,0 +1,21 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module keeps a ring of checkpoints to rewind the machine.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#define REWIND_FRAMES	50		/* default frames between checkpoints */
+#define REWIND_MB	64		/* default memory for the deltas */
+#define REWIND_MAX	65536		/* max. checkpoints kept */
+
+extern void rewind_init(void);
+extern void rewind_exit(void);
+extern void rewind_frame(void);
+
+#endif
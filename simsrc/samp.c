@@ -0,0 +1,290 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements a statistical profiler driven by a host timer.
+ *
+ * A POSIX timer on the CPU time of the thread running the CPU sends
+ * SIGPROF SAMP_HZ times a second of that time. While the thread
+ * sleeps to keep the speed of option -f the timer stands still, so
+ * the sleep isn't cut short and the speed is kept. The handler
+ * records the emulated PC and the return addresses found on the
+ * emulated stack into a lock-free ring, the CPU emulation itself is
+ * not touched at all. The ring is drained and aggregated per label
+ * when a report is written, on exit and on SIGUSR1.
+ *
+ * Return addresses are found heuristically: a word on the stack is
+ * taken as return address if the bytes in front of it are a CALL
+ * or a RST op-code.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "samp.h"
+
+#define SAMP_HZ		997	/* sample rate, prime to not beat with INT */
+#define SAMP_RING	4096	/* samples in the ring, power of 2 */
+#define SAMP_DEPTH	16	/* max. return addresses per sample */
+#define SAMP_SCAN	64	/* max. stack words to scan */
+#define SAMP_STACKS	16384	/* distinct stacks aggregated, power of 2 */
+
+extern void usr1_register(void (*)(void));
+
+struct sample {
+	WORD pc;			/* emulated PC */
+	BYTE depth;			/* return addresses found */
+	WORD ret[SAMP_DEPTH];		/* innermost first */
+};
+
+struct stack {
+	unsigned long count;		/* samples with this stack */
+	BYTE depth;			/* routines in key, outermost first */
+	WORD key[SAMP_DEPTH + 1];
+};
+
+static struct sample ring[SAMP_RING];
+static unsigned int head;		/* written by signal handler only */
+static unsigned int tail;		/* written by drain only */
+static unsigned long dropped;		/* samples lost, ring was full */
+
+static unsigned long total;		/* samples aggregated */
+static unsigned long self[65536];	/* samples per routine, PC in it */
+static unsigned long incl[65536];	/* samples per routine on stack */
+static struct stack *stacks;
+static unsigned long other;		/* samples not fitting into stacks */
+static timer_t timer;
+static pthread_mutex_t samp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static WORD samp_key(WORD addr)
+{
+	int i = sym_find(addr);
+
+	return((i < 0) ? addr : sym_addr(i));
+}
+
+/*
+ *	Check if addr on the stack is the return address of a CALL or RST
+ */
+static int is_ret(WORD addr)
+{
+	register BYTE op;
+
+	if (addr < 3 || addr >= MEMORY_SIZE)
+		return(0);
+	op = memory[addr - 3];
+	if (op == 0xcd || (op & 0xc7) == 0xc4)
+		return(1);
+	return((memory[addr - 1] & 0xc7) == 0xc7);
+}
+
+/*
+ *	SIGPROF handler, only producer of the ring
+ */
+static void samp_tick(int sig)
+{
+	register struct sample *s;
+	register unsigned int h, i;
+	WORD a, ret;
+
+	sig = sig;	/* to avoid compiler warning */
+
+	h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == SAMP_RING) {
+		dropped++;
+		return;
+	}
+	s = &ring[h & (SAMP_RING - 1)];
+	s->pc = PC;
+	s->depth = 0;
+	a = SP;
+	for (i = 0; i < SAMP_SCAN && s->depth < SAMP_DEPTH; i++, a += 2) {
+		if (a >= MEMORY_SIZE - 1)
+			break;
+		ret = memory[a] + (memory[a + 1] << 8);
+		if (is_ret(ret))
+			s->ret[s->depth++] = ret;
+	}
+	__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ *	Add one sample to the collapsed stacks
+ */
+static void samp_stack(WORD *key, int depth)
+{
+	register struct stack *st;
+	register unsigned int h = 2166136261U;
+	register int i, n;
+
+	for (i = 0; i < depth; i++)
+		h = (h ^ key[i]) * 16777619U;
+	for (n = 0; n < SAMP_STACKS; n++) {
+		st = &stacks[(h + n) & (SAMP_STACKS - 1)];
+		if (st->count == 0) {
+			st->depth = depth;
+			memcpy(st->key, key, depth * sizeof(WORD));
+		} else if (st->depth != depth ||
+			   memcmp(st->key, key, depth * sizeof(WORD)) != 0)
+			continue;
+		st->count++;
+		return;
+	}
+	other++;
+}
+
+/*
+ *	Move the samples from the ring into the tables
+ */
+static void samp_drain(void)
+{
+	register struct sample *s;
+	register int i, j, n;
+	unsigned int t, h;
+	WORD key[SAMP_DEPTH + 1];
+
+	t = tail;
+	h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	for (; t != h; t++) {
+		s = &ring[t & (SAMP_RING - 1)];
+		n = 0;
+		for (i = s->depth - 1; i >= 0; i--)
+			key[n++] = samp_key(s->ret[i] - 1);
+		key[n++] = samp_key(s->pc);
+		total++;
+		self[key[n - 1]]++;
+		/* count routines only once for recursion */
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < i; j++)
+				if (key[j] == key[i])
+					break;
+			if (j == i)
+				incl[key[i]]++;
+		}
+		samp_stack(key, n);
+		__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+	}
+}
+
+static int samp_cmp(const void *a, const void *b)
+{
+	WORD x = *(const WORD *) a, y = *(const WORD *) b;
+
+	if (self[x] != self[y])
+		return((self[x] < self[y]) ? 1 : -1);
+	if (incl[x] != incl[y])
+		return((incl[x] < incl[y]) ? 1 : -1);
+	return(x - y);
+}
+
+/*
+ *	Write the report into sfn and the stacks into sfn.folded
+ */
+static void samp_report(void)
+{
+	static WORD keys[65536];
+	FILE *fp;
+	char fn[4096 + 8];
+	char buf[SYM_NAMELEN + 8];
+	register int i, j;
+	int n = 0;
+
+	pthread_mutex_lock(&samp_lock);
+	samp_drain();
+
+	if ((fp = fopen(sfn, "w")) == NULL) {
+		printf("can't open file %s\n", sfn);
+		pthread_mutex_unlock(&samp_lock);
+		return;
+	}
+	for (i = 0; i < 65536; i++)
+		if (incl[i])
+			keys[n++] = i;
+	qsort(keys, n, sizeof(WORD), samp_cmp);
+	fprintf(fp, "Sampling profile, %lu samples at %d Hz, %lu dropped\n\n",
+		total, SAMP_HZ, dropped);
+	fprintf(fp, " %%self  %%incl       self       incl  routine\n");
+	for (i = 0; i < n; i++)
+		fprintf(fp, "%6.2f %6.2f %10lu %10lu  %s\n",
+			100.0 * self[keys[i]] / total,
+			100.0 * incl[keys[i]] / total,
+			self[keys[i]], incl[keys[i]],
+			sym_label(keys[i], buf));
+	fclose(fp);
+
+	strcpy(fn, sfn);
+	strcat(fn, ".folded");
+	if ((fp = fopen(fn, "w")) == NULL) {
+		printf("can't open file %s\n", fn);
+		pthread_mutex_unlock(&samp_lock);
+		return;
+	}
+	for (i = 0; i < SAMP_STACKS; i++) {
+		if (stacks[i].count == 0)
+			continue;
+		fputs("(top)", fp);
+		for (j = 0; j < stacks[i].depth; j++)
+			fprintf(fp, ";%s", sym_label(stacks[i].key[j], buf));
+		fprintf(fp, " %lu\n", stacks[i].count);
+	}
+	if (other)
+		fprintf(fp, "(top);(other) %lu\n", other);
+	fclose(fp);
+	pthread_mutex_unlock(&samp_lock);
+}
+
+/*
+ *	Start sampling
+ */
+void samp_init(void)
+{
+	static struct sigaction newact;
+	struct sigevent sev;
+	struct itimerspec its;
+	clockid_t clock;
+
+	stacks = calloc(SAMP_STACKS, sizeof(struct stack));
+	if (stacks == NULL) {
+		puts("out of memory for sampling profiler");
+		exit(1);
+	}
+
+	newact.sa_handler = samp_tick;
+	memset((void *) &newact.sa_mask, 0, sizeof(newact.sa_mask));
+	newact.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &newact, NULL);
+
+	memset((void *) &sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGPROF;
+	if (pthread_getcpuclockid(pthread_self(), &clock) != 0 ||
+	    timer_create(clock, &sev, &timer) == -1) {
+		perror("timer_create");
+		exit(1);
+	}
+	its.it_value.tv_sec = 0;
+	its.it_value.tv_nsec = 1000000000L / SAMP_HZ;
+	its.it_interval = its.it_value;
+	timer_settime(timer, 0, &its, NULL);
+
+	usr1_register(samp_report);
+}
+
+/*
+ *	Stop sampling and write the final report
+ */
+void samp_exit(void)
+{
+	timer_delete(timer);
+	signal(SIGPROF, SIG_IGN);
+	samp_report();
+}
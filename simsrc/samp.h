@@ -0,0 +1,16 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module implements a statistical profiler driven by a host timer.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _SAMP_H_
+#define _SAMP_H_
+
+extern void samp_init(void);
+extern void samp_exit(void);
+
+#endif
@@ -47,9 +47,31 @@
  *	by user for her/his own purpose.
  */
 #define CPU_SPEED 0	/* default CPU speed 0=unlimited */
+#define INT_PERIOD 69888 /* T-states per 50 Hz frame at 3.5 MHz */
 #define Z80_UNDOC	/* compile undocumented Z80 instructions */
 #define WANT_FASTM	/* much faster but not accurate Z80 block moves */
 /*#define WANT_TIM*/	/* don't count t-states */
+#define WANT_PROF	/* exact per-PC profiler, enabled with -P */
+#define WANT_SAMP	/* sampling profiler, enabled with -S */
+#define WANT_COVER	/* ROM code coverage, enabled with -c */
+/*#define WANT_HEAT*/	/* no data access heatmap, else enabled with -H */
+#define WANT_STATS	/* runtime statistics, enabled with -T */
+#define WANT_BENCH	/* A/B ROM benchmark with -B, needs WANT_STATS */
+#define WANT_SWEEP	/* clock/wait state sweep with -W, needs WANT_BENCH */
+#define WANT_FLEET	/* corpus runner with -F, needs WANT_BENCH */
+#define WANT_BUDGET	/* T-state budgets of routines, enabled with -G */
+#define WANT_INTLAT	/* interrupt latency and DI regions, enabled with -L */
+#define WANT_MACHINE	/* machine API, one machine per thread, needs WANT_BENCH */
+#define WANT_EXPLORE	/* branches with keystrokes with -E, needs WANT_MACHINE
+			   and WANT_FLEET */
+#define WANT_REWIND	/* ring of checkpoints with -R, SIGUSR2 rewinds */
+#define WANT_WARM	/* boot snapshots cached with -C, needs WANT_BENCH */
+#define WANT_TAPE	/* TAP/TZX tape with -t, EAR signal with -e */
+#define WANT_BEEP	/* beeper sound with -a, into a WAV file with -A */
+#define WANT_REPLAY	/* keys recorded with -k, replayed with -K */
+#define WANT_BASIC	/* BASIC text loaded with -o, pasted with -O */
+#define WANT_TEXT	/* text on the screen, written per frame with -X */
+#define WANT_RELOAD	/* ROM reloaded when its file changes with -M */
 /*#define HISIZE  1000*//* no history */
 /*#define SBSIZE  10*/	/* no breakpoints */
 /*#define FRONTPANEL*/	/* no frontpanel emulation */
@@ -137,6 +159,12 @@ typedef unsigned short WORD;		/* 16 bit unsigned */
 typedef signed short   SWORD;		/* 16 bit signed */
 typedef unsigned char  BYTE;		/* 8 bit unsigned */
 
+#ifdef WANT_MACHINE
+#define MSTATE	__thread		/* machine state is per thread */
+#else
+#define MSTATE
+#endif
+
 #ifdef HISIZE
 struct history {			/* structure of a history entry */
 	WORD	h_adr;			/* address of execution */
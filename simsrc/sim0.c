@@ -67,23 +67,80 @@
 //ashwinm #include "../../frontpanel/frontpanel.h"
 #include "memory.h"
 #include "lcd_emu.h"
+#include "lcd.h"
+#include "symtab.h"
+#include "snap.h"
+#ifdef WANT_PROF
+#include "prof.h"
+#endif
+#ifdef WANT_SAMP
+#include "samp.h"
+#endif
+#ifdef WANT_COVER
+#include "cover.h"
+#endif
+#ifdef WANT_HEAT
+#include "heat.h"
+#endif
+#ifdef WANT_STATS
+#include "stats.h"
+#endif
+#ifdef WANT_BENCH
+#include "bench.h"
+#endif
+#ifdef WANT_SWEEP
+#include "sweep.h"
+#endif
+#ifdef WANT_FLEET
+#include "fleet.h"
+#endif
+#ifdef WANT_EXPLORE
+#include "explore.h"
+#endif
+#ifdef WANT_BUDGET
+#include "budget.h"
+#endif
+#ifdef WANT_INTLAT
+#include "intlat.h"
+#endif
+#ifdef WANT_REWIND
+#include "rewind.h"
+#endif
+#ifdef WANT_TAPE
+#include "tape.h"
+#endif
+#ifdef WANT_BEEP
+#include "beep.h"
+#endif
+#ifdef WANT_REPLAY
+#include "replay.h"
+#endif
+#ifdef WANT_BASIC
+#include "basic.h"
+#endif
+#ifdef WANT_TEXT
+#include "text.h"
+#endif
+#ifdef WANT_RELOAD
+#include "reload.h"
+#endif
 
 #define BUFSIZE	256		/* buffer size for file I/O */
 
 static void init_cpu(void);
-int load_core(void);
-static void save_core(void);
 static int load_mos(int, char *), load_hex(char *), checksum(char *);
+void load_symbols(void);
 extern void int_on(void), int_off(void), mon(void);
 extern void init_io(void), exit_io(void);
 extern int exatoi(char *);
 
-BYTE *wrk_ram;			/* work pointer for the memory */
+MSTATE BYTE *wrk_ram;		/* work pointer for the memory */
 
 int main(int argc, char *argv[])
 {
 	register char *s, *p;
 	register int i;
+	int rc = 0;
 	char *pn = basename(argv[0]);
 	struct timeval tv;
 #ifdef HAS_CONFIG
@@ -111,6 +168,23 @@ int main(int argc, char *argv[])
 				l_flag = 1;
 				break;
 
+			case 'I':	/* load snapshot from file */
+				l_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = nfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
 			case 'u':	/* trap undocumented ops */
 				u_flag = 1;
 				break;
@@ -163,6 +237,470 @@ int main(int argc, char *argv[])
 				s--;
 				break;
 
+			case 'y':	/* get filename of listing with labels */
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = yfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+#ifdef WANT_PROF
+			case 'P':	/* profile execution into file */
+				p_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = pfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_SAMP
+			case 'S':	/* sample execution into file */
+				S_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = sfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_COVER
+			case 'c':	/* record ROM coverage into file */
+				c_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = cfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_HEAT
+			case 'H':	/* count data accesses into files */
+				H_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = hfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_STATS
+			case 'T':	/* runtime statistics, JSON to fd */
+				T_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				tfd = atoi(s);
+				while (*s)
+					s++;
+				s--;
+				break;
+#endif
+
+#ifdef WANT_BENCH
+			case 'B':	/* benchmark ROM against -x ROM */
+				B_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = bfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+			case 'b':	/* regression threshold in % */
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				bench_pct = atof(s);
+				while (*s)
+					s++;
+				s--;
+				break;
+#endif
+
+#ifdef WANT_SWEEP
+			case 'W':	/* sweep clocks and LCD wait states */
+				W_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = wsp;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+			case 'w':	/* CSV file of the sweep */
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = wfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_FLEET
+			case 'F':	/* run corpus of programs */
+				F_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = ffn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_EXPLORE
+			case 'E':	/* run branches of the booted ROM */
+				E_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = efn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_BUDGET
+			case 'G':	/* check T-state budgets in file */
+				G_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = gfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_INTLAT
+			case 'L':	/* interrupt latency report into file */
+				L_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = lfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_REWIND
+			case 'R':	/* checkpoints to rewind */
+				R_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = rsp;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_WARM
+			case 'C':	/* cache of boot snapshots */
+				C_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = cdir;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_TAPE
+			case 't':	/* insert tape file */
+				tp_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = tpfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+			case 'e':	/* play tape on EAR bit */
+				e_flag = 1;
+				break;
+#endif
+
+#ifdef WANT_BEEP
+			case 'a':	/* play beeper */
+				a_flag = 1;
+				break;
+
+			case 'A':	/* write beeper into WAV file */
+				A_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = afn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_REPLAY
+			case 'k':	/* record keys into file */
+				k_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = kfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+			case 'K':	/* replay keys from file */
+				K_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = Kfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_BASIC
+			case 'o':	/* load BASIC program */
+				o_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = ofn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+
+			case 'O':	/* paste BASIC lines */
+				O_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = Ofn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+
+#ifdef WANT_TEXT
+			case 'X':	/* write screen text per frame */
+				X_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				p = Xfn;
+				while (*s)
+					*p++ = *s++;
+				*p = '\0';
+				s--;
+				break;
+#endif
+#ifdef WANT_RELOAD
+			case 'M':	/* reload the ROM when it changes */
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				if (strcmp(s, "rom") == 0)
+					M_flag = RELOAD_ROM;
+				else if (strcmp(s, "warm") == 0)
+					M_flag = RELOAD_WARM;
+				else
+					goto usage;
+				s += strlen(s) - 1;
+				break;
+#endif
+
+			case 'D':	/* LCD controller */
+				D_flag = 1;
+				s++;
+				if (*s == '\0') {
+					if (argc <= 1)
+						goto usage;
+					argc--;
+					argv++;
+					s = argv[0];
+				}
+				if (lcd_select(s))
+					goto usage;
+				s += strlen(s) - 1;
+				break;
+
 #ifdef BOOTROM
 			case 'r':	/* load default boot ROM */
 				x_flag = 1;
@@ -206,14 +744,16 @@ int main(int argc, char *argv[])
 usage:
 
 #ifdef HAS_DISKS
-				printf("usage:\t%s -z -8 -s -l -i -u %s-m val -f freq -x filename -d diskpath\n", pn, rom);
+				printf("usage:\t%s -z -8 -s -l -I file -i -u %s-m val -f freq -x filename -y listing -P file -S file -c file -H file -T fd -B file -b pct -W mhz:wait -w file -F corpus -E file -G file -L file -R frames[:MB] -C dir -t tape -e -a -A file -k file -K file -o file -O file -X file -M rom|warm -D lcd -d diskpath\n", pn, rom);
 #else
-				printf("usage:\t%s -z -8 -s -l -i -u %s-m val -f freq -x filename\n", pn, rom);
+				printf("usage:\t%s -z -8 -s -l -I file -i -u %s-m val -f freq -x filename -y listing -P file -S file -c file -H file -T fd -B file -b pct -W mhz:wait -w file -F corpus -E file -G file -L file -R frames[:MB] -C dir -t tape -e -a -A file -k file -K file -o file -O file -X file -M rom|warm -D lcd\n", pn, rom);
 #endif
 				puts("\t-z = emulate Zilog Z80");
 				puts("\t-8 = emulate Intel 8080");
-				puts("\t-s = save core and CPU");
-				puts("\t-l = load core and CPU");
+				puts("\t-s = save core and CPU into " SNAP_FILE);
+				puts("\t-l = load core and CPU from " SNAP_FILE);
+				puts("\t-I = load core and CPU from snapshot file,");
+				puts("\t     " SNAP_FILE " format, .sna or .z80");
 				puts("\t-i = trap on I/O to unused ports");
 				puts("\t-u = trap on undocumented instructions");
 #ifdef BOOTROM
@@ -223,6 +763,92 @@ usage:
 				puts("\t-m = init memory with val (00-FF)");
 				puts("\t-f = CPU clock frequency freq in MHz");
 				puts("\t-x = load and execute filename");
+				puts("\t-y = load labels from assembler listing,");
+				puts("\t     default is filename with extension .lst");
+#ifdef WANT_PROF
+				puts("\t-P = profile execution, write report into file");
+				puts("\t     and collapsed stacks into file.folded");
+#endif
+#ifdef WANT_SAMP
+				puts("\t-S = sample execution, write report into file");
+				puts("\t     and file.folded on exit and on SIGUSR1");
+#endif
+#ifdef WANT_COVER
+				puts("\t-c = merge ROM coverage into file, write");
+				puts("\t     annotated listing file.lst and file.txt");
+#endif
+#ifdef WANT_HEAT
+				puts("\t-H = count data accesses, write heatmap file.ppm");
+				puts("\t     and tables file.csv and file.pc.csv");
+#endif
+#ifdef WANT_STATS
+				puts("\t-T = runtime statistics in shared memory");
+				puts("\t     /newspec-pid and as JSON lines to fd,");
+				puts("\t     summary on SIGUSR1 and exit, fd 0 = no JSON");
+#endif
+#ifdef WANT_BENCH
+				puts("\t-B = benchmark screen operations of the -x ROM");
+				puts("\t     against ROM file, both need a listing");
+				puts("\t-b = fail if B is pct % slower, default 1.0");
+#endif
+#ifdef WANT_SWEEP
+				puts("\t-W = run the benchmark of the -x ROM for the clocks");
+				puts("\t     and LCD wait states mhz,...[:wait,...]");
+				puts("\t     from the snapshot of -l or -I if given");
+				puts("\t-w = write the results of -W as CSV into file");
+#endif
+#ifdef WANT_FLEET
+				puts("\t-F = run the programs in corpus on the -x ROM on");
+				puts("\t     all cores, compare LCD hashes with golden ones");
+#endif
+#ifdef WANT_EXPLORE
+				puts("\t-E = fork the booted -x ROM into the branches in");
+				puts("\t     file, type their keys, compare LCD hashes");
+#endif
+#ifdef WANT_BUDGET
+				puts("\t-G = check T-state budgets of the routines in");
+				puts("\t     file, exit with 1 if one is exceeded");
+#endif
+#ifdef WANT_INTLAT
+				puts("\t-L = measure interrupt latency and DI regions,");
+				puts("\t     write report into file");
+#endif
+#ifdef WANT_REWIND
+				puts("\t-R = checkpoint every frames interrupts, keep");
+				puts("\t     deltas of up to MB, rewind on SIGUSR2");
+#endif
+#ifdef WANT_WARM
+				puts("\t-C = start the -x ROM from a snapshot after boot");
+				puts("\t     cached in dir, boot and cache it if none");
+#endif
+#ifdef WANT_TAPE
+				puts("\t-t = insert TAP or TZX tape, LOAD is instant,");
+				puts("\t     SAVE appends to it");
+				puts("\t-e = play the -t tape on the EAR bit instead");
+#endif
+#ifdef WANT_BEEP
+				puts("\t-a = play the beeper with SDL audio");
+				puts("\t-A = write the beeper into WAV file");
+#endif
+#ifdef WANT_REPLAY
+				puts("\t-k = record the keys at their T-states into file");
+				puts("\t-K = replay the keys of file, stop at its end");
+#endif
+#ifdef WANT_BASIC
+				puts("\t-o = load the BASIC program listed in file");
+				puts("\t-O = paste the lines of file into the editor");
+#endif
+#ifdef WANT_TEXT
+				puts("\t-X = write the text on the screen into file");
+				puts("\t     at every frame it changed in");
+#endif
+#ifdef WANT_RELOAD
+				puts("\t-M = reload the -x ROM when it changes, rom swaps");
+				puts("\t     the ROM only, warm boots again");
+#endif
+				puts("\t-D = emulate LCD controller lcd, print commands");
+				puts("\t     and bytes per frame at the end, lcd one of:");
+				lcd_list();
 #ifdef HAS_DISKS
 				puts("\t-d = use disks images at diskpath");
 				puts("\t     default path for disk images:");
@@ -283,6 +909,10 @@ puts(" #####    ###     #####    ###            #####    ###   #     #");
 
 	/* seed random generator */
 	gettimeofday(&tv, NULL);
+#ifdef WANT_REPLAY
+	if (k_flag || K_flag)	/* same memory and registers */
+		tv.tv_sec = REPLAY_SEED;
+#endif
 	srand(tv.tv_sec);
 
 	config();		/* read system configuration */
@@ -300,10 +930,113 @@ puts(" #####    ###     #####    ###            #####    ###   #     #");
 	}
 
 	init_rom();		/* initialise ROM's */
+	load_symbols();		/* labels for reports */
+
+#ifdef WANT_PROF
+	if (p_flag)		/* start profiler */
+		prof_init();
+#endif
+#ifdef WANT_SAMP
+	if (S_flag)		/* start sampling profiler */
+		samp_init();
+#endif
+#ifdef WANT_COVER
+	if (c_flag)		/* load coverage of earlier runs */
+		cover_init();
+#endif
+#ifdef WANT_HEAT
+	if (H_flag)		/* start counting data accesses */
+		heat_init();
+#endif
+#ifdef WANT_STATS
+	if (T_flag)		/* start runtime statistics */
+		stats_init();
+#endif
+#ifdef WANT_BUDGET
+	if (G_flag)		/* read T-state budgets */
+		budget_init();
+#endif
+#ifdef WANT_INTLAT
+	if (L_flag)		/* start measuring interrupt latency */
+		intlat_init();
+#endif
+#ifdef WANT_REWIND
+	if (R_flag)		/* start taking checkpoints */
+		rewind_init();
+#endif
+#ifdef WANT_TAPE
+	if (tp_flag)		/* insert the tape */
+		tape_init();
+#endif
+#ifdef WANT_BEEP
+	if (a_flag || A_flag)	/* start the beeper sound */
+		beep_init();
+#endif
+#ifdef WANT_REPLAY
+	if (k_flag || K_flag)	/* record or replay the keys */
+		replay_init();
+#endif
+#ifdef WANT_BASIC
+	if (o_flag || O_flag)	/* tokenize the BASIC text */
+		basic_init();
+#endif
+#ifdef WANT_TEXT
+	if (X_flag)		/* trap the character output */
+		text_init();
+#endif
+#ifdef WANT_RELOAD
+	if (M_flag)		/* watch the ROM file */
+		reload_init();
+#endif
+
+#ifdef WANT_BENCH
+	if (B_flag) {		/* A/B benchmark instead of a session */
+		if (!x_flag) {
+			puts("option -B needs a ROM loaded with -x");
+			return(1);
+		}
+		i = bench_run();
+#ifdef WANT_BUDGET
+		if (G_flag && budget_fail)
+			i = 1;
+#endif
+		return(i);
+	}
+#endif
+#ifdef WANT_SWEEP
+	if (W_flag) {		/* parameter sweep instead of a session */
+		if (!x_flag) {
+			puts("option -W needs a ROM loaded with -x");
+			return(1);
+		}
+		return(sweep_run());
+	}
+#endif
+#ifdef WANT_FLEET
+	if (F_flag) {		/* corpus run instead of a session */
+		if (!x_flag) {
+			puts("option -F needs a ROM loaded with -x");
+			return(1);
+		}
+		return(fleet_run());
+	}
+#endif
+#ifdef WANT_EXPLORE
+	if (E_flag) {		/* branches instead of a session */
+		if (!x_flag) {
+			puts("option -E needs a ROM loaded with -x");
+			return(1);
+		}
+		return(explore_run());
+	}
+#endif
 
-	if (l_flag)		/* load core */
-		if (load_core())
+	if (l_flag) {		/* load core */
+		if (*nfn == '\0')
+			strcpy(nfn, SNAP_FILE);
+		if (snap_load(nfn))
 			return(1);
+	}
 
 	int_on();		/* initialize UNIX interrupts */
 	init_io();		/* initialize I/O devices */
@@ -311,12 +1044,71 @@ puts(" #####    ###     #####    ###            #####    ###   #     #");
 	mon();			/* run system */
 
 	if (s_flag)		/* save core */
-		save_core();
+		snap_save(SNAP_FILE, SNAP_COMPRESS);
+
+#ifdef WANT_PROF
+	if (p_flag)		/* write profile */
+		prof_exit();
+#endif
+#ifdef WANT_SAMP
+	if (S_flag)		/* write sampling profile */
+		samp_exit();
+#endif
+#ifdef WANT_COVER
+	if (c_flag)		/* write coverage */
+		cover_exit();
+#endif
+#ifdef WANT_HEAT
+	if (H_flag)		/* write heatmap */
+		heat_exit();
+#endif
+#ifdef WANT_STATS
+	if (T_flag)		/* final statistics */
+		stats_exit();
+#endif
+#ifdef WANT_BUDGET
+	if (G_flag && budget_exit())	/* report budgets */
+		rc = 1;
+#endif
+#ifdef WANT_INTLAT
+	if (L_flag)		/* write interrupt latency report */
+		intlat_exit();
+#endif
+#ifdef WANT_REWIND
+	if (R_flag)		/* report checkpoints */
+		rewind_exit();
+#endif
+#ifdef WANT_TAPE
+	if (tp_flag)		/* report tape use */
+		tape_exit();
+#endif
+#ifdef WANT_BEEP
+	if (a_flag || A_flag)	/* stop the beeper sound */
+		beep_exit();
+#endif
+#ifdef WANT_REPLAY
+	if (k_flag || K_flag)	/* end recording or replay */
+		replay_exit();
+#endif
+#ifdef WANT_BASIC
+	if (o_flag || O_flag)	/* report the BASIC text */
+		basic_exit();
+#endif
+#ifdef WANT_TEXT
+	if (X_flag)		/* last screen text */
+		text_exit();
+#endif
+#ifdef WANT_RELOAD
+	if (M_flag)		/* stop watching the ROM file */
+		reload_exit();
+#endif
+	if (D_flag)		/* LCD bytes per frame */
+		lcd_exit();
 
 	exit_io();		/* stop I/O devices */
 	int_off();		/* stop UNIX interrupts */
 
-	return(0);
+	return(rc);
 }
 
 /*
@@ -371,81 +1163,19 @@ void reset_cpu(void)
 }
 
 /*
- *	This function saves the CPU and the memory into the file core.z80
+ *	Load the labels from the listing given with option -y, else
+ *	try the listing belonging to the file loaded with option -x
  */
-static void save_core(void)
+void load_symbols(void)
 {
-	int fd;
-
-	if ((fd	= open("core.z80", O_WRONLY | O_CREAT, 0600)) == -1) {
-		puts("can't open file core.z80");
-		return;
-	}
-	write(fd, (char	*) &A, sizeof(A));
-	write(fd, (char	*) &F, sizeof(F));
-	write(fd, (char	*) &B, sizeof(B));
-	write(fd, (char	*) &C, sizeof(C));
-	write(fd, (char	*) &D, sizeof(D));
-	write(fd, (char	*) &E, sizeof(E));
-	write(fd, (char	*) &H, sizeof(H));
-	write(fd, (char	*) &L, sizeof(L));
-	write(fd, (char	*) &A_,	sizeof(A_));
-	write(fd, (char	*) &F_,	sizeof(F_));
-	write(fd, (char	*) &B_,	sizeof(B_));
-	write(fd, (char	*) &C_,	sizeof(C_));
-	write(fd, (char	*) &D_,	sizeof(D_));
-	write(fd, (char	*) &E_,	sizeof(E_));
-	write(fd, (char	*) &H_,	sizeof(H_));
-	write(fd, (char	*) &L_,	sizeof(L_));
-	write(fd, (char	*) &I, sizeof(I));
-	write(fd, (char	*) &IFF, sizeof(IFF));
-	write(fd, (char	*) &R, sizeof(R));
-	write(fd, (char	*) &PC,	sizeof(PC));
-	write(fd, (char	*) &SP, sizeof(SP));
-	write(fd, (char	*) &IX,	sizeof(IX));
-	write(fd, (char	*) &IY,	sizeof(IY));
-	write(fd, (char	*) mem_base(), MEMORY_SIZE);
-	close(fd);
-}
+	int rc = 1;
 
-/*
- *	This function loads the CPU and memory from the file core.z80
- */
-int load_core(void)
-{
-	int fd;
-
-	if ((fd	= open("core.z80", O_RDONLY)) == -1) {
-		puts("can't open file core.z80");
-		return(1);
-	}
-	read(fd, (char *) &A, sizeof(A));
-	read(fd, (char *) &F, sizeof(F));
-	read(fd, (char *) &B, sizeof(B));
-	read(fd, (char *) &C, sizeof(C));
-	read(fd, (char *) &D, sizeof(D));
-	read(fd, (char *) &E, sizeof(E));
-	read(fd, (char *) &H, sizeof(H));
-	read(fd, (char *) &L, sizeof(L));
-	read(fd, (char *) &A_, sizeof(A_));
-	read(fd, (char *) &F_, sizeof(F_));
-	read(fd, (char *) &B_, sizeof(B_));
-	read(fd, (char *) &C_, sizeof(C_));
-	read(fd, (char *) &D_, sizeof(D_));
-	read(fd, (char *) &E_, sizeof(E_));
-	read(fd, (char *) &H_, sizeof(H_));
-	read(fd, (char *) &L_, sizeof(L_));
-	read(fd, (char *) &I, sizeof(I));
-	read(fd, (char *) &IFF,	sizeof(IFF));
-	read(fd, (char *) &R, sizeof(R));
-	read(fd, (char *) &PC, sizeof(PC));
-	read(fd, (char *) &SP, sizeof(SP));
-	read(fd, (char *) &IX, sizeof(IX));
-	read(fd, (char *) &IY, sizeof(IY));
-	read(fd, (char *) mem_base(), MEMORY_SIZE);
-	close(fd);
-
-	return(0);
+	if (*yfn)
+		rc = sym_load(yfn);
+	else if (x_flag)
+		rc = sym_load_near(xfn);
+	if (rc == 0)
+		printf("Loaded %d labels from %s\n", sym_count(), sym_file());
 }
 
 /*
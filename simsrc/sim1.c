@@ -54,6 +54,47 @@
 #include "../../frontpanel/frontpanel.h"
 #endif
 #include "memory.h"
+#include "kbd.h"
+#include "lcd.h"
+#ifdef WANT_REPLAY
+#include "replay.h"
+#endif
+#ifdef WANT_BASIC
+#include "basic.h"
+#endif
+#ifdef WANT_TEXT
+#include "text.h"
+#endif
+#ifdef WANT_PROF
+#include "prof.h"
+#endif
+#ifdef WANT_COVER
+#include "cover.h"
+#endif
+#ifdef WANT_HEAT
+#include "heat.h"
+#endif
+#ifdef WANT_STATS
+#include "stats.h"
+#endif
+#ifdef WANT_BENCH
+#include "bench.h"
+#endif
+#ifdef WANT_BUDGET
+#include "budget.h"
+#endif
+#ifdef WANT_INTLAT
+#include "intlat.h"
+#endif
+#ifdef WANT_REWIND
+#include "rewind.h"
+#endif
+#ifdef WANT_TAPE
+#include "tape.h"
+#endif
+#ifdef WANT_BEEP
+#include "beep.h"
+#endif
 
 #ifdef WANT_GUI
 void check_gui_break(void);
@@ -407,6 +448,10 @@ void cpu_z80(void)
 	struct timespec timer;
 	struct timeval t1, t2, tdiff;
 	WORD p;
+#if defined(WANT_PROF) || defined(WANT_COVER) || defined(WANT_BUDGET) || \
+    defined(WANT_INTLAT)
+	WORD pc0, sp0;
+#endif
 
 	gettimeofday(&t1, NULL);
 
@@ -444,6 +489,18 @@ void cpu_z80(void)
 			memwrt(--SP, PC);
 			PC = 0x66;
 			int_nmi = 0;
+#ifdef WANT_STATS
+			if (T_flag)
+				STAT_ADD(stats.ints, 1);
+#endif
+#ifdef WANT_PROF
+			if (p_flag)
+				prof_call(PC, SP);
+#endif
+#ifdef WANT_BUDGET
+			if (G_flag)
+				budget_int(SP);
+#endif
 		}
 
 		if (int_int) {		/* maskable interrupt */
@@ -531,8 +588,43 @@ void cpu_z80(void)
 				PC += memrdr(p) << 8;
 				break;
 			}
+#ifdef WANT_PROF
+			if (p_flag)
+				prof_call(PC, SP);
+#endif
+#ifdef WANT_BUDGET
+			if (G_flag)
+				budget_int(SP);
+#endif
+#ifdef WANT_INTLAT
+			if (L_flag)
+				intlat_int();
+#endif
+#ifdef WANT_STATS
+			if (T_flag)
+				STAT_ADD(stats.ints, 1);
+#endif
 			int_int = 0;
 			int_data = -1;
+#ifdef WANT_REWIND
+			if (R_flag)	/* checkpoint or rewind */
+				rewind_frame();
+#endif
+#ifdef WANT_BEEP
+			if (beep_on)	/* finish the samples of the frame */
+				beep_flush();
+#endif
+			if (kbd_on)	/* keys of the frame */
+				kbd_frame();
+			lcd_frame();	/* LCD bytes of the frame */
+#ifdef WANT_REPLAY
+			if (replay_rec)	/* record the keys of the frame */
+				replay_frame();
+#endif
+#ifdef WANT_TEXT
+			if (text_on)	/* screen text of the frame */
+				text_frame();
+#endif
 #ifdef FRONTPANEL
 			m1_step = 1;
 #endif
@@ -552,10 +644,106 @@ leave:
 		fp_sampleData();
 #endif
 
+#if defined(WANT_PROF) || defined(WANT_COVER) || defined(WANT_BUDGET) || \
+    defined(WANT_INTLAT)
+		pc0 = PC;
+		sp0 = SP;
+#endif
+#ifdef WANT_HEAT
+		heat_pc = PC;
+#endif
+
+#ifdef WANT_TAPE
+		if (tape_on && (PC == tape_ld || PC == tape_sa))
+			tape_rom();	/* LD-BYTES, SA-BYTES */
+#endif
+#ifdef WANT_BASIC
+		if (basic_on && PC == basic_ki)
+			basic_key();	/* load, paste into KEY-INPUT */
+#endif
+#ifdef WANT_TEXT
+		if (text_on && PC >= text_lo && PC <= text_hi)
+			text_trap();	/* characters printed */
+#endif
+
 		int_protection = 0;
 		states = (*op_sim[memrdr(PC++)]) (); /* execute next opcode */
+		if (io_wait) {		/* wait states of I/O devices */
+			states += io_wait;
+			io_wait = 0;
+		}
 		t += states;
 
+#ifdef WANT_PROF
+		if (p_flag)		/* count for profiler */
+			prof_step(pc0, sp0, states);
+#endif
+#ifdef WANT_COVER
+		if (c_flag)		/* record coverage */
+			cover_step(pc0);
+#endif
+#ifdef WANT_HEAT
+		if (H_flag)		/* stack high-water mark */
+			heat_sp(SP);
+#endif
+#ifdef WANT_BUDGET
+		if (G_flag)		/* check routine budgets */
+			budget_step(pc0, sp0, states);
+#endif
+#ifdef WANT_STATS
+		if (T_flag) {		/* runtime statistics */
+			STAT_ADD(stats.tstates, states);
+			STAT_ADD(stats.insns, 1);
+		}
+#endif
+
+		if (int_period) {	/* interrupt counted in T-states */
+			int_tcnt += states;
+			if (int_tcnt >= int_period) {
+				int_tcnt -= int_period;
+				int_int = 1;
+				int_data = 0xff;
+			}
+		}
+
+#ifdef WANT_INTLAT
+		if (L_flag)		/* interrupt latency, DI regions */
+			intlat_step(pc0, states);
+#endif
+
+#ifdef WANT_BENCH
+		if (bench_tmax) {	/* stop at address or T-states */
+			bench_t += states;
+			if (PC == bench_stop || bench_t >= bench_tmax)
+				cpu_state = STOPPED;
+		}
+#endif
+
+#ifdef WANT_BEEP
+		if (beep_on)		/* clock of the beeper */
+			beep_t += states;
+#endif
+
+#ifdef WANT_BASIC
+		if (basic_run)		/* no speed limit until it's in */
+			t = 0;
+#endif
+
+#ifdef WANT_REPLAY
+		if (replay_on) {	/* keys replayed at their T-states */
+			replay_t += states;
+			if (replay_t >= replay_next)
+				replay_apply();
+		}
+#endif
+
+#ifdef WANT_TAPE
+		if (tape_run) {		/* EAR signal of the tape */
+			tape_step(states);
+			t = 0;		/* no speed limit while it runs */
+		}
+#endif
+
 		if (f_flag) {			/* adjust CPU speed */
 			if (t >= tmax) {
 				gettimeofday(&t2, NULL);
@@ -625,6 +813,12 @@ static int op_halt(void)		/* HALT */
 	if (IFF == 0)	{
 		cpu_error = OPHALT;
 		cpu_state = STOPPED;
+	} else if (int_period) {
+	/* interrupt counted in T-states, skip to it */
+		if (int_period - int_tcnt > 4) {
+			R += (int_period - int_tcnt) / 4 - 1;
+			return(int_period - int_tcnt);
+		}
 	} else {
 	/* else wait for INT, NMI or user interrupt */
 		while ((int_int == 0) && (int_nmi == 0) &&
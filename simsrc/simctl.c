@@ -53,11 +53,20 @@
 #include "simglb.h"
 #include "memory.h"
 #include "unix_terminal.h"
+#include "snap.h"
+#ifdef WANT_WARM
+#include "warm.h"
+#endif
+#ifdef WANT_REPLAY
+#include "replay.h"
+#endif
+#ifdef WANT_RELOAD
+#include "reload.h"
+#endif
 
 int boot(void);
 
 extern int load_file(char *);
-extern int load_core(void);
 extern void cpu_z80(void), cpu_8080(void);
 //ashwinm extern struct dskdef disks[];
 
@@ -79,7 +88,16 @@ void mon(void)
 	/* initialise terminal */
 	set_unix_terminal();
 
+#ifdef WANT_REPLAY
+	/* count the T-states of the key recording from here */
+	if (replay_on)
+		replay_start();
+#endif
+
 	/* start CPU emulation */
+#ifdef WANT_RELOAD
+again:
+#endif
 	cpu_state = CONTIN_RUN;
 	cpu_error = NONE;
 	switch(cpu) {
@@ -91,6 +109,14 @@ void mon(void)
 		break;
 	}
 
+#ifdef WANT_RELOAD
+	/* stopped for the changed ROM, go on with it */
+	if (reload_pending && cpu_error == NONE) {
+		reload_rom();
+		goto again;
+	}
+#endif
+
 	/* reset terminal */
 	reset_unix_terminal();
 
@@ -153,11 +179,17 @@ int boot(void)
 
 	puts("\r\nBooting...\r\n");
 
-	if (l_flag) {
-		return(load_core());
+	if (l_flag) {		/* imported snapshots need the ROM */
+		if (x_flag && load_file(xfn))
+			return(1);
+		return(snap_load(nfn));
 	}
 
 	if (x_flag) {
+#ifdef WANT_WARM
+		if (C_flag)	/* from or into the boot cache */
+			return(warm_boot());
+#endif
 		return(load_file(xfn));
 	}
 
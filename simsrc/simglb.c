@@ -58,40 +58,44 @@
 int cpu = DEFAULT_CPU;
 
 /*
- *	CPU Registers
+ *	CPU Registers, MSTATE is per thread with the machine API
  */
-BYTE A,B,C,D,E,H,L;		/* primary registers */
-int  F;				/* normally 8-Bit, but int is faster */
-WORD IX, IY;			/* Z80 index registers */
-BYTE A_,B_,C_,D_,E_,H_,L_;	/* Z80 alternate registers */
-int  F_;
-WORD PC;			/* programm counter */
-WORD SP;			/* stackpointer */
-BYTE I;				/* Z80 interrupt register */
-BYTE IFF;			/* interrupt flags */
-long R;				/* Z80 refresh register */
+MSTATE BYTE A,B,C,D,E,H,L;	/* primary registers */
+MSTATE int  F;			/* normally 8-Bit, but int is faster */
+MSTATE WORD IX, IY;		/* Z80 index registers */
+MSTATE BYTE A_,B_,C_,D_,E_,H_,L_; /* Z80 alternate registers */
+MSTATE int  F_;
+MSTATE WORD PC;			/* programm counter */
+MSTATE WORD SP;			/* stackpointer */
+MSTATE BYTE I;			/* Z80 interrupt register */
+MSTATE BYTE IFF;		/* interrupt flags */
+MSTATE long R;			/* Z80 refresh register */
 				/* is normally a 8 bit register */
 				/* the larger bits are used to measure the */
 				/* clock frequency */
 
 #ifdef BUS_8080
-BYTE cpu_bus;			/* CPU bus status, for frontpanels */
-int m1_step;			/* flag for waiting at M1 in single step */
+MSTATE BYTE cpu_bus;		/* CPU bus status, for frontpanels */
+MSTATE int m1_step;		/* flag for waiting at M1 in single step */
 #endif
 
-BYTE io_port;			/* I/O port used */
-BYTE io_port_h;			/* Upper 8 bits of I/O port used */
-BYTE io_data;			/* data on I/O port */
-int busy_loop_cnt[MAXCHAN];	/* counters for I/O busy loop detection */
+MSTATE BYTE io_port;		/* I/O port used */
+MSTATE BYTE io_port_h;		/* Upper 8 bits of I/O port used */
+MSTATE BYTE io_data;		/* data on I/O port */
+MSTATE int busy_loop_cnt[MAXCHAN]; /* counters for I/O busy loop detection */
 
-BYTE cpu_state;			/* state of CPU emulation */
-int cpu_error;			/* error status of CPU emulation */
-int int_mode;			/* CPU interrupt mode (IM 0, IM 1, IM 2) */
-int int_nmi;			/* non maskable interrupt request */
-int int_int;			/* interrupt request */
-int int_data = -1;		/* data from interrupting device on data bus */
-int int_protection;		/* to delay interrupts after EI */
-BYTE bus_request;		/* request address/data bus from CPU */
+MSTATE BYTE cpu_state;		/* state of CPU emulation */
+MSTATE int cpu_error;		/* error status of CPU emulation */
+MSTATE int int_mode;		/* CPU interrupt mode (IM 0, IM 1, IM 2) */
+MSTATE int int_nmi;		/* non maskable interrupt request */
+MSTATE int int_int;		/* interrupt request */
+MSTATE int int_data = -1;	/* data from interrupting device on data bus */
+MSTATE int int_protection;	/* to delay interrupts after EI */
+MSTATE int int_period;		/* T-states between interrupts, 0 = timer */
+MSTATE int int_tcnt;		/* T-states since last interrupt */
+MSTATE int lcd_wait;		/* wait states per I/O to the LCD */
+MSTATE int io_wait;		/* wait states of the last instruction */
+MSTATE BYTE bus_request;	/* request address/data bus from CPU */
 int tmax;			/* max t-states to execute in 10ms */
 
 /*
@@ -140,6 +144,32 @@ int m_flag = -1;		/* flag for -m option */
 int x_flag;			/* flag for -x option */
 int i_flag;			/* flag for -i option */
 int f_flag;			/* flag for -f option */
+int p_flag;			/* flag for -P option */
+int S_flag;			/* flag for -S option */
+int c_flag;			/* flag for -c option */
+int H_flag;			/* flag for -H option */
+int T_flag;			/* flag for -T option */
+int tfd;			/* fd for statistics (option -T) */
+int B_flag;			/* flag for -B option */
+double bench_pct = 1.0;		/* regression threshold (option -b) */
+int G_flag;			/* flag for -G option */
+int L_flag;			/* flag for -L option */
+int W_flag;			/* flag for -W option */
+int F_flag;			/* flag for -F option */
+int E_flag;			/* flag for -E option */
+int R_flag;			/* flag for -R option */
+int C_flag;			/* flag for -C option */
+int tp_flag;			/* flag for -t option */
+int e_flag;			/* flag for -e option */
+int a_flag;			/* flag for -a option */
+int A_flag;			/* flag for -A option */
+int k_flag;			/* flag for -k option */
+int K_flag;			/* flag for -K option */
+int o_flag;			/* flag for -o option */
+int O_flag;			/* flag for -O option */
+int X_flag;			/* flag for -X option */
+int M_flag;			/* flag for -M option */
+int D_flag;			/* flag for -D option */
 #ifdef Z80_UNDOC
 int u_flag;			/* flag for -u option */
 #endif
@@ -148,6 +178,28 @@ int u_flag;			/* flag for -u option */
  *	Variables for configuration and disk images
  */
 char xfn[4096];			/* buffer for filename (option -x) */
+char yfn[4096];			/* listing with labels (option -y) */
+char pfn[4096];			/* profile output file (option -P) */
+char sfn[4096];			/* sampling profile file (option -S) */
+char cfn[4096];			/* coverage data file (option -c) */
+char hfn[4096];			/* heatmap output files (option -H) */
+char bfn[4096];			/* ROM to benchmark against (option -B) */
+char gfn[4096];			/* T-state budget file (option -G) */
+char lfn[4096];			/* interrupt latency report (option -L) */
+char wsp[4096];			/* configurations to sweep (option -W) */
+char wfn[4096];			/* CSV output of the sweep (option -w) */
+char ffn[4096];			/* corpus of programs (option -F) */
+char efn[4096];			/* branches to explore (option -E) */
+char nfn[4096];			/* snapshot to load (option -l, -I) */
+char rsp[4096];			/* frames[:MB] of the rewind ring (option -R) */
+char cdir[4096];		/* cache of boot snapshots (option -C) */
+char tpfn[4096];		/* tape file (option -t) */
+char afn[4096];			/* WAV file of the beeper (option -A) */
+char kfn[4096];			/* keys recorded (option -k) */
+char Kfn[4096];			/* keys replayed (option -K) */
+char ofn[4096];			/* BASIC program to load (option -o) */
+char Ofn[4096];			/* BASIC lines to paste (option -O) */
+char Xfn[4096];			/* screen text per frame (option -X) */
 char *diskdir = NULL;		/* path for disk images (option -d) */
 char diskd[4096];		/* disk image directory in use */
 char confdir[4096];		/* path for configuration files */
@@ -49,33 +49,60 @@
 
 extern int	cpu;
 
-extern BYTE	A, B, C, D, E, H, L, A_, B_, C_, D_, E_, H_, L_, I, IFF;
-extern WORD	PC, SP, IX, IY;
-extern int	F, F_;
-extern long	R;
-extern BYTE	io_port, io_data;
-extern BYTE	io_port_h;
+extern MSTATE BYTE A, B, C, D, E, H, L, A_, B_, C_, D_, E_, H_, L_, I, IFF;
+extern MSTATE WORD PC, SP, IX, IY;
+extern MSTATE int F, F_;
+extern MSTATE long R;
+extern MSTATE BYTE io_port, io_data;
+extern MSTATE BYTE io_port_h;
 
 #ifdef BUS_8080
-extern BYTE	cpu_bus;
-extern int	m1_step;
+extern MSTATE BYTE cpu_bus;
+extern MSTATE int m1_step;
 #endif
 
-extern BYTE	cpu_state, bus_request;
-extern int	int_data;
+extern MSTATE BYTE cpu_state, bus_request;
+extern MSTATE int int_data, int_period, int_tcnt, lcd_wait, io_wait,
+		cpu_error, int_nmi, int_int, int_mode, int_protection;
 
 extern int	s_flag, l_flag, m_flag, x_flag, break_flag, i_flag, f_flag,
-		cpu_error, int_nmi, int_int, int_mode, parity[], sb_next,
-		int_protection;
+		p_flag, S_flag, c_flag, H_flag, T_flag, tfd, B_flag, G_flag,
+		L_flag, W_flag, F_flag, E_flag, R_flag, C_flag,
+		tp_flag, e_flag, a_flag, A_flag, k_flag, K_flag, o_flag, O_flag,
+		X_flag, M_flag, D_flag,
+		parity[], sb_next;
 
 #ifdef Z80_UNDOC
 extern int	u_flag;
 #endif
 
 extern int	tmax;
-extern int	busy_loop_cnt[];
+extern MSTATE int busy_loop_cnt[];
 
 extern char	xfn[];
+extern char	yfn[];
+extern char	pfn[];
+extern char	sfn[];
+extern char	cfn[];
+extern char	hfn[];
+extern char	bfn[];
+extern char	gfn[];
+extern char	lfn[];
+extern char	wsp[];
+extern char	wfn[];
+extern char	ffn[];
+extern char	efn[];
+extern char	nfn[];
+extern char	rsp[];
+extern char	cdir[];
+extern char	tpfn[];
+extern char	afn[];
+extern char	kfn[];
+extern char	Kfn[];
+extern char	ofn[];
+extern char	Ofn[];
+extern char	Xfn[];
+extern double	bench_pct;
 extern char	*diskdir, diskd[];
 extern char	confdir[];
 
@@ -51,6 +51,7 @@
  *	user_int()	: handler for user interrupt (CNTL-C)
  *	quit_int()	: handler for signal "quit" (CNTL-\)
  *	term_int()	: handler for signal SIGTERM when process is killed
+ *	usr1_register()	: add a function to run on signal SIGUSR1
  */
 
 #include <unistd.h>
@@ -59,16 +60,41 @@
 #include <string.h>
 #include <termios.h>
 #include <signal.h>
+#include <pthread.h>
 #include "sim.h"
 #include "simglb.h"
 
+#define MAXUSR1	8	/* max. no. of functions run on SIGUSR1 */
+
 static void user_int(int), quit_int(int), term_int(int);
+static void *usr1_thread(void *);
 extern void exit_io(void);
 extern struct termios old_term;
 
+static void (*usr1_fn[MAXUSR1]) (void);
+static int usr1_num;
+
 void int_on(void)
 {
 	static struct sigaction newact;
+	pthread_t tid;
+	sigset_t set, old;
+
+	/*
+	 * SIGUSR1 is handled by a thread of its own, so that the
+	 * registered functions may do I/O. It must not take the
+	 * signals meant for the CPU thread, so it starts with all
+	 * signals blocked.
+	 */
+	if (usr1_num) {
+		sigfillset(&set);
+		pthread_sigmask(SIG_SETMASK, &set, &old);
+		pthread_create(&tid, NULL, usr1_thread, NULL);
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		sigemptyset(&set);
+		sigaddset(&set, SIGUSR1);
+		pthread_sigmask(SIG_BLOCK, &set, NULL);
+	}
 
 	newact.sa_handler = user_int;
 	memset((void *) &newact.sa_mask, 0, sizeof(newact.sa_mask));
@@ -118,3 +144,31 @@ static void term_int(int sig)
 	puts("\nKilled by user");
 	exit(0);
 }
+
+/*
+ *	Register a function to be run on signal SIGUSR1,
+ *	must be called before int_on()
+ */
+void usr1_register(void (*fn)(void))
+{
+	if (usr1_num < MAXUSR1)
+		usr1_fn[usr1_num++] = fn;
+}
+
+static void *usr1_thread(void *arg)
+{
+	sigset_t set;
+	int i, sig;
+
+	arg = arg;	/* to avoid compiler warning */
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	for (;;) {
+		if (sigwait(&set, &sig) != 0)
+			continue;
+		for (i = 0; i < usr1_num; i++)
+			(*usr1_fn[i]) ();
+	}
+	return(NULL);
+}
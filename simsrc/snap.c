@@ -0,0 +1,683 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module saves and loads snapshots of the machine.
+ *
+ * A snapshot file is a header followed by the payload:
+ *
+ *	offset	size	header, numbers little endian
+ *	0	8	SNAP_MAGIC
+ *	8	2	version
+ *	10	2	flags, SNAP_RLE and SNAP_GRAM
+ *	12	4	size of the state in the payload
+ *	16	4	size of the payload in the file
+ *	20	4	size of the payload unpacked
+ *	24	8	checksum of the payload in the file
+ *
+ * The payload is the state, CPU registers, interrupt and scheduler
+ * state, I/O ports and the LCD controller registers, followed by
+ * the memory and the GRAM of the LCD. All numbers in the state have
+ * fixed sizes and are little endian, so snapshots don't depend on the
+ * host. Later versions only append to the state, snapshots of older
+ * versions still load.
+ *
+ * With SNAP_RLE the payload is packed in 16 bit words: a count byte
+ * n below 128 is followed by n + 1 words as they are, from 128 up by
+ * one word repeated n - 125 times, which suits the RGB565 GRAM.
+ *
+ * A snapshot is written with one writev() and loaded from a mmap() of
+ * the file, the checksum is checked before the machine is changed.
+ *
+ * Files without SNAP_MAGIC are imported by their extension as .sna or
+ * .z80 snapshot of a 48K Spectrum: the CPU and the RAM from 0x4000 up,
+ * as far as the memory goes. The ROM loaded with -x stays.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "lcd.h"
+#include "snap.h"
+
+#define SUM_MUL		0x9e3779b97f4a7c15ULL
+#define RUN_MIN		3		/* min. words packed as a run */
+#define RUN_MAX		130		/* max. words of a run */
+#define LIT_MAX		128		/* max. words of a literal */
+
+#define RAM_START	0x4000		/* RAM of the Spectrum */
+#define RAM_48K		49152
+#define SNA_HEADER	27		/* .sna header, 48K RAM follows */
+#define Z80_HEADER	30		/* .z80 version 1 header */
+#define Z80_PAGE	16384		/* memory page of .z80 version 2/3 */
+
+static void put(BYTE **p, unsigned long long v, int n)
+{
+	while (n--) {
+		*(*p)++ = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static unsigned long long get(const BYTE **p, int n)
+{
+	unsigned long long v = 0;
+	register int i;
+
+	for (i = n - 1; i >= 0; i--)
+		v = (v << 8) | (*p)[i];
+	*p += n;
+	return(v);
+}
+
+static WORD get16(const BYTE *p)
+{
+	return(p[0] | (p[1] << 8));
+}
+
+/*
+ *	64 bit little endian word, one load on such hosts
+ */
+static unsigned long long le64(const BYTE *p)
+{
+	return((unsigned long long) p[0] | (unsigned long long) p[1] << 8 |
+	       (unsigned long long) p[2] << 16 |
+	       (unsigned long long) p[3] << 24 |
+	       (unsigned long long) p[4] << 32 |
+	       (unsigned long long) p[5] << 40 |
+	       (unsigned long long) p[6] << 48 |
+	       (unsigned long long) p[7] << 56);
+}
+
+/*
+ *	Checksum of n bytes, continuing h, parts may be summed one
+ *	after the other as long as all but the last are multiples of 8
+ */
+static unsigned long long snap_sum(unsigned long long h, const BYTE *p,
+				   size_t n)
+{
+	const BYTE *q;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		h = (h ^ le64(p)) * SUM_MUL;
+		h ^= h >> 29;
+	}
+	if (n) {
+		q = p;
+		h = (h ^ get(&q, n)) * SUM_MUL;
+		h ^= h >> 29;
+	}
+	return(h);
+}
+
+/*
+ *	Hash of n bytes, changes with the version of the format
+ */
+unsigned long long snap_hash(const BYTE *p, size_t n)
+{
+	return(snap_sum(SNAP_VERSION, p, n));
+}
+
+/*
+ *	Pack n bytes from src into dst, n is even, returns the
+ *	packed size
+ */
+static size_t rle_pack(const BYTE *src, size_t n, BYTE *dst)
+{
+	const BYTE *end = src + n;
+	BYTE *d = dst, *lit = NULL;
+	int r;
+
+	while (src < end) {
+		for (r = 1; r < RUN_MAX && src + 2 * r < end &&
+		     src[2 * r] == src[0] && src[2 * r + 1] == src[1]; r++)
+			;
+		if (r >= RUN_MIN) {
+			*d++ = r + 125;
+			*d++ = src[0];
+			*d++ = src[1];
+			src += 2 * r;
+			lit = NULL;
+			continue;
+		}
+		if (lit == NULL || *lit == LIT_MAX - 1) {
+			lit = d++;
+			*lit = 0;
+		} else
+			(*lit)++;
+		*d++ = *src++;
+		*d++ = *src++;
+	}
+	return(d - dst);
+}
+
+/*
+ *	Unpack n bytes from src into size bytes at dst, 0 if ok
+ */
+static int rle_unpack(const BYTE *src, size_t n, BYTE *dst, size_t size)
+{
+	const BYTE *end = src + n;
+	BYTE *d = dst, *dend = dst + size;
+	size_t len;
+	int c;
+
+	while (src < end) {
+		c = *src++;
+		if (c < LIT_MAX) {
+			len = 2 * (c + 1);
+			if ((size_t) (end - src) < len ||
+			    (size_t) (dend - d) < len)
+				return(1);
+			memcpy(d, src, len);
+			d += len;
+			src += len;
+		} else {
+			c -= 125;
+			if (end - src < 2 || dend - d < 2 * c)
+				return(1);
+			while (c--) {
+				*d++ = src[0];
+				*d++ = src[1];
+			}
+			src += 2;
+		}
+	}
+	return(d != dend);
+}
+
+/*
+ *	CPU, LCD and I/O state into s
+ */
+void snap_state_get(BYTE *s)
+{
+	struct il9341_state st;
+	BYTE *p = s;
+
+	memset(s, 0, SNAP_STATE);
+	(*lcd->save)(&st);
+	put(&p, cpu, 1);
+	put(&p, A, 1);
+	put(&p, F, 1);
+	put(&p, B, 1);
+	put(&p, C, 1);
+	put(&p, D, 1);
+	put(&p, E, 1);
+	put(&p, H, 1);
+	put(&p, L, 1);
+	put(&p, A_, 1);
+	put(&p, F_, 1);
+	put(&p, B_, 1);
+	put(&p, C_, 1);
+	put(&p, D_, 1);
+	put(&p, E_, 1);
+	put(&p, H_, 1);
+	put(&p, L_, 1);
+	put(&p, I, 1);
+	put(&p, IFF, 1);
+	put(&p, PC, 2);
+	put(&p, SP, 2);
+	put(&p, IX, 2);
+	put(&p, IY, 2);
+	put(&p, R, 4);
+	put(&p, int_int, 1);
+	put(&p, int_nmi, 1);
+	put(&p, int_mode, 1);
+	put(&p, int_protection, 1);
+	put(&p, int_data, 4);
+	put(&p, int_period, 4);
+	put(&p, int_tcnt, 4);
+	put(&p, lcd_wait, 4);
+	put(&p, io_wait, 4);
+	put(&p, io_port, 1);
+	put(&p, io_port_h, 1);
+	put(&p, io_data, 1);
+	put(&p, t_states, 8);
+	put(&p, st.data_count, 4);
+	put(&p, st.current_cmd, 1);
+	put(&p, st.x, 4);
+	put(&p, st.y, 4);
+	put(&p, st.start_x, 4);
+	put(&p, st.end_x, 4);
+	put(&p, st.start_y, 4);
+	put(&p, st.end_y, 4);
+	put(&p, st.wr_count, 4);
+	put(&p, st.colmod, 1);
+	put(&p, st.px_count, 1);
+	put(&p, st.px[0], 1);
+	put(&p, st.px[1], 1);
+}
+
+/*
+ *	CPU, LCD and I/O state from size bytes at s
+ */
+void snap_state_set(const BYTE *s, size_t size)
+{
+	struct il9341_state st;
+	BYTE buf[SNAP_STATE];
+	const BYTE *p = buf;
+	int c;
+
+	memset(buf, 0, SNAP_STATE);	/* older versions are shorter */
+	memcpy(buf, s, size < SNAP_STATE ? size : SNAP_STATE);
+	(*lcd->save)(&st);		/* keeps the GRAM of the thread */
+	if ((c = get(&p, 1)) == Z80 || c == I8080)
+		cpu = c;
+	A = get(&p, 1);
+	F = get(&p, 1);
+	B = get(&p, 1);
+	C = get(&p, 1);
+	D = get(&p, 1);
+	E = get(&p, 1);
+	H = get(&p, 1);
+	L = get(&p, 1);
+	A_ = get(&p, 1);
+	F_ = get(&p, 1);
+	B_ = get(&p, 1);
+	C_ = get(&p, 1);
+	D_ = get(&p, 1);
+	E_ = get(&p, 1);
+	H_ = get(&p, 1);
+	L_ = get(&p, 1);
+	I = get(&p, 1);
+	IFF = get(&p, 1);
+	PC = get(&p, 2);
+	SP = get(&p, 2);
+	IX = get(&p, 2);
+	IY = get(&p, 2);
+	R = get(&p, 4);
+	int_int = get(&p, 1);
+	int_nmi = get(&p, 1);
+	int_mode = get(&p, 1);
+	int_protection = get(&p, 1);
+	int_data = (int) get(&p, 4);
+	int_period = get(&p, 4);
+	int_tcnt = get(&p, 4);
+	lcd_wait = get(&p, 4);
+	io_wait = get(&p, 4);
+	io_port = get(&p, 1);
+	io_port_h = get(&p, 1);
+	io_data = get(&p, 1);
+	t_states = get(&p, 8);
+	st.data_count = get(&p, 4);
+	st.current_cmd = get(&p, 1);
+	st.x = get(&p, 4);
+	st.y = get(&p, 4);
+	st.start_x = get(&p, 4);
+	st.end_x = get(&p, 4);
+	st.start_y = get(&p, 4);
+	st.end_y = get(&p, 4);
+	st.wr_count = get(&p, 4);
+	st.colmod = get(&p, 1);
+	st.px_count = get(&p, 1);
+	st.px[0] = get(&p, 1);
+	st.px[1] = get(&p, 1);
+	(*lcd->restore)(&st);
+}
+
+/*
+ *	Save the machine into file fn, packed if compress isn't 0,
+ *	0 if ok
+ */
+int snap_save(char *fn, int compress)
+{
+	BYTE head[SNAP_HEADER], state[SNAP_STATE];
+	BYTE *gram, *raw = NULL, *pack = NULL, *p = head;
+	struct iovec iov[4];
+	unsigned long long sum;
+	size_t size, psize;
+	int fd, n, gsize, flags = 0;
+
+	snap_state_get(state);
+	if ((gram = il9341_gram(&gsize)) != NULL)
+		flags |= SNAP_GRAM;
+	else
+		gsize = 0;
+	size = SNAP_STATE + MEMORY_SIZE + gsize;
+
+	if (compress) {
+		raw = malloc(size);
+		pack = malloc(size + size / LIT_MAX + 16);
+		if (raw == NULL || pack == NULL) {
+			puts("out of memory for snapshot");
+			free(raw);
+			free(pack);
+			return(1);
+		}
+		memcpy(raw, state, SNAP_STATE);
+		memcpy(raw + SNAP_STATE, mem_base(), MEMORY_SIZE);
+		if (gsize)
+			memcpy(raw + SNAP_STATE + MEMORY_SIZE, gram, gsize);
+		psize = rle_pack(raw, size, pack);
+		sum = snap_sum(0, pack, psize);
+		iov[1].iov_base = pack;
+		iov[1].iov_len = psize;
+		n = 2;
+		flags |= SNAP_RLE;
+	} else {
+		psize = size;
+		sum = snap_sum(0, state, SNAP_STATE);
+		sum = snap_sum(sum, mem_base(), MEMORY_SIZE);
+		iov[1].iov_base = state;
+		iov[1].iov_len = SNAP_STATE;
+		iov[2].iov_base = mem_base();
+		iov[2].iov_len = MEMORY_SIZE;
+		n = 3;
+		if (gsize) {
+			sum = snap_sum(sum, gram, gsize);
+			iov[3].iov_base = gram;
+			iov[3].iov_len = gsize;
+			n++;
+		}
+	}
+
+	memcpy(p, SNAP_MAGIC, 8);
+	p += 8;
+	put(&p, SNAP_VERSION, 2);
+	put(&p, flags, 2);
+	put(&p, SNAP_STATE, 4);
+	put(&p, psize, 4);
+	put(&p, size, 4);
+	put(&p, sum, 8);
+	iov[0].iov_base = head;
+	iov[0].iov_len = SNAP_HEADER;
+
+	if ((fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1) {
+		printf("can't open file %s\n", fn);
+		n = -1;
+	} else if (writev(fd, iov, n) != (ssize_t) (SNAP_HEADER + psize)) {
+		printf("can't write file %s\n", fn);
+		n = -1;
+	}
+	if (fd != -1)
+		close(fd);
+	free(raw);
+	free(pack);
+	return(n == -1);
+}
+
+/*
+ *	Load a snapshot of this format from the mapped file f
+ */
+static int snap_native(char *fn, const BYTE *f, size_t size)
+{
+	const BYTE *p = f + 8;
+	BYTE *raw = NULL, *gram;
+	unsigned long long sum;
+	size_t ssize, psize, usize;
+	int version, flags, gsize, n;
+
+	version = get(&p, 2);
+	flags = get(&p, 2);
+	ssize = get(&p, 4);
+	psize = get(&p, 4);
+	usize = get(&p, 4);
+	sum = get(&p, 8);
+	if (version < 1 || version > SNAP_VERSION) {
+		printf("%s: snapshot version %d not supported\n", fn, version);
+		return(1);
+	}
+	if (psize != size - SNAP_HEADER) {
+		printf("%s: snapshot truncated\n", fn);
+		return(1);
+	}
+	gsize = (flags & SNAP_GRAM) ? LCD_GRAM : 0;
+	if (usize != ssize + MEMORY_SIZE + gsize) {
+		printf("%s: snapshot of another machine\n", fn);
+		return(1);
+	}
+	if (snap_sum(0, p, psize) != sum) {
+		printf("%s: snapshot checksum error\n", fn);
+		return(1);
+	}
+	if (flags & SNAP_RLE) {
+		if ((raw = malloc(usize)) == NULL) {
+			puts("out of memory for snapshot");
+			return(1);
+		}
+		if (rle_unpack(p, psize, raw, usize)) {
+			printf("%s: snapshot corrupt\n", fn);
+			free(raw);
+			return(1);
+		}
+		p = raw;
+	}
+
+	snap_state_set(p, ssize);
+	memcpy(mem_base(), p + ssize, MEMORY_SIZE);
+	if (gsize && (gram = il9341_gram(&n)) != NULL)
+		memcpy(gram, p + ssize + MEMORY_SIZE, gsize);
+	free(raw);
+	return(0);
+}
+
+/*
+ *	48K RAM of an imported snapshot into memory, the CPU is
+ *	set by the caller
+ */
+static void snap_ram(char *fn, const BYTE *ram)
+{
+	int n = MEMORY_SIZE - RAM_START;
+	register int i;
+
+	memcpy(mem_base() + RAM_START, ram, n);
+	for (i = n; i < RAM_48K; i++)
+		if (ram[i]) {
+			printf("%s: RAM from %04X up ignored\n", fn,
+			       RAM_START + n);
+			break;
+		}
+	cpu = Z80;
+	int_int = int_nmi = int_protection = 0;
+	int_data = -1;
+	t_states = 0;
+}
+
+/*
+ *	Import a 48K .sna snapshot
+ */
+static int snap_sna(char *fn, const BYTE *f, size_t size)
+{
+	const BYTE *ram = f + SNA_HEADER;
+	WORD sp = get16(f + 23);
+
+	if (size != SNA_HEADER + RAM_48K) {
+		printf("%s: not a 48K .sna snapshot\n", fn);
+		return(1);
+	}
+	if (sp < RAM_START || sp == 0xffff) {
+		printf("%s: stack pointer %04X not in RAM\n", fn, sp);
+		return(1);
+	}
+
+	I = f[0];
+	L_ = f[1];
+	H_ = f[2];
+	E_ = f[3];
+	D_ = f[4];
+	C_ = f[5];
+	B_ = f[6];
+	F_ = f[7];
+	A_ = f[8];
+	L = f[9];
+	H = f[10];
+	E = f[11];
+	D = f[12];
+	C = f[13];
+	B = f[14];
+	IY = get16(f + 15);
+	IX = get16(f + 17);
+	IFF = (f[19] & 4) ? 3 : 0;
+	R = f[20];
+	F = f[21];
+	A = f[22];
+	int_mode = f[25] & 3;
+	PC = get16(ram + sp - RAM_START);	/* RETN of the saver */
+	SP = sp + 2;
+	snap_ram(fn, ram);
+	return(0);
+}
+
+/*
+ *	Unpack a .z80 memory block into size bytes at d, 0 if ok
+ */
+static int z80_unpack(const BYTE *s, size_t n, BYTE *d, size_t size)
+{
+	size_t i = 0, o = 0;
+
+	while (i < n && o < size) {
+		if (i + 3 < n && s[i] == 0xed && s[i + 1] == 0xed) {
+			if (o + s[i + 2] > size)
+				return(1);
+			memset(d + o, s[i + 3], s[i + 2]);
+			o += s[i + 2];
+			i += 4;
+		} else
+			d[o++] = s[i++];
+	}
+	return(o != size);
+}
+
+/*
+ *	Import a 48K .z80 snapshot of version 1, 2 or 3
+ */
+static int snap_z80(char *fn, const BYTE *f, size_t size)
+{
+	BYTE ram[RAM_48K];
+	const BYTE *p, *end = f + size;
+	WORD pc;
+	int flags, extra, len, page;
+
+	if (size < Z80_HEADER) {
+		printf("%s: not a .z80 snapshot\n", fn);
+		return(1);
+	}
+	memset(ram, 0, RAM_48K);
+	flags = (f[12] == 0xff) ? 1 : f[12];	/* 255 means 1 */
+	if ((pc = get16(f + 6)) != 0) {		/* version 1 */
+		p = f + Z80_HEADER;
+		if ((flags & 0x20) ? z80_unpack(p, end - p, ram, RAM_48K)
+				   : (end - p < RAM_48K)) {
+			printf("%s: .z80 snapshot corrupt\n", fn);
+			return(1);
+		}
+		if (!(flags & 0x20))
+			memcpy(ram, p, RAM_48K);
+	} else {				/* version 2 or 3 */
+		extra = (size < Z80_HEADER + 2) ? 0 : get16(f + 30);
+		if (extra < 23 || size < (size_t) (Z80_HEADER + 2 + extra)) {
+			printf("%s: .z80 snapshot corrupt\n", fn);
+			return(1);
+		}
+		pc = get16(f + 32);
+		if (f[34] > (extra == 23 ? 2 : 3)) {
+			printf("%s: only 48K snapshots supported\n", fn);
+			return(1);
+		}
+		for (p = f + Z80_HEADER + 2 + extra; end - p >= 3; p += len) {
+			len = get16(p);
+			page = p[2];
+			p += 3;
+			if (len == 0xffff)
+				len = Z80_PAGE;
+			if (end - p < len) {
+				printf("%s: .z80 snapshot corrupt\n", fn);
+				return(1);
+			}
+			if (page != 8 && page != 4 && page != 5)
+				continue;
+			page = (page == 8) ? 0 : (page == 4) ? 1 : 2;
+			if (len == Z80_PAGE)
+				memcpy(ram + page * Z80_PAGE, p, Z80_PAGE);
+			else if (z80_unpack(p, len, ram + page * Z80_PAGE,
+					    Z80_PAGE)) {
+				printf("%s: .z80 snapshot corrupt\n", fn);
+				return(1);
+			}
+		}
+	}
+
+	A = f[0];
+	F = f[1];
+	C = f[2];
+	B = f[3];
+	L = f[4];
+	H = f[5];
+	PC = pc;
+	SP = get16(f + 8);
+	I = f[10];
+	R = (f[11] & 0x7f) | ((flags & 1) << 7);
+	E = f[13];
+	D = f[14];
+	C_ = f[15];
+	B_ = f[16];
+	E_ = f[17];
+	D_ = f[18];
+	L_ = f[19];
+	H_ = f[20];
+	A_ = f[21];
+	F_ = f[22];
+	IY = get16(f + 23);
+	IX = get16(f + 25);
+	IFF = (f[27] ? 1 : 0) | (f[28] ? 2 : 0);
+	int_mode = f[29] & 3;
+	snap_ram(fn, ram);
+	return(0);
+}
+
+/*
+ *	1 if the name fn has extension ext
+ */
+static int snap_ext(char *fn, char *ext)
+{
+	char *p = strrchr(fn, '.');
+
+	return(p != NULL && strcasecmp(p, ext) == 0);
+}
+
+/*
+ *	Load the machine from file fn, a snapshot of this format or
+ *	an .sna or .z80 snapshot, 0 if ok
+ */
+int snap_load(char *fn)
+{
+	struct stat sbuf;
+	BYTE *f;
+	int fd, rc;
+
+	if ((fd = open(fn, O_RDONLY)) == -1) {
+		printf("can't open file %s\n", fn);
+		return(1);
+	}
+	if (fstat(fd, &sbuf) == -1 || sbuf.st_size == 0 ||
+	    (f = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+	    == MAP_FAILED) {
+		printf("can't read file %s\n", fn);
+		close(fd);
+		return(1);
+	}
+	close(fd);
+
+	if (sbuf.st_size >= SNAP_HEADER && memcmp(f, SNAP_MAGIC, 8) == 0)
+		rc = snap_native(fn, f, sbuf.st_size);
+	else if (snap_ext(fn, ".sna"))
+		rc = snap_sna(fn, f, sbuf.st_size);
+	else if (snap_ext(fn, ".z80"))
+		rc = snap_z80(fn, f, sbuf.st_size);
+	else {
+		printf("%s: not a snapshot\n", fn);
+		rc = 1;
+	}
+	munmap(f, sbuf.st_size);
+	return(rc);
+}
@@ -0,0 +1,30 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module saves and loads snapshots of the machine.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _SNAP_H_
+#define _SNAP_H_
+
+#define SNAP_FILE	"core.snp"	/* snapshot of options -s and -l */
+#define SNAP_MAGIC	"NSPCSNAP"
+#define SNAP_VERSION	2
+#define SNAP_HEADER	32		/* size of the header */
+#define SNAP_STATE	128		/* size of CPU, LCD and I/O state */
+#define SNAP_COMPRESS	1		/* -s writes compressed snapshots */
+
+					/* flags in the header */
+#define SNAP_RLE	1		/* payload is run length encoded */
+#define SNAP_GRAM	2		/* payload contains the LCD GRAM */
+
+extern int snap_save(char *, int);
+extern int snap_load(char *);
+extern void snap_state_get(BYTE *);
+extern void snap_state_set(const BYTE *, size_t);
+extern unsigned long long snap_hash(const BYTE *, size_t);
+
+#endif
@@ -0,0 +1,39 @@
+
+#include "sim.h"
+
+#include "lcd.h"
+
+// ST7789 driver. Its command set is the one of the ILI9341 for the
+// window, memory write and pixel formats, with 12 bit colour added.
+// The panels of 240x320 are used turned like the ILI9341 ones.
+
+extern MSTATE BYTE current_cmd, colmod;
+extern MSTATE int px_count;
+extern MSTATE BYTE px[2];
+
+static void st7789_wr_data(BYTE data)
+{
+  if (current_cmd != 0x2c || (colmod & 7) != 3)
+  {
+    il9341_wr_data(data);
+    return;
+  }
+
+  // 12 bit, two pixels of 4 bits red, green and blue in 3 bytes
+  if (px_count < 2)
+  {
+    px[px_count++] = data;
+    return;
+  }
+  px_count = 0;
+  il9341_pixel(((px[0] & 0xf0) << 8) | ((px[0] & 0x0f) << 7) |
+               ((px[1] & 0xf0) >> 3));
+  il9341_pixel(((px[1] & 0x0f) << 12) | ((data & 0xf0) << 3) |
+               ((data & 0x0f) << 1));
+}
+
+struct lcd_driver lcd_st7789 = {
+  "st7789", 320, 240, 0x04, { 0x85, 0x85, 0x52 },
+  il9341_wr_cmd, st7789_wr_data, il9341_rd_data, il9341_update,
+  il9341_save, il9341_restore
+};
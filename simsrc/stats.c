@@ -0,0 +1,252 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module publishes runtime statistics of the emulation.
+ *
+ * The CPU loop and the I/O handlers only bump the counters in stats,
+ * one I/O handler in STATS_IO_EVERY is timed.
+ * A thread of its own takes a snapshot every STATS_MS milliseconds,
+ * computes the rates and
+ *	- copies everything into the shared memory /newspec-<pid>
+ *	  under a sequence lock, for external monitors to poll
+ *	- writes it as one JSON line to the file descriptor given
+ *	  with option -T, if it isn't 0
+ * On SIGUSR1 and on exit a readable summary is written to stderr.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "sim.h"
+#include "simglb.h"
+#include "stats.h"
+
+extern void usr1_register(void (*)(void));
+
+struct stats_cnt stats;			/* counters of the CPU thread */
+unsigned int stats_ios;			/* I/O's, to time a sample of them */
+
+static struct stats_shm *shm;		/* published statistics */
+static struct stats_shm prev;		/* last snapshot, for the rates */
+static char shm_name[32];
+static unsigned long long ns_start;
+static pthread_t tid;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *	Host time in ns
+ */
+unsigned long long stats_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ *	Charge the host time since t0 to an I/O handler, for all the I/O's
+ *	of the sample it was timed for
+ */
+void stats_io(int lcd, unsigned long long t0)
+{
+	unsigned long long ns = (stats_ns() - t0) * STATS_IO_EVERY;
+
+	if (lcd)
+		STAT_ADD(stats.ns_lcd, ns);
+	else
+		STAT_ADD(stats.ns_io, ns);
+}
+
+/*
+ *	Take a snapshot of the counters and compute the rates
+ */
+static void stats_take(struct stats_shm *s)
+{
+	unsigned long long *src = (unsigned long long *) &stats;
+	unsigned long long *dst = (unsigned long long *) &s->cnt;
+	struct rusage ru;
+	double dt;
+	register unsigned int i;
+
+	for (i = 0; i < sizeof(stats) / sizeof(unsigned long long); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	s->ns_run = stats_ns() - ns_start;
+	dt = (s->ns_run - prev.ns_run) / 1e9;
+	if (dt > 0) {
+		s->mhz = (s->cnt.tstates - prev.cnt.tstates) / dt / 1e6;
+		s->mips = (s->cnt.insns - prev.cnt.insns) / dt / 1e6;
+		s->fps = (s->cnt.frames - prev.cnt.frames) / dt;
+	}
+	getrusage(RUSAGE_SELF, &ru);
+	s->cpu_user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+	s->cpu_sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	s->nvcsw = ru.ru_nvcsw;
+	s->nivcsw = ru.ru_nivcsw;
+	s->magic = STATS_MAGIC;
+	s->version = STATS_VERSION;
+	s->pid = getpid();
+}
+
+/*
+ *	Copy a snapshot into the shared memory
+ */
+static void stats_publish(struct stats_shm *s)
+{
+	unsigned int seq;
+
+	if (shm == NULL)
+		return;
+	seq = shm->seq;
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	s->seq = seq + 1;
+	memcpy(shm, s, sizeof(*s));
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void stats_json(struct stats_shm *s)
+{
+	char buf[16384];
+	register int i, n;
+
+	n = sprintf(buf, "{\"t\":%.3f,\"mhz\":%.3f,\"mips\":%.3f,"
+		    "\"fps\":%.1f,\"tstates\":%llu,\"insns\":%llu,"
+		    "\"ints\":%llu,\"frames\":%llu,\"lcd_ms\":%llu,"
+		    "\"io_ms\":%llu,\"user\":%.3f,\"sys\":%.3f,"
+		    "\"nvcsw\":%ld,\"nivcsw\":%ld,\"in\":{",
+		    s->ns_run / 1e9, s->mhz, s->mips, s->fps,
+		    s->cnt.tstates, s->cnt.insns, s->cnt.ints, s->cnt.frames,
+		    (s->cnt.ns_lcd + s->cnt.ns_frame) / 1000000,
+		    s->cnt.ns_io / 1000000,
+		    s->cpu_user, s->cpu_sys, s->nvcsw, s->nivcsw);
+	for (i = 0; i < 256; i++)
+		if (s->cnt.in[i])
+			n += sprintf(buf + n, "%s\"%02x\":%llu",
+				     buf[n - 1] == '{' ? "" : ",", i,
+				     s->cnt.in[i]);
+	n += sprintf(buf + n, "},\"out\":{");
+	for (i = 0; i < 256; i++)
+		if (s->cnt.out[i])
+			n += sprintf(buf + n, "%s\"%02x\":%llu",
+				     buf[n - 1] == '{' ? "" : ",", i,
+				     s->cnt.out[i]);
+	n += sprintf(buf + n, "}}\n");
+	if (write(tfd, buf, n) != n)
+		tfd = 0;		/* reader has gone, stop writing */
+}
+
+static void *stats_thread(void *arg)
+{
+	struct timespec ts;
+	struct stats_shm s;
+
+	arg = arg;	/* to avoid compiler warning */
+
+	ts.tv_sec = STATS_MS / 1000;
+	ts.tv_nsec = (STATS_MS % 1000) * 1000000L;
+	for (;;) {
+		nanosleep(&ts, NULL);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		pthread_mutex_lock(&stats_lock);
+		memset(&s, 0, sizeof(s));
+		stats_take(&s);
+		stats_publish(&s);
+		if (tfd > 0)
+			stats_json(&s);
+		prev = s;
+		pthread_mutex_unlock(&stats_lock);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	}
+	return(NULL);
+}
+
+/*
+ *	Readable summary on stderr
+ */
+static void stats_dump(void)
+{
+	struct stats_shm s;
+	double run, lcd, io;
+	register int i;
+
+	pthread_mutex_lock(&stats_lock);
+	memset(&s, 0, sizeof(s));
+	stats_take(&s);
+	pthread_mutex_unlock(&stats_lock);
+
+	run = s.ns_run / 1e9;
+	lcd = (s.cnt.ns_lcd + s.cnt.ns_frame) / 1e9;
+	io = s.cnt.ns_io / 1e9;
+	fprintf(stderr, "\r\nRuntime statistics after %.3f s\r\n", run);
+	fprintf(stderr, "T-states     %14llu  %8.3f MHz\r\n", s.cnt.tstates,
+		run > 0 ? s.cnt.tstates / run / 1e6 : 0.0);
+	fprintf(stderr, "instructions %14llu  %8.3f MIPS\r\n", s.cnt.insns,
+		run > 0 ? s.cnt.insns / run / 1e6 : 0.0);
+	fprintf(stderr, "interrupts   %14llu\r\n", s.cnt.ints);
+	fprintf(stderr, "frames       %14llu  %8.1f fps\r\n", s.cnt.frames,
+		run > 0 ? s.cnt.frames / run : 0.0);
+	fprintf(stderr, "host time    %8.3f s LCD, %.3f s other I/O, "
+		"%.3f s CPU\r\n", lcd, io, run - lcd - io);
+	fprintf(stderr, "host CPU     %8.3f s user, %.3f s sys, "
+		"%ld/%ld context switches\r\n", s.cpu_user, s.cpu_sys,
+		s.nvcsw, s.nivcsw);
+	for (i = 0; i < 256; i++)
+		if (s.cnt.in[i] || s.cnt.out[i])
+			fprintf(stderr, "port %02X      %14llu IN %14llu OUT "
+				"%10.0f OUT/s\r\n", i, s.cnt.in[i],
+				s.cnt.out[i],
+				run > 0 ? s.cnt.out[i] / run : 0.0);
+}
+
+/*
+ *	Create the shared memory and start the statistics thread
+ */
+void stats_init(void)
+{
+	sigset_t set, old;
+	int fd;
+
+	ns_start = stats_ns();
+
+	sprintf(shm_name, "/newspec-%d", (int) getpid());
+	if ((fd = shm_open(shm_name, O_CREAT | O_RDWR, 0644)) == -1 ||
+	    ftruncate(fd, sizeof(struct stats_shm)) == -1 ||
+	    (shm = mmap(NULL, sizeof(struct stats_shm),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+	    == MAP_FAILED) {
+		perror("statistics shared memory");
+		shm = NULL;
+	}
+	if (fd != -1)
+		close(fd);
+
+	/* the thread must not take the signals meant for the CPU */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	pthread_create(&tid, NULL, stats_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	usr1_register(stats_dump);
+}
+
+void stats_exit(void)
+{
+	pthread_cancel(tid);
+	pthread_join(tid, NULL);
+	stats_dump();
+	if (shm != NULL) {
+		munmap(shm, sizeof(struct stats_shm));
+		shm_unlink(shm_name);
+	}
+}
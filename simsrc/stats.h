@@ -0,0 +1,66 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module publishes runtime statistics of the emulation.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#define STATS_MAGIC	0x5a385354	/* "Z8ST" */
+#define STATS_VERSION	1
+#define STATS_MS	1000		/* interval of JSON lines and rates */
+#define STATS_IO_EVERY	64		/* I/O handlers timed one in, power of 2 */
+
+/*
+ *	Counters, written by the CPU thread only
+ */
+struct stats_cnt {
+	unsigned long long tstates;	/* T-states executed */
+	unsigned long long insns;	/* instructions executed */
+	unsigned long long ints;	/* interrupts accepted */
+	unsigned long long frames;	/* display updates presented */
+	unsigned long long ns_lcd;	/* host time in the LCD port handlers,
+					   from a sample of them */
+	unsigned long long ns_frame;	/* host time presenting frames */
+	unsigned long long ns_io;	/* host time in other I/O handlers, too */
+	unsigned long long in[256];	/* IN per port */
+	unsigned long long out[256];	/* OUT per port */
+};
+
+/*
+ *	Layout of the shared memory /newspec-<pid>. A reader copies
+ *	the page and retries while seq was odd or has changed.
+ */
+struct stats_shm {
+	unsigned int magic;		/* STATS_MAGIC */
+	unsigned int version;		/* STATS_VERSION */
+	unsigned int seq;		/* odd while being updated */
+	unsigned int pid;		/* process of the emulator */
+	unsigned long long ns_run;	/* host time since start */
+	double mhz;			/* emulated clock, last interval */
+	double mips;			/* instructions, last interval */
+	double fps;			/* frames, last interval */
+	double cpu_user, cpu_sys;	/* host CPU seconds */
+	long nvcsw, nivcsw;		/* context switches */
+	struct stats_cnt cnt;
+};
+
+/* add to a counter, others may read it without tearing */
+#define STAT_ADD(c, n)	__atomic_store_n(&(c), (c) + (n), __ATOMIC_RELAXED)
+
+/* true for the I/O handlers timed */
+#define STAT_SAMPLE()	((++stats_ios & (STATS_IO_EVERY - 1)) == 0)
+
+extern struct stats_cnt stats;
+extern unsigned int stats_ios;
+
+extern void stats_init(void);
+extern void stats_exit(void);
+extern unsigned long long stats_ns(void);
+extern void stats_io(int, unsigned long long);
+
+#endif
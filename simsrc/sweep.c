@@ -0,0 +1,232 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module sweeps the benchmark over CPU clocks and LCD wait states.
+ *
+ * The configurations are given with option -W as a list of clocks in
+ * MHz and optionally a list of wait states per IN/OUT on the LCD ports:
+ *
+ *	-W 3.33,3.5,4,6:0,1,2
+ *
+ * The ROM loaded with -x is booted once, the machine booted is the
+ * snapshot all runs start from. With option -l or -I the runs start
+ * from the snapshot loaded with it instead, which has to wait for a
+ * key in the editor like the machine booted. One process is forked per
+ * configuration, as many in parallel as the host has cores. Each run
+ * gets the interrupt period of its clock and the wait states, runs
+ * the script of screen operations of the A/B benchmark and leaves
+ * the results in shared memory. The script is the only workload, it
+ * calls ROM routines whose end is known, keys typed have no end to
+ * take the time to.
+ *
+ * The predicted time per operation is written as table, and as CSV
+ * into the file given with option -w.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "simglb.h"
+#include "snap.h"
+#include "bench.h"
+#include "sweep.h"
+
+struct conf {
+	double mhz;			/* CPU clock */
+	int wait;			/* wait states per LCD I/O */
+	pid_t pid;			/* process running it */
+};
+
+static struct conf confs[SWEEP_MAX];
+static int nconfs;
+
+/*
+ *	Parse the configurations clocks[:waits]
+ */
+static int sweep_parse(char *spec)
+{
+	char buf[4096];
+	char *waits, *p, *sv;
+	int wait[SWEEP_MAX];
+	int nwait = 0;
+	double mhz;
+	register int i;
+
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	if ((waits = strchr(buf, ':')) != NULL) {
+		*waits++ = '\0';
+		for (p = strtok_r(waits, ",", &sv); p != NULL;
+		     p = strtok_r(NULL, ",", &sv))
+			if (nwait < SWEEP_MAX)
+				wait[nwait++] = atoi(p);
+	}
+	if (nwait == 0)
+		wait[nwait++] = 0;
+
+	for (p = strtok_r(buf, ",", &sv); p != NULL;
+	     p = strtok_r(NULL, ",", &sv)) {
+		if ((mhz = atof(p)) <= 0.0)
+			return(1);
+		for (i = 0; i < nwait; i++) {
+			if (nconfs == SWEEP_MAX)
+				return(1);
+			confs[nconfs].mhz = mhz;
+			confs[nconfs].wait = wait[i];
+			nconfs++;
+		}
+	}
+	return(nconfs == 0);
+}
+
+/*
+ *	Run one configuration in the forked process
+ */
+static void sweep_child(struct conf *c, struct bench_result *res)
+{
+	f_flag = 0;			/* as fast as possible */
+	lcd_wait = c->wait;
+	int_period = c->mhz * 1000000.0 / SWEEP_HZ;
+	int_tcnt = 0;
+	bench_script(xfn, res);
+	fflush(stdout);
+	_exit(0);
+}
+
+/*
+ *	Short name of an operation, the first word
+ */
+static char *short_name(int i, char *buf)
+{
+	sscanf(bench_opname(i), "%15s", buf);
+	return(buf);
+}
+
+static void sweep_table(struct bench_result *res, int nops)
+{
+	struct bench_result *r;
+	double ms, total;
+	char buf[16];
+	register int i, j;
+
+	printf("\n%s, %d configurations, predicted ms per operation\n\n",
+	       xfn, nconfs);
+	printf("%7s %5s", "MHz", "wait");
+	for (j = 0; j < nops; j++)
+		printf(" %10s", short_name(j, buf));
+	printf(" %10s\n", "total ms");
+	for (i = 0; i < nconfs; i++) {
+		printf("%7.2f %5d", confs[i].mhz, confs[i].wait);
+		total = 0.0;
+		for (j = 0; j < nops; j++) {
+			r = &res[i * nops + j];
+			if (r->failed) {
+				printf(" %10s", "failed");
+				continue;
+			}
+			ms = r->t / confs[i].mhz / 1000.0;
+			total += ms;
+			printf(" %10.2f", ms);
+		}
+		printf(" %10.2f\n", total);
+	}
+}
+
+static void sweep_csv(struct bench_result *res, int nops)
+{
+	FILE *fp;
+	struct bench_result *r;
+	register int i, j;
+
+	if ((fp = fopen(wfn, "w")) == NULL) {
+		printf("can't open file %s\n", wfn);
+		return;
+	}
+	fprintf(fp, "mhz,wait,operation,tstates,outs,ms,failed\n");
+	for (i = 0; i < nconfs; i++)
+		for (j = 0; j < nops; j++) {
+			r = &res[i * nops + j];
+			fprintf(fp, "%.3f,%d,\"%s\",%llu,%llu,%.4f,%d\n",
+				confs[i].mhz, confs[i].wait, bench_opname(j),
+				r->t, r->outs, r->t / confs[i].mhz / 1000.0,
+				r->failed);
+		}
+	fclose(fp);
+}
+
+/*
+ *	Run the sweep, returns exit code
+ */
+int sweep_run(void)
+{
+	struct bench_result *res;
+	int nops, ncpu, running = 0, status, rc = 0;
+	register int i, j;
+	pid_t pid;
+
+	if (sweep_parse(wsp)) {
+		printf("bad configurations %s, expected MHz,...[:wait,...]\n",
+		       wsp);
+		return(1);
+	}
+	bench_init();
+	if (l_flag) {		/* start from the snapshot */
+		if (*nfn == '\0')
+			strcpy(nfn, SNAP_FILE);
+		if (bench_load(xfn) || snap_load(nfn))
+			return(1);
+	} else if (bench_boot(xfn))
+		return(1);
+
+	nops = bench_count();
+	res = mmap(NULL, nconfs * nops * sizeof(struct bench_result),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED) {
+		perror("mmap");
+		return(1);
+	}
+	for (i = 0; i < nconfs * nops; i++)
+		res[i].failed = 1;	/* until a run reports */
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		ncpu = 1;
+
+	fflush(stdout);
+	for (i = 0; i < nconfs || running > 0; ) {
+		if (i < nconfs && running < ncpu) {
+			if ((pid = fork()) == 0)
+				sweep_child(&confs[i], &res[i * nops]);
+			if (pid < 0) {
+				perror("fork");
+				return(1);
+			}
+			confs[i++].pid = pid;
+			running++;
+			continue;
+		}
+		if ((pid = wait(&status)) < 0)
+			break;
+		running--;
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			continue;
+		for (j = 0; j < nconfs; j++)
+			if (confs[j].pid == pid)
+				printf("run %.2f MHz, %d wait states died\n",
+				       confs[j].mhz, confs[j].wait);
+	}
+
+	sweep_table(res, nops);
+	if (*wfn)
+		sweep_csv(res, nops);
+	for (i = 0; i < nconfs * nops; i++)
+		if (res[i].failed)
+			rc = 1;
+	munmap(res, nconfs * nops * sizeof(struct bench_result));
+	return(rc);
+}
@@ -0,0 +1,18 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module sweeps the benchmark over CPU clocks and LCD wait states.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#define SWEEP_MAX	64		/* max. no. of configurations */
+#define SWEEP_HZ	50		/* interrupts per second */
+
+extern int sweep_run(void);
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads the labels of a uz80as/TASM listing, so that
+ * addresses in the ROM can be reported by name.
+ *
+ * The ROM source names its routines twice: the assembler label
+ * (L0B24) and a comment line in front of it (;; PO-ANY). Both are
+ * kept, the comment name is preferred for reports.
+ *
+ * A routine starts at a label with a ;; name or at a label named in
+ * the source (LCD_WRCH). Labels made of the address (L0B24, X007B)
+ * and labels of a routine with _n appended (LCD_WRCH_1) are local.
+ *
+ * History:
+ * 18-OCT-26 first version for the profiler
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "sim.h"
+#include "symtab.h"
+
+#define BUFSIZE	512		/* max line length of listing */
+
+struct symbol {
+	WORD addr;			/* address of label */
+	char label[SYM_NAMELEN];	/* assembler label */
+	char name[SYM_NAMELEN];		/* name from ;; comment, if any */
+	int routine;			/* label starts a routine */
+};
+
+static struct symbol *syms;	/* labels sorted by address */
+static int nsyms;
+static int sym_end;		/* first address after the listing */
+static char sym_fn[4096];	/* name of the listing loaded */
+
+static char *mnemonics[] = {
+	"ADC", "ADD", "AND", "BIT", "CALL", "CCF", "CP", "CPD", "CPDR",
+	"CPI", "CPIR", "CPL", "DAA", "DEC", "DI", "DJNZ", "EI", "EX",
+	"EXX", "HALT", "IM", "IN", "INC", "IND", "INDR", "INI", "INIR",
+	"JP", "JR", "LD", "LDD", "LDDR", "LDI", "LDIR", "NEG", "NOP",
+	"OR", "OTDR", "OTIR", "OUT", "OUTD", "OUTI", "POP", "PUSH", "RES",
+	"RET", "RETI", "RETN", "RL", "RLA", "RLC", "RLCA", "RLD", "RR",
+	"RRA", "RRC", "RRCA", "RRD", "RST", "SBC", "SCF", "SET", "SLA",
+	"SRA", "SRL", "SUB", "XOR", "DEFB", "DEFW", "DEFM", "DEFS", "ORG",
+	"EQU", "END", NULL
+};
+
+static int is_hex(char *s, int n)
+{
+	register int i;
+
+	for (i = 0; i < n; i++)
+		if (!isxdigit((int)s[i]))
+			return(0);
+	return(1);
+}
+
+static int tok_len(char *s)
+{
+	register int n = 0;
+
+	while (s[n] != '\0' && !isspace((int)s[n]))
+		n++;
+	return(n);
+}
+
+static char *skip_space(char *s)
+{
+	while (isspace((int)*s) && *s != '\n')
+		s++;
+	return(s);
+}
+
+/*
+ *	Split one line of a listing into address, object bytes and
+ *	source text. Accepts the TASM layout with or without a leading
+ *	line number:
+ *
+ *		0040   0000 F3          L0000:  DI
+ *		0000 F3                 L0000:  DI
+ *
+ *	Returns 1 if the line carries an address, 0 otherwise.
+ */
+int lst_line(char *line, WORD *addr, BYTE *bytes, int *nbytes, char **src)
+{
+	register char *s, *t;
+	int n;
+
+	*nbytes = 0;
+	s = skip_space(line);
+	n = tok_len(s);
+	t = skip_space(s + n);
+
+	/* line number in front of the address ? */
+	if (n > 0 && isdigit((int)*s) && tok_len(t) == 4 && is_hex(t, 4)) {
+		s = t;
+		n = 4;
+	}
+	if (n != 4 || !is_hex(s, 4)) {
+		*src = s;
+		return(0);
+	}
+	*addr = (WORD) strtol(s, NULL, 16);
+	s = skip_space(s + 4);
+
+	while (tok_len(s) == 2 && is_hex(s, 2) && *nbytes < LST_MAXBYTES) {
+		bytes[(*nbytes)++] = (BYTE) strtol(s, NULL, 16);
+		s = skip_space(s + 2);
+	}
+	*src = s;
+	return(1);
+}
+
+/*
+ *	Check if the source line holds data instead of an instruction
+ */
+int lst_data(char *src)
+{
+	static char *dir[] = { "DEFB", "DEFW", "DEFM", "DEFS", ".BYTE",
+			       ".WORD", ".TEXT", ".FILL", ".BLOCK", NULL };
+	register char **d;
+	register char *s;
+	int n;
+
+	for (s = src; *s && *s != ';'; s++) {
+		if (s != src && !isspace((int)s[-1]))
+			continue;
+		for (d = dir; *d != NULL; d++) {
+			n = strlen(*d);
+			if (strncasecmp(s, *d, n) == 0 &&
+			    (s[n] == '\0' || isspace((int)s[n])))
+				return(1);
+		}
+	}
+	return(0);
+}
+
+static int is_mnemonic(char *s, int n)
+{
+	register char **m;
+
+	for (m = mnemonics; *m != NULL; m++)
+		if ((int) strlen(*m) == n && strncasecmp(*m, s, n) == 0)
+			return(1);
+	return(0);
+}
+
+/*
+ *	Check if the source text starts with a label, copy it to buf
+ */
+static int get_label(char *src, char *buf)
+{
+	register char *s = src;
+	register int n = 0;
+	char *t;
+
+	if (!(isalpha((int)*s) || *s == '_'))
+		return(0);
+	while (isalnum((int)s[n]) || s[n] == '_' || s[n] == '.')
+		n++;
+	t = skip_space(s + n + (s[n] == ':'));
+	if (s[n] != ':') {
+		/* TASM allows labels without colon, but not equates */
+		if (is_mnemonic(s, n) || *t == '=' ||
+		    strncasecmp(t, ".EQU", 4) == 0 ||
+		    strncasecmp(t, "EQU", 3) == 0)
+			return(0);
+	}
+	if (n >= SYM_NAMELEN)
+		n = SYM_NAMELEN - 1;
+	strncpy(buf, s, n);
+	buf[n] = '\0';
+	return(1);
+}
+
+/*
+ *	Check if label s is local to the routine starting at label r
+ */
+static int is_local(char *s, char *r)
+{
+	register int n;
+
+	/* label made of the address, L0B24 */
+	if (strlen(s) == 5 && isalpha((int)*s) && is_hex(s + 1, 4))
+		return(1);
+	/* label of the routine with _n appended, LCD_WRCH_1 */
+	if (r == NULL || strncmp(s, r, n = strlen(r)) != 0 || s[n] != '_' ||
+	    s[n + 1] == '\0')
+		return(0);
+	for (s += n + 1; *s; s++)
+		if (!isdigit((int)*s))
+			return(0);
+	return(1);
+}
+
+static int sym_cmp(const void *a, const void *b)
+{
+	return(((struct symbol *) a)->addr - ((struct symbol *) b)->addr);
+}
+
+/*
+ *	Load the labels from listing file fn
+ */
+int sym_load(char *fn)
+{
+	FILE *fp;
+	char buf[BUFSIZE];
+	char name[SYM_NAMELEN];
+	char label[SYM_NAMELEN];
+	BYTE bytes[LST_MAXBYTES];
+	char *src, *r;
+	WORD addr;
+	int n, size = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		printf("can't open listing %s\n", fn);
+		return(1);
+	}
+
+	free(syms);
+	syms = NULL;
+	nsyms = sym_end = 0;
+	name[0] = '\0';
+
+	while (fgets(buf, BUFSIZE, fp) != NULL) {
+		if (!lst_line(buf, &addr, bytes, &n, &src))
+			continue;
+		if (addr + n > sym_end)
+			sym_end = addr + n;
+		if (src[0] == ';' && src[1] == ';' && src[2] == ' ') {
+			/* ;; NAME comment names the following label */
+			src += 3;
+			n = tok_len(src);
+			if (n >= SYM_NAMELEN)
+				n = SYM_NAMELEN - 1;
+			strncpy(name, src, n);
+			name[n] = '\0';
+			continue;
+		}
+		if (!get_label(src, label))
+			continue;
+		if (nsyms == size) {
+			size = size ? size * 2 : 1024;
+			syms = realloc(syms, size * sizeof(struct symbol));
+			if (syms == NULL) {
+				puts("out of memory for symbols");
+				exit(1);
+			}
+		}
+		syms[nsyms].addr = addr;
+		strcpy(syms[nsyms].label, label);
+		strcpy(syms[nsyms].name, name);
+		name[0] = '\0';
+		nsyms++;
+	}
+	fclose(fp);
+
+	qsort(syms, nsyms, sizeof(struct symbol), sym_cmp);
+	for (n = 0, r = NULL; n < nsyms; n++)
+		if (syms[n].name[0] || !is_local(syms[n].label, r)) {
+			syms[n].routine = 1;
+			r = syms[n].label;
+		} else
+			syms[n].routine = 0;
+	strncpy(sym_fn, fn, sizeof(sym_fn) - 1);
+	return(0);
+}
+
+/*
+ *	Load the listing belonging to file fn, the name with
+ *	extension .lst, if there is one
+ */
+int sym_load_near(char *fn)
+{
+	char lst[4096];
+	char *p;
+
+	strncpy(lst, fn, sizeof(lst) - 5);
+	lst[sizeof(lst) - 5] = '\0';
+	if ((p = strrchr(lst, '.')) != NULL && strchr(p, '/') == NULL)
+		*p = '\0';
+	strcat(lst, ".lst");
+	if (access(lst, R_OK) != 0)
+		return(1);
+	return(sym_load(lst));
+}
+
+/*
+ *	Name of the listing loaded, NULL if none
+ */
+char *sym_file(void)
+{
+	return(sym_fn[0] ? sym_fn : NULL);
+}
+
+int sym_count(void)
+{
+	return(nsyms);
+}
+
+/*
+ *	Find the label an address belongs to, -1 if outside of the listing
+ */
+int sym_find(WORD addr)
+{
+	register int lo = 0, hi = nsyms - 1, mid;
+
+	if (nsyms == 0 || addr < syms[0].addr || addr >= sym_end)
+		return(-1);
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (syms[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return(lo);
+}
+
+/*
+ *	Find the routine an address belongs to, the last label starting
+ *	one, so that local labels don't split it up
+ */
+int sym_routine(WORD addr)
+{
+	register int i = sym_find(addr);
+
+	while (i > 0 && !syms[i].routine)
+		i--;
+	if (i == 0 && !syms[0].routine)
+		return(sym_find(addr));	/* only local labels */
+	return(i);
+}
+
+char *sym_name(int i)
+{
+	return(syms[i].name[0] ? syms[i].name : syms[i].label);
+}
+
+WORD sym_addr(int i)
+{
+	return(syms[i].addr);
+}
+
+/*
+ *	Address of a label or ;; name, -1 if unknown
+ */
+int sym_lookup(char *name)
+{
+	register int i;
+
+	for (i = 0; i < nsyms; i++)
+		if (strcmp(syms[i].name, name) == 0 ||
+		    strcmp(syms[i].label, name) == 0)
+			return(syms[i].addr);
+	return(-1);
+}
+
+/*
+ *	Format an address as LABEL+offset into buf
+ */
+char *sym_label(WORD addr, char *buf)
+{
+	int i = sym_find(addr);
+
+	if (i < 0)
+		sprintf(buf, "%04X", addr);
+	else if (syms[i].addr == addr)
+		sprintf(buf, "%s", sym_name(i));
+	else
+		sprintf(buf, "%s+%d", sym_name(i), addr - syms[i].addr);
+	return(buf);
+}
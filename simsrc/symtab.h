@@ -0,0 +1,31 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads the labels of a uz80as/TASM listing, so that
+ * addresses in the ROM can be reported by name.
+ *
+ * History:
+ * 18-OCT-26 first version for the profiler
+ */
+
+#ifndef _SYMTAB_H_
+#define _SYMTAB_H_
+
+#define SYM_NAMELEN	32		/* max. length of a label */
+#define LST_MAXBYTES	64		/* max. bytes on one listing line */
+
+extern int sym_load(char *);
+extern int sym_load_near(char *);
+extern char *sym_file(void);
+extern int sym_count(void);
+extern int sym_find(WORD);
+extern int sym_routine(WORD);
+extern char *sym_name(int);
+extern WORD sym_addr(int);
+extern int sym_lookup(char *);
+extern char *sym_label(WORD, char *);
+
+extern int lst_line(char *, WORD *, BYTE *, int *, char **);
+extern int lst_data(char *);
+
+#endif
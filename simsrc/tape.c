@@ -0,0 +1,523 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads and saves TAP and TZX tape files.
+ *
+ * With option -t file the tape file is inserted, it is read as TZX if
+ * it starts with the TZX signature, else as TAP. The ROM routines
+ * LD-BYTES and SA-BYTES are looked up in the listing, the modified
+ * ROM has them at other addresses than the original one.
+ *
+ * By default LD-BYTES is trapped: the next block with data is taken
+ * from the tape, its flag byte compared with A and its bytes copied
+ * to IX, or compared with the memory if carry is reset (VERIFY), the
+ * checksum checked and the routine left through SA/LD-RET with carry
+ * set if all went well. If there are no more blocks the ROM routine
+ * runs and waits for a signal, so that BREAK works.
+ *
+ * With option -e the tape is played as signal on the EAR bit of port
+ * FE instead, for loaders that don't use the ROM routine. The pulses
+ * of the blocks are generated from the T-states the CPU runs, in the
+ * ROM timing for TAP files and in the timing of the blocks for TZX
+ * files. The tape starts when LD-BYTES is called, if it isn't in the
+ * listing at once, and stops at pauses of 0 ms and the end of the
+ * tape. While it runs the CPU runs at unlimited speed.
+ *
+ * SA-BYTES is always trapped if found, the block is appended to the
+ * tape file as TAP or TZX block, a new file is TZX if it ends in .tzx.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "tape.h"
+
+#define TZX_MAGIC	"ZXTape!\032"
+#define TZX_HEADER	10		/* size of the file header */
+#define PAD		32		/* zeroes after the file, for parsing */
+
+struct block {
+	BYTE *data;			/* flag, bytes and checksum */
+	int len;
+	int pilot, npilot;		/* pilot pulse and number of them */
+	int sync1, sync2;		/* sync pulses, 0 if none */
+	int zero, one;			/* pulses of the bits */
+	int lastbits;			/* bits used in the last byte */
+	int pause;			/* ms of silence after the block */
+	int stop;			/* stop the tape after the block */
+	BYTE *pulses;			/* TZX pulse sequence */
+	int npulses;
+};
+
+enum { S_BLOCK, S_PILOT, S_SYNC1, S_SYNC2, S_PULSES, S_DATA, S_PAUSE,
+       S_NEXT };
+
+int tape_on;				/* ROM routines are trapped */
+int tape_run;				/* tape plays on the EAR bit */
+int tape_ld = -1, tape_sa = -1;		/* addresses of the ROM routines */
+BYTE tape_ear;				/* level of the EAR bit */
+
+static BYTE *buf;			/* the tape file */
+static struct block *blocks;
+static int nblocks, pos;		/* blocks and the next one */
+static int tzx;				/* tape file is TZX */
+static int trap;			/* loads are trapped */
+static int stage, count, half;		/* pulse generator */
+static long remain;			/* T-states left of the pulse */
+static int loaded, saved;
+
+static int le16(const BYTE *p)
+{
+	return(p[0] | (p[1] << 8));
+}
+
+static int le24(const BYTE *p)
+{
+	return(p[0] | (p[1] << 8) | (p[2] << 16));
+}
+
+static long le32(const BYTE *p)
+{
+	return(le24(p) | ((long) p[3] << 24));
+}
+
+/*
+ *	Standard ROM timing of a block
+ */
+static void block_rom(struct block *b)
+{
+	b->pilot = TAPE_PILOT;
+	b->npilot = (b->len > 0 && b->data[0] < 0x80) ? TAPE_HEADER
+						       : TAPE_DATA;
+	b->sync1 = TAPE_SYNC1;
+	b->sync2 = TAPE_SYNC2;
+	b->zero = TAPE_ZERO;
+	b->one = TAPE_ONE;
+	b->lastbits = 8;
+}
+
+static int block_add(struct block *b)
+{
+	struct block *p;
+
+	if ((p = realloc(blocks, (nblocks + 1) * sizeof(struct block)))
+	    == NULL)
+		return(1);
+	blocks = p;
+	blocks[nblocks++] = *b;
+	return(0);
+}
+
+/*
+ *	Split a TAP file into blocks
+ */
+static void tap_parse(BYTE *p, size_t n)
+{
+	struct block b;
+	size_t i = 0;
+
+	while (i + 2 <= n) {
+		memset(&b, 0, sizeof(b));
+		b.len = le16(p + i);
+		b.data = p + i + 2;
+		if ((i += 2 + b.len) > n) {
+			puts("tape: last TAP block truncated, ignored");
+			break;
+		}
+		block_rom(&b);
+		b.pause = TAPE_PAUSE;
+		if (block_add(&b))
+			break;
+	}
+}
+
+/*
+ *	Split a TZX file into blocks, the blocks without signal are
+ *	skipped
+ */
+static void tzx_parse(BYTE *p, size_t n)
+{
+	struct block b;
+	size_t i = TZX_HEADER;
+	int id, add;
+
+	while (i < n) {
+		memset(&b, 0, sizeof(b));
+		add = 1;
+		switch (id = p[i++]) {
+		case 0x10:		/* standard speed data */
+			b.len = le16(p + i + 2);
+			b.data = p + i + 4;
+			block_rom(&b);
+			b.pause = le16(p + i);
+			i += 4 + b.len;
+			break;
+		case 0x11:		/* turbo speed data */
+			b.pilot = le16(p + i);
+			b.sync1 = le16(p + i + 2);
+			b.sync2 = le16(p + i + 4);
+			b.zero = le16(p + i + 6);
+			b.one = le16(p + i + 8);
+			b.npilot = le16(p + i + 10);
+			b.lastbits = p[i + 12];
+			b.pause = le16(p + i + 13);
+			b.len = le24(p + i + 15);
+			b.data = p + i + 18;
+			i += 18 + b.len;
+			break;
+		case 0x12:		/* pure tone */
+			b.pilot = le16(p + i);
+			b.npilot = le16(p + i + 2);
+			i += 4;
+			break;
+		case 0x13:		/* pulse sequence */
+			b.npulses = p[i];
+			b.pulses = p + i + 1;
+			i += 1 + 2 * b.npulses;
+			break;
+		case 0x14:		/* pure data */
+			b.zero = le16(p + i);
+			b.one = le16(p + i + 2);
+			b.lastbits = p[i + 4];
+			b.pause = le16(p + i + 5);
+			b.len = le24(p + i + 7);
+			b.data = p + i + 10;
+			i += 10 + b.len;
+			break;
+		case 0x20:		/* pause, 0 stops the tape */
+			if ((b.pause = le16(p + i)) == 0)
+				b.stop = 1;
+			i += 2;
+			break;
+		case 0x2a:		/* stop the tape in 48K mode */
+			b.stop = 1;
+			i += 4 + le32(p + i);
+			break;
+		case 0x21:		/* group start */
+		case 0x30:		/* text description */
+			i += 1 + p[i];
+			add = 0;
+			break;
+		case 0x22:		/* group end */
+		case 0x25:		/* loop end */
+		case 0x27:		/* return from sequence */
+			add = 0;
+			break;
+		case 0x23:		/* jump to block */
+		case 0x24:		/* loop start */
+			i += 2;
+			add = 0;
+			break;
+		case 0x26:		/* call sequence */
+			i += 2 + 2 * le16(p + i);
+			add = 0;
+			break;
+		case 0x28:		/* select block */
+		case 0x32:		/* archive info */
+			i += 2 + le16(p + i);
+			add = 0;
+			break;
+		case 0x31:		/* message */
+			i += 2 + p[i + 1];
+			add = 0;
+			break;
+		case 0x33:		/* hardware type */
+			i += 1 + 3 * p[i];
+			add = 0;
+			break;
+		case 0x35:		/* custom info */
+			i += 20 + le32(p + i + 16);
+			add = 0;
+			break;
+		case 0x5a:		/* glue */
+			i += 9;
+			add = 0;
+			break;
+		case 0x15:		/* direct recording */
+			i += 8 + le24(p + i + 5);
+			printf("tape: TZX block %02X not supported, skipped\n",
+			       id);
+			add = 0;
+			break;
+		case 0x18:		/* CSW recording */
+		case 0x19:		/* generalized data */
+		case 0x2b:		/* set signal level */
+			i += 4 + le32(p + i);
+			printf("tape: TZX block %02X not supported, skipped\n",
+			       id);
+			add = 0;
+			break;
+		default:
+			printf("tape: unknown TZX block %02X, rest ignored\n",
+			       id);
+			return;
+		}
+		if (i > n) {
+			puts("tape: last TZX block truncated, ignored");
+			return;
+		}
+		if (b.data != NULL && b.lastbits == 0)
+			b.lastbits = 8;
+		if (add && block_add(&b))
+			return;
+	}
+}
+
+/*
+ *	Next pulse of the tape in T-states, *edge is set if the EAR bit
+ *	changes at its start, 0 if the tape stops
+ */
+static long next_pulse(int *edge)
+{
+	struct block *b = (pos < nblocks) ? &blocks[pos] : NULL;
+	int k;
+
+	*edge = 1;
+	for (;;) {
+		switch (stage) {
+		case S_BLOCK:
+			if (pos >= nblocks) {
+				puts("\r\ntape: end of tape\r");
+				return(0);
+			}
+			b = &blocks[pos];
+			count = b->npilot;
+			stage = S_PILOT;
+			break;
+		case S_PILOT:
+			if (count > 0) {
+				count--;
+				return(b->pilot);
+			}
+			stage = S_SYNC1;
+			break;
+		case S_SYNC1:
+			stage = S_SYNC2;
+			if (b->sync1)
+				return(b->sync1);
+			break;
+		case S_SYNC2:
+			stage = S_PULSES;
+			count = 0;
+			if (b->sync2)
+				return(b->sync2);
+			break;
+		case S_PULSES:
+			if (count < b->npulses)
+				return(le16(b->pulses + 2 * count++));
+			stage = S_DATA;
+			count = half = 0;
+			break;
+		case S_DATA:
+			if (b->len > 0 && count < (b->len - 1) * 8 + b->lastbits) {
+				k = b->data[count >> 3] & (0x80 >> (count & 7));
+				if (++half == 2) {
+					half = 0;
+					count++;
+				}
+				return(k ? b->one : b->zero);
+			}
+			stage = S_PAUSE;
+			break;
+		case S_PAUSE:
+			stage = S_NEXT;
+			if (b->pause) {
+				*edge = tape_ear;	/* silence is low */
+				return((long) b->pause * TAPE_MS);
+			}
+			break;
+		case S_NEXT:
+			pos++;
+			stage = S_BLOCK;
+			if (b->stop)
+				return(0);
+			break;
+		}
+	}
+}
+
+/*
+ *	Called by the CPU with the T-states of every instruction while
+ *	the tape runs
+ */
+void tape_step(int states)
+{
+	long d;
+	int edge;
+
+	if ((remain -= states) > 0)
+		return;
+	do {
+		if ((d = next_pulse(&edge)) == 0) {
+			tape_run = 0;
+			return;
+		}
+		if (edge)
+			tape_ear ^= 1;
+		remain += d;
+	} while (remain <= 0);
+}
+
+/*
+ *	Leave a trapped ROM routine through SA/LD-RET with carry set if ok
+ */
+static void tape_ret(int ok)
+{
+	if (ok)
+		F |= C_FLAG;
+	else
+		F &= ~C_FLAG;
+	IFF = 3;
+	PC = memrdr(SP);
+	PC += memrdr(SP + 1) << 8;
+	SP += 2;
+}
+
+/*
+ *	LD-BYTES: load or verify the next block with data
+ */
+static void tape_load(void)
+{
+	struct block *b;
+	int de, i, load;
+	BYTE parity;
+
+	while (pos < nblocks && blocks[pos].data == NULL)
+		pos++;			/* skip tones and pauses */
+	if (pos >= nblocks) {
+		if (pos++ == nblocks)	/* the ROM waits for a signal */
+			puts("\r\ntape: end of tape\r");
+		return;
+	}
+	b = &blocks[pos++];
+	if (b->len == 0 || b->data[0] != A) {
+		tape_ret(0);		/* not the expected flag */
+		return;
+	}
+
+	load = F & C_FLAG;
+	de = (D << 8) | E;
+	parity = b->data[0];
+	for (i = 1; de > 0 && i < b->len; i++, de--, IX++) {
+		if (load)
+			memwrt(IX, b->data[i]);
+		else if (memrdr(IX) != b->data[i])
+			break;
+		parity ^= b->data[i];
+	}
+	D = de >> 8;
+	E = de & 0xff;
+	loaded++;
+	tape_ret(de == 0 && i < b->len && parity == b->data[i]);
+}
+
+/*
+ *	SA-BYTES: append the block to the tape file
+ */
+static void tape_save(void)
+{
+	BYTE *blk, h[5];
+	int de = (D << 8) | E, i;
+	FILE *fp;
+
+	if ((blk = malloc(de + 2)) == NULL || (fp = fopen(tpfn, "ab")) == NULL) {
+		free(blk);
+		printf("\r\ntape: can't save to %s\r\n", tpfn);
+		tape_ret(0);
+		return;
+	}
+	blk[0] = A;
+	blk[de + 1] = A;
+	for (i = 1; i <= de; i++, IX++) {
+		blk[i] = memrdr(IX);
+		blk[de + 1] ^= blk[i];
+	}
+	D = E = 0;
+
+	fseek(fp, 0L, SEEK_END);
+	if (tzx && ftell(fp) == 0)
+		fwrite(TZX_MAGIC "\001\024", 1, TZX_HEADER, fp);
+	h[0] = 0x10;			/* standard speed data */
+	h[1] = TAPE_PAUSE & 0xff;
+	h[2] = TAPE_PAUSE >> 8;
+	h[3] = (de + 2) & 0xff;
+	h[4] = (de + 2) >> 8;
+	fwrite(tzx ? h : h + 3, 1, tzx ? 5 : 2, fp);
+	fwrite(blk, 1, de + 2, fp);
+	i = fclose(fp);
+	free(blk);
+	if (i == 0)
+		saved++;
+	tape_ret(i == 0);
+}
+
+/*
+ *	Called by the CPU at LD-BYTES and SA-BYTES
+ */
+void tape_rom(void)
+{
+	if (PC == tape_sa)
+		tape_save();
+	else if (trap)
+		tape_load();
+	else if (!tape_run && pos < nblocks) {
+		tape_run = 1;		/* start the tape */
+		remain = 0;
+	}
+}
+
+void tape_init(void)
+{
+	FILE *fp;
+	long n = 0;
+	size_t l = strlen(tpfn);
+
+	tape_ld = sym_lookup(TAPE_LOAD);
+	tape_sa = sym_lookup(TAPE_SAVE);
+	tzx = l > 4 && strcasecmp(tpfn + l - 4, ".tzx") == 0;
+
+	if ((fp = fopen(tpfn, "rb")) != NULL) {
+		fseek(fp, 0L, SEEK_END);
+		n = ftell(fp);
+		rewind(fp);
+		if (n < 0 || (buf = calloc(n + PAD, 1)) == NULL ||
+		    fread(buf, 1, n, fp) != (size_t) n) {
+			printf("tape: can't read %s\n", tpfn);
+			exit(1);
+		}
+		fclose(fp);
+		if (n >= TZX_HEADER && memcmp(buf, TZX_MAGIC, 8) == 0) {
+			tzx = 1;
+			tzx_parse(buf, n);
+		} else
+			tap_parse(buf, n);
+	}
+
+	trap = !e_flag && tape_ld >= 0;
+	if (!e_flag && tape_ld < 0)
+		printf("tape: %s not in listing, playing tape on EAR\n",
+		       TAPE_LOAD);
+	if (tape_sa < 0)
+		printf("tape: %s not in listing, can't save\n", TAPE_SAVE);
+	tape_on = tape_ld >= 0 || tape_sa >= 0;
+	if (!trap && tape_ld < 0)
+		tape_run = nblocks > 0;
+	printf("tape: %s, %s, %d blocks, %s\n", tpfn, tzx ? "TZX" : "TAP",
+	       nblocks, trap ? "instant load" : "EAR signal");
+}
+
+void tape_exit(void)
+{
+	if (loaded || saved)
+		printf("tape: %d blocks loaded, %d saved\n", loaded, saved);
+	free(blocks);
+	free(buf);
+}
@@ -0,0 +1,36 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module loads and saves TAP and TZX tape files.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _TAPE_H_
+#define _TAPE_H_
+
+#define TAPE_LOAD	"LD-BYTES"	/* ROM routines trapped */
+#define TAPE_SAVE	"SA-BYTES"
+
+					/* ROM timing in T-states */
+#define TAPE_PILOT	2168		/* pilot pulse */
+#define TAPE_HEADER	8063		/* pilot pulses of a header */
+#define TAPE_DATA	3223		/* pilot pulses of a data block */
+#define TAPE_SYNC1	667		/* sync pulses */
+#define TAPE_SYNC2	735
+#define TAPE_ZERO	855		/* pulses of a 0 bit */
+#define TAPE_ONE	1710		/* pulses of a 1 bit */
+#define TAPE_PAUSE	1000		/* ms after a TAP block */
+#define TAPE_MS		3500		/* T-states per ms */
+
+extern int tape_on, tape_run;
+extern int tape_ld, tape_sa;
+extern BYTE tape_ear;
+
+extern void tape_init(void);
+extern void tape_exit(void);
+extern void tape_rom(void);
+extern void tape_step(int);
+
+#endif
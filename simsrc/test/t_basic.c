@@ -0,0 +1,51 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Test of the BASIC tokenizer: variables named like a keyword stay
+ * variables, keywords are tokens where they can stand.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include "../basic.c"		/* basic_tokenize() is static */
+
+static struct {
+	const char *text;
+	const char *tokens;
+	int len;
+} tests[] = {
+	{ "LET cat=1: PRINT cat",
+	  "\xf1" "cat=1:" "\xf5" "cat", 11 },
+	{ "IF cat THEN CAT",
+	  "\xfa" "cat" "\xcb\xcf", 6 },
+	{ "LET list=total: PRINT INK 2;list",
+	  "\xf1" "list=total:" "\xf5\xd9" "2;list", 20 },
+	{ "SAVE \"x\" DATA data()",
+	  "\xf8" "\"x\"" "\xe4" "data()", 11 },
+	{ "10 GO TO 20",
+	  "10" "\xec" "20", 5 },
+	{ NULL, NULL, 0 }
+};
+
+int main(void)
+{
+	static BYTE out[BODY];
+	register int i, j;
+	int n, rc = 0;
+
+	for (i = 0; tests[i].text != NULL; i++) {
+		n = basic_tokenize(tests[i].text, out, 0);
+		if (n == tests[i].len &&
+		    memcmp(out, tests[i].tokens, n) == 0)
+			continue;
+		printf("t_basic: %s:", tests[i].text);
+		for (j = 0; j < n; j++)
+			printf(" %02x", out[j]);
+		putchar('\n');
+		rc = 1;
+	}
+	if (rc == 0)
+		puts("t_basic: ok");
+	return(rc);
+}
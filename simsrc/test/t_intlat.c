@@ -0,0 +1,88 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Test of the interrupt latency report: a DI region in a routine of
+ * the LCD driver, which has no ;; name, is charged to the routine and
+ * not to the last routine named in front of it.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../sim.h"
+#include "../simglb.h"
+#include "../memory.h"
+#include "../symtab.h"
+#include "../bench.h"
+#include "../intlat.h"
+
+static char *lst[] = {
+	"0001   0000                    ;; LAST",
+	"0002   0000 CD 05 00           L0000:  CALL LCD_WRCH",
+	"0003   0003 18 FE              L0003:  JR L0003",
+	"0004   0005 F3                 LCD_WRCH:       DI",
+	"0005   0006 06 08                      LD B,8",
+	"0006   0008 00                 LCD_WRCH_1:     NOP",
+	"0007   0009 10 FD                      DJNZ LCD_WRCH_1",
+	"0008   000B FB                         EI",
+	"0009   000C C9                         RET",
+	"0010   000D 3E 00              LCD_WRCH8:      LD A,0",
+	"0011   000F C9                         RET",
+	NULL
+};
+
+static BYTE rom[] = {
+	0xcd, 0x05, 0x00, 0x18, 0xfe, 0xf3, 0x06, 0x08,
+	0x00, 0x10, 0xfd, 0xfb, 0xc9, 0x3e, 0x00, 0xc9
+};
+
+int main(void)
+{
+	char fn[] = "/tmp/t_intlatXXXXXX";
+	char buf[256];
+	FILE *fp;
+	int fd, found = 0;
+	register int i;
+
+	if ((fd = mkstemp(fn)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+		return(1);
+	for (i = 0; lst[i] != NULL; i++)
+		fprintf(fp, "%s\n", lst[i]);
+	fclose(fp);
+	if (sym_load(fn))
+		return(1);
+
+	memcpy(memory, rom, sizeof(rom));
+	PC = 0;
+	SP = 0x8000;
+	IFF = 3;
+	L_flag = 1;
+	strcpy(lfn, fn);
+	intlat_init();
+	if (bench_until(0x0003, 1000)) {
+		puts("t_intlat: LCD_WRCH didn't return");
+		return(1);
+	}
+	intlat_exit();
+
+	if ((fp = fopen(fn, "r")) == NULL)
+		return(1);
+	while (fgets(buf, sizeof(buf), fp) != NULL)
+		if (strstr(buf, "DI regions per routine") != NULL)
+			found = 1;
+		else if (found == 1 && strstr(buf, "  LCD_WRCH\n") != NULL)
+			found = 2;
+	fclose(fp);
+	unlink(fn);
+
+	if (found != 2) {
+		puts("t_intlat: DI region of LCD_WRCH not reported under its name");
+		return(1);
+	}
+	puts("t_intlat: ok");
+	return(0);
+}
@@ -0,0 +1,223 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module keeps the text printed on the screen.
+ *
+ * The ROM's character output is trapped where it is certain: PO-ANY
+ * gets the character code in A, PR-ALL-3 has the screen address the
+ * character goes to in HL after a new line and scrolling were done,
+ * carry set if it goes to the printer instead. In between PO-SCR may
+ * print the scroll? prompt, so the code is latched when PR-ALL is
+ * entered, on a stack of the calls printing, and taken back from it
+ * at PR-ALL-3. Calls left by an error are dropped by their SP. The text line and
+ * column follow from the display file address, for the upper and
+ * the lower screen alike. CL-SCROLL moves the B lines from the bottom
+ * one up, CL-LINE clears the B lines at the bottom, so that the grid
+ * of 24 lines of 32 characters follows the screen. The attributes are
+ * kept by the ROM in its attribute file and are read from there.
+ *
+ * Characters printed with PRINT, LIST, the editor and the reports are
+ * in the grid as their codes, 0 where nothing was printed yet. Graphics
+ * drawn with PLOT, DRAW or POKE are not. The grid is part of the
+ * machine state, a machine of each thread has its own.
+ *
+ * With option -X file the grid is written into file as text at every
+ * frame it changed in, after a line with the frame number. Codes
+ * outside 32-126 are written as '?'.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "symtab.h"
+#include "text.h"
+
+int text_on;				/* output routines are trapped */
+int text_lo, text_hi;			/* range of their addresses */
+
+static int any, all, print, scroll, clear; /* addresses of the routines */
+static MSTATE BYTE grid[TEXT_ROWS][TEXT_COLS];
+static MSTATE BYTE code;		/* character of the last PO-ANY */
+static MSTATE struct {
+	WORD sp;			/* SP at PR-ALL */
+	BYTE code;			/* character it prints */
+} nest[TEXT_NEST];
+static MSTATE int depth;		/* PR-ALL calls printing */
+static MSTATE int dirty;		/* grid changed in this frame */
+static FILE *fp;
+static unsigned long frames, dumps;
+
+/*
+ *	Called by the CPU when PC is between text_lo and text_hi
+ */
+void text_trap(void)
+{
+	int n;
+
+	if (PC == any)
+		code = A;
+	else if (PC == all) {
+		while (depth && nest[depth - 1].sp <= SP)
+			depth--;	/* left by an error */
+		if (depth < TEXT_NEST) {
+			nest[depth].sp = SP;
+			nest[depth++].code = code;
+		}
+	} else if (PC == print) {
+		if (depth == 0)
+			return;
+		n = nest[--depth].code;
+		if (F & C_FLAG)		/* printer */
+			return;
+		grid[(H & 0x18) | (L >> 5)][L & 0x1f] = n;
+		dirty = 1;
+	} else if (PC == scroll) {
+		if ((n = B) < 1 || n >= TEXT_ROWS)
+			return;
+		memmove(grid[TEXT_ROWS - 1 - n], grid[TEXT_ROWS - n],
+			n * TEXT_COLS);
+		dirty = 1;
+	} else if (PC == clear) {
+		if ((n = B) < 1 || n > TEXT_ROWS)
+			return;
+		memset(grid[TEXT_ROWS - n], 0, n * TEXT_COLS);
+		dirty = 1;
+	}
+}
+
+/*
+ *	Character code at row, column, 0 if none
+ */
+BYTE text_char(int row, int col)
+{
+	if (row < 0 || row >= TEXT_ROWS || col < 0 || col >= TEXT_COLS)
+		return(0);
+	return(grid[row][col]);
+}
+
+/*
+ *	Attribute at row, column
+ */
+BYTE text_attr(int row, int col)
+{
+	if (row < 0 || row >= TEXT_ROWS || col < 0 || col >= TEXT_COLS)
+		return(0);
+	return(memory[TEXT_ATTRS + row * TEXT_COLS + col]);
+}
+
+/*
+ *	Text of a row into buf of TEXT_COLS + 1 bytes, without trailing
+ *	spaces, codes outside 32-126 as '?'
+ */
+char *text_line(int row, char *buf)
+{
+	register int i, n = 0;
+	BYTE c;
+
+	for (i = 0; i < TEXT_COLS; i++) {
+		c = text_char(row, i);
+		if (c == 0)
+			c = ' ';
+		buf[i] = (c >= 32 && c <= 126) ? c : '?';
+		if (c != ' ')
+			n = i + 1;
+	}
+	buf[n] = '\0';
+	return(buf);
+}
+
+/*
+ *	Position row * TEXT_COLS + column of the first s on the screen,
+ *	-1 if not there
+ */
+int text_find(const char *s)
+{
+	char buf[TEXT_COLS + 1], *p;
+	register int i;
+
+	for (i = 0; i < TEXT_ROWS; i++)
+		if ((p = strstr(text_line(i, buf), s)) != NULL)
+			return(i * TEXT_COLS + (p - buf));
+	return(-1);
+}
+
+static void text_dump(void)
+{
+	char buf[TEXT_COLS + 1];
+	register int i;
+
+	fprintf(fp, "--- frame %lu\n", frames);
+	for (i = 0; i < TEXT_ROWS; i++)
+		fprintf(fp, "%s\n", text_line(i, buf));
+	dumps++;
+}
+
+/*
+ *	Called by the CPU for every interrupt taken
+ */
+void text_frame(void)
+{
+	frames++;
+	if (fp != NULL && dirty)
+		text_dump();
+	dirty = 0;
+}
+
+/*
+ *	Look up the output routines, 0 if all are in the listing
+ */
+int text_syms(void)
+{
+	int *addr[] = { &any, &all, &print, &scroll, &clear };
+	register int i;
+
+	any = sym_lookup(TEXT_ANY);
+	all = sym_lookup(TEXT_ALL);
+	print = sym_lookup(TEXT_PRINT);
+	scroll = sym_lookup(TEXT_SCROLL);
+	clear = sym_lookup(TEXT_CLEAR);
+	text_lo = 0xffff;
+	text_hi = 0;
+	for (i = 0; i < 5; i++) {
+		if (*addr[i] < 0)
+			return(1);
+		if (*addr[i] < text_lo)
+			text_lo = *addr[i];
+		if (*addr[i] > text_hi)
+			text_hi = *addr[i];
+	}
+	return(0);
+}
+
+void text_init(void)
+{
+	if (text_syms()) {
+		printf("text: %s, %s, %s, %s or %s not in listing, no "
+		       "screen text\n", TEXT_ANY, TEXT_ALL, TEXT_PRINT,
+		       TEXT_SCROLL, TEXT_CLEAR);
+		return;
+	}
+
+	if (X_flag && (fp = fopen(Xfn, "w")) == NULL) {
+		printf("can't create %s\n", Xfn);
+		exit(1);
+	}
+	text_on = 1;
+}
+
+void text_exit(void)
+{
+	if (fp == NULL)
+		return;
+	if (dirty)
+		text_dump();
+	fclose(fp);
+	printf("text: %lu screens of %lu frames written into %s\n", dumps,
+	       frames, Xfn);
+}
@@ -0,0 +1,37 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module keeps the text printed on the screen.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _TEXT_H_
+#define _TEXT_H_
+
+#define TEXT_ROWS	24
+#define TEXT_COLS	32
+#define TEXT_ATTRS	0x5800		/* attribute file of the ROM */
+#define TEXT_NEST	4		/* PR-ALL calls printing at once */
+
+#define TEXT_ANY	"PO-ANY"	/* ROM routines trapped */
+#define TEXT_ALL	"PR-ALL"
+#define TEXT_PRINT	"PR-ALL-3"
+#define TEXT_SCROLL	"CL-SCROLL"
+#define TEXT_CLEAR	"CL-LINE"
+
+extern int text_on;
+extern int text_lo, text_hi;
+
+extern void text_init(void);
+extern void text_exit(void);
+extern void text_trap(void);
+extern void text_frame(void);
+extern int text_syms(void);
+extern BYTE text_char(int, int);
+extern BYTE text_attr(int, int);
+extern char *text_line(int, char *);
+extern int text_find(const char *);
+
+#endif
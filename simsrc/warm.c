@@ -0,0 +1,108 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module starts ROMs from a cache of snapshots taken after boot.
+ *
+ * With option -C dir the file loaded with -x is hashed as it is, the
+ * snapshot dir/<hash>-<lcd>.snp is the machine after booting it with
+ * the LCD controller <lcd> of option -D, whose GRAM size it has. If
+ * there is one, it is loaded instead of the ROM and the session starts
+ * at the BASIC prompt, without the LCD delays, RAM check and NEW of the
+ * boot and without parsing the ROM. Else the ROM is loaded and run
+ * until it waits for a key (WARM_LABEL in the listing), the machine
+ * is written into the cache and the session goes on from there.
+ *
+ * Snapshots are written uncompressed to a file of their own and then
+ * renamed, so that many instances can share one cache directory.
+ * The hash includes the version of the snapshot format, a new one
+ * doesn't load old snapshots.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sim.h"
+#include "simglb.h"
+#include "symtab.h"
+#include "bench.h"
+#include "snap.h"
+#include "lcd.h"
+#include "warm.h"
+
+extern int load_file(char *);
+
+/*
+ *	Hash of the file fn into h, 0 if ok
+ */
+static int warm_hash(char *fn, unsigned long long *h)
+{
+	struct stat sbuf;
+	BYTE *f;
+	int fd;
+
+	if ((fd = open(fn, O_RDONLY)) == -1)
+		return(1);
+	if (fstat(fd, &sbuf) == -1 || sbuf.st_size == 0 ||
+	    (f = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0))
+	    == MAP_FAILED) {
+		close(fd);
+		return(1);
+	}
+	close(fd);
+	*h = snap_hash(f, sbuf.st_size);
+	munmap(f, sbuf.st_size);
+	return(0);
+}
+
+/*
+ *	Boot the -x ROM from the cache or into it, 0 if ok
+ */
+int warm_boot(void)
+{
+	char fn[4096 + 32], tmp[4096 + 48];
+	unsigned long long h;
+	int a;
+
+	if (warm_hash(xfn, &h))
+		return(load_file(xfn));	/* reports the error */
+	snprintf(fn, sizeof(fn), "%s/%016llx-%s.snp", cdir, h, lcd->name);
+	if (access(fn, R_OK) == 0) {
+		if (snap_load(fn) == 0) {
+			printf("Warm start from %s\r\n", fn);
+			return(0);
+		}
+		printf("%s not usable, booting\r\n", fn);
+	}
+
+	if (load_file(xfn))
+		return(1);
+	if ((a = sym_lookup(WARM_LABEL)) < 0) {
+		printf("%s: routine %s not in listing, not cached\r\n", xfn,
+		       WARM_LABEL);
+		return(0);
+	}
+	a = bench_until(a, WARM_TMAX);
+	bench_tmax = 0;			/* the session runs unlimited */
+	if (a) {
+		printf("%s: doesn't boot to %s, not cached\r\n", xfn,
+		       WARM_LABEL);
+		return(0);
+	}
+
+	mkdir(cdir, 0755);		/* if it isn't there yet */
+	snprintf(tmp, sizeof(tmp), "%s.%d", fn, (int) getpid());
+	if (snap_save(tmp, 0) == 0) {
+		if (rename(tmp, fn) == 0)
+			printf("Booted into %s\r\n", fn);
+		else
+			unlink(tmp);
+	}
+	return(0);
+}
@@ -0,0 +1,18 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * This module starts ROMs from a cache of snapshots taken after boot.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#ifndef _WARM_H_
+#define _WARM_H_
+
+#define WARM_LABEL	"WAIT-KEY"	/* routine the boot ends in */
+#define WARM_TMAX	500000000ULL	/* max. T-states for booting */
+
+extern int warm_boot(void);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * zxanno - static T-state and size annotator for uz80as listings
+ *
+ * Reads the listing of the ROM and decodes the object bytes of every
+ * instruction with the tables of the simulator. Without option the
+ * cost of every label is summed up and the loops and straight-line
+ * segments in it are reported:
+ *
+ *	loop	from a backward JR, DJNZ or JP to its target, T-states
+ *		for one iteration with the branch taken
+ *	segment	instructions between entry points and transfers of
+ *		control, worst case takes every conditional branch and
+ *		returns at the end of the segment
+ *
+ * With option -l the listing is written with bytes and T-states
+ * (not taken/taken) in front of every instruction.
+ *
+ * History:
+ * 18-OCT-26 first version
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "symtab.h"
+#include "optab.h"
+
+#define BUFSIZE		512		/* max line length of listing */
+
+struct insn {
+	WORD addr;
+	struct opinfo oi;
+};
+
+static struct insn *insns;		/* instructions of the listing */
+static int ninsns;
+static char label[SYM_NAMELEN + 8];
+static BYTE entry[65536];		/* 1 if address is an entry point */
+
+static void usage(char *pn)
+{
+	printf("usage:\t%s -l -r label[:label] listing\n", pn);
+	puts("\t-l = write the annotated listing");
+	puts("\t-r = report only the routine at label, or the routines");
+	puts("\t     from label up to, not including the second one");
+	exit(1);
+}
+
+static char *t_str(struct opinfo *oi, char *buf)
+{
+	if (oi->t != oi->t_taken)
+		sprintf(buf, "%d/%d", oi->t, oi->t_taken);
+	else
+		sprintf(buf, "%d", oi->t);
+	return(buf);
+}
+
+/*
+ *	Read the listing, write it annotated if fp isn't NULL
+ */
+static int read_listing(char *fn, FILE *fp)
+{
+	FILE *in;
+	char buf[BUFSIZE];
+	char t[16];
+	BYTE bytes[LST_MAXBYTES];
+	struct opinfo oi;
+	char *src;
+	WORD addr;
+	int n, size = 0;
+
+	if ((in = fopen(fn, "r")) == NULL) {
+		printf("can't open listing %s\n", fn);
+		return(1);
+	}
+	while (fgets(buf, BUFSIZE, in) != NULL) {
+		if (!lst_line(buf, &addr, bytes, &n, &src) || n == 0 ||
+		    lst_data(src) || op_decode(bytes, addr, &oi) != n) {
+			if (fp != NULL)
+				fprintf(fp, "%9s %s", "", buf);
+			continue;
+		}
+		if (fp != NULL)
+			fprintf(fp, "%2d %6s %s", n, t_str(&oi, t), buf);
+		if (ninsns == size) {
+			size = size ? size * 2 : 8192;
+			insns = realloc(insns, size * sizeof(struct insn));
+			if (insns == NULL) {
+				puts("out of memory");
+				exit(1);
+			}
+		}
+		insns[ninsns].addr = addr;
+		insns[ninsns].oi = oi;
+		ninsns++;
+	}
+	fclose(in);
+	return(0);
+}
+
+static int max(int a, int b)
+{
+	return((a > b) ? a : b);
+}
+
+/*
+ *	Mark labels and targets of branches as entry points
+ */
+static void mark_entries(void)
+{
+	register int i;
+
+	for (i = 0; i < sym_count(); i++)
+		entry[sym_addr(i)] = 1;
+	for (i = 0; i < ninsns; i++)
+		if (insns[i].oi.kind != OP_PLAIN &&
+		    insns[i].oi.kind != OP_RET && insns[i].oi.kind != OP_JPIND)
+			entry[insns[i].oi.target] = 1;
+}
+
+/*
+ *	Report routine r, instructions i up to e
+ */
+static void report(int r, int i, int e)
+{
+	register struct opinfo *oi;
+	int j, k, bytes = 0, tmin = 0, tmax = 0;
+	int seg, seg_n, seg_b, seg_min, seg_max;
+	char lbl2[SYM_NAMELEN + 8];
+
+	for (j = i; j < e; j++) {
+		bytes += insns[j].oi.len;
+		tmin += insns[j].oi.t;
+		tmax += max(insns[j].oi.t, insns[j].oi.t_taken);
+	}
+	printf("%-24s %04X  %5d bytes  %6d..%d T\n", sym_name(r),
+	       sym_addr(r), bytes, tmin, tmax);
+
+	/* loops closed by a backward branch in this label */
+	for (j = i; j < e; j++) {
+		oi = &insns[j].oi;
+		if ((oi->kind != OP_JR && oi->kind != OP_DJNZ &&
+		     oi->kind != OP_JP) || oi->target > insns[j].addr)
+			continue;
+		for (k = j; k > 0 && insns[k - 1].addr >= oi->target; k--)
+			;
+		if (insns[k].addr != oi->target)
+			continue;	/* not into this listing */
+		bytes = tmin = tmax = 0;
+		for (; k < j; k++) {
+			bytes += insns[k].oi.len;
+			tmin += insns[k].oi.t;
+			tmax += max(insns[k].oi.t, insns[k].oi.t_taken);
+		}
+		bytes += oi->len;
+		printf("  loop    %-20s .. %-20s %4d bytes %6d..%d T/iteration\n",
+		       sym_label(oi->target, label),
+		       sym_label(insns[j].addr, lbl2), bytes,
+		       tmin + oi->t_taken, tmax + oi->t_taken);
+	}
+
+	/* straight-line segments */
+	seg = i;
+	seg_n = seg_b = seg_min = seg_max = 0;
+	for (j = i; j < e; j++) {
+		oi = &insns[j].oi;
+		if (j > seg && entry[insns[j].addr]) {
+			printf("  segment %-20s %4d insns %4d bytes %6d..%d T\n",
+			       sym_label(insns[seg].addr, label), seg_n,
+			       seg_b, seg_min, seg_max);
+			seg = j;
+			seg_n = seg_b = seg_min = seg_max = 0;
+		}
+		seg_n++;
+		seg_b += oi->len;
+		seg_min += oi->t;
+		seg_max += max(oi->t, oi->t_taken);
+		if (oi->kind != OP_PLAIN || j == e - 1) {
+			printf("  segment %-20s %4d insns %4d bytes %6d..%d T\n",
+			       sym_label(insns[seg].addr, label), seg_n,
+			       seg_b, seg_min, seg_max);
+			seg = j + 1;
+			seg_n = seg_b = seg_min = seg_max = 0;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	register char *s;
+	char *pn = argv[0];
+	char *range = NULL;
+	char *to;
+	int l_flag = 0;
+	int i, e, r, first, last = -1;
+
+	while (--argc > 0 && (*++argv)[0] == '-')
+		for (s = argv[0] + 1; *s != '\0'; s++)
+			switch (*s) {
+			case 'l':	/* annotated listing */
+				l_flag = 1;
+				break;
+			case 'r':	/* range of labels */
+				if (*++s == '\0') {
+					if (argc <= 1)
+						usage(pn);
+					argc--;
+					s = *++argv;
+				}
+				range = s;
+				s += strlen(s) - 1;
+				break;
+			default:
+				usage(pn);
+			}
+	if (argc != 1)
+		usage(pn);
+
+	if (sym_load(argv[0]) ||
+	    read_listing(argv[0], l_flag ? stdout : NULL))
+		return(1);
+	if (l_flag)
+		return(0);
+
+	first = 0;
+	if (range != NULL) {
+		if ((to = strchr(range, ':')) != NULL)
+			*to++ = '\0';
+		if ((first = sym_lookup(range)) < 0) {
+			printf("label %s not found\n", range);
+			return(1);
+		}
+		first = sym_addr(sym_routine(first));
+		if (to != NULL && (last = sym_lookup(to)) < 0) {
+			printf("label %s not found\n", to);
+			return(1);
+		}
+	}
+
+	mark_entries();
+	for (i = 0; i < ninsns; i = e) {
+		r = sym_routine(insns[i].addr);
+		for (e = i + 1; e < ninsns &&
+		     sym_routine(insns[e].addr) == r; e++)
+			;
+		if (r < 0)
+			continue;	/* in front of the first label */
+		if (range != NULL) {
+			if (sym_addr(r) < first)
+				continue;
+			if (last < 0 && sym_addr(r) > first)
+				break;
+			if (last >= 0 && sym_addr(r) >= last)
+				break;
+		}
+		report(r, i, e);
+	}
+	return(0);
+}